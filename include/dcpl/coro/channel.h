@@ -0,0 +1,432 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "dcpl/assert.h"
+#include "dcpl/coro/coro.h"
+#include "dcpl/coro/utils.h"
+#include "dcpl/coro/wait_list.h"
+
+namespace dcpl::coro {
+
+// A bounded multi producer, multi consumer channel. Values are stored in a lock-free
+// ring (where each cell carries a sequence number telling whether it is ready to
+// be written or read), so that sends and receives which do not need to wait are a
+// couple of atomic operations. Senders finding the channel full, and receivers
+// finding it empty, queue their waiter nodes (embedded within the awaiters), and are
+// completed by the counterpart which makes room or pushes a value, which performs
+// the operation on their behalf before resuming them.
+// Once closed, sends fail, while receives keep returning the values still in the
+// channel, and then std::nullopt.
+template <typename T>
+class channel {
+  struct send_node : public detail::wait_node {
+    explicit send_node(T value) :
+        value(std::move(value)) {
+    }
+
+    T value;
+    bool sent = false;
+  };
+
+  struct recv_node : public detail::wait_node {
+    std::optional<T> result;
+  };
+
+  struct cell {
+    std::atomic<std::size_t> seq;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+ public:
+  using value_type = T;
+
+  explicit channel(std::size_t capacity) :
+      mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+      cells_(std::make_unique<cell[]>(mask_ + 1)) {
+    for (std::size_t i = 0; i <= mask_; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  channel(const channel&) = delete;
+
+  channel& operator=(const channel&) = delete;
+
+  ~channel() {
+    std::optional<T> value;
+
+    while (ring_pop(&value)) { }
+  }
+
+  std::size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  bool closed() const {
+    return closed_.load(std::memory_order_acquire);
+  }
+
+  // Sends the value, suspending while the channel is full. The awaiter returns
+  // false if the channel has been closed (in which case the value is dropped).
+  [[nodiscard]] auto send(T value) {
+    struct awaiter : public send_node {
+      awaiter(channel* ch, T value) :
+          send_node(std::move(value)),
+          ch(ch) {
+      }
+
+      bool await_ready() {
+        return ch->closed() || (this->sent = ch->push(&this->value));
+      }
+
+      bool await_suspend(std::coroutine_handle<> hcoro) {
+        this->coro = hcoro;
+
+        return ch->send_or_enqueue(this);
+      }
+
+      bool await_resume() const noexcept {
+        return this->sent;
+      }
+
+      channel* ch;
+    };
+
+    return awaiter(this, std::move(value));
+  }
+
+  // Receives a value, suspending while the channel is empty. The awaiter returns
+  // std::nullopt once the channel is closed and drained.
+  [[nodiscard]] auto recv() {
+    struct awaiter : public recv_node {
+      explicit awaiter(channel* ch) :
+          ch(ch) {
+      }
+
+      bool await_ready() {
+        bool was_closed = ch->closed();
+
+        return ch->pop(&this->result) || was_closed;
+      }
+
+      bool await_suspend(std::coroutine_handle<> hcoro) {
+        this->coro = hcoro;
+
+        return ch->recv_or_enqueue(this);
+      }
+
+      std::optional<T> await_resume() {
+        return std::move(this->result);
+      }
+
+      channel* ch;
+    };
+
+    return awaiter(this);
+  }
+
+  // Appends up to max_count values to `values`, suspending only if the channel is
+  // empty, so that consumers can amortize the scheduling costs over many values.
+  // The awaiter returns the number of values received, which is zero only once the
+  // channel is closed and drained.
+  [[nodiscard]] auto recv_many(std::vector<T>* values, std::size_t max_count) {
+    struct awaiter : public recv_node {
+      awaiter(channel* ch, std::vector<T>* values, std::size_t max_count) :
+          ch(ch),
+          values(values),
+          max_count(max_count) {
+      }
+
+      bool await_ready() {
+        bool was_closed = ch->closed();
+
+        count = ch->pop_many(values, max_count);
+
+        return count > 0 || was_closed || max_count == 0;
+      }
+
+      bool await_suspend(std::coroutine_handle<> hcoro) {
+        this->coro = hcoro;
+
+        return ch->recv_or_enqueue(this);
+      }
+
+      std::size_t await_resume() {
+        if (this->result) {
+          values->push_back(std::move(*this->result));
+          count = 1 + ch->pop_many(values, max_count - 1);
+        }
+
+        return count;
+      }
+
+      channel* ch;
+      std::vector<T>* values;
+      std::size_t max_count;
+      std::size_t count = 0;
+    };
+
+    return awaiter(this, values, max_count);
+  }
+
+  bool try_send(T* value) {
+    return !closed() && push(value);
+  }
+
+  std::optional<T> try_recv() {
+    std::optional<T> result;
+
+    pop(&result);
+
+    return result;
+  }
+
+  // Closes the channel, failing all the pending (and future) sends, and resuming
+  // all the pending receivers.
+  void close() {
+    detail::wait_node* senders;
+    detail::wait_node* receivers;
+    {
+      std::lock_guard guard(lock_);
+
+      closed_.store(true, std::memory_order_release);
+      senders = send_waiters_.take();
+      receivers = recv_waiters_.take();
+      num_send_waiters_.store(0, std::memory_order_relaxed);
+      num_recv_waiters_.store(0, std::memory_order_relaxed);
+    }
+    while (senders != nullptr) {
+      detail::wait_node* next = senders->next;
+
+      spawn(senders->coro);
+      senders = next;
+    }
+    while (receivers != nullptr) {
+      detail::wait_node* next = receivers->next;
+      recv_node* node = static_cast<recv_node*>(receivers);
+
+      ring_pop(&node->result);
+      spawn(node->coro);
+      receivers = next;
+    }
+  }
+
+ private:
+  // Moves from *value only if the push succeeds.
+  bool ring_push(T* value) {
+    std::size_t pos = push_pos_.load(std::memory_order_relaxed);
+
+    for (;;) {
+      cell& ccell = cells_[pos & mask_];
+      std::size_t seq = ccell.seq.load(std::memory_order_acquire);
+      std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+      if (diff == 0) {
+        if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          new (ccell.storage) T(std::move(*value));
+          ccell.seq.store(pos + 1, std::memory_order_release);
+
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = push_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Values are popped into an optional, so that T needs not be default constructible.
+  bool ring_pop(std::optional<T>* value) {
+    std::size_t pos = pop_pos_.load(std::memory_order_relaxed);
+
+    for (;;) {
+      cell& ccell = cells_[pos & mask_];
+      std::size_t seq = ccell.seq.load(std::memory_order_acquire);
+      std::intptr_t diff = static_cast<std::intptr_t>(seq) -
+          static_cast<std::intptr_t>(pos + 1);
+
+      if (diff == 0) {
+        if (pop_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          T* cvalue = std::launder(reinterpret_cast<T*>(ccell.storage));
+
+          value->emplace(std::move(*cvalue));
+          cvalue->~T();
+          ccell.seq.store(pos + mask_ + 1, std::memory_order_release);
+
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = pop_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool push(T* value) {
+    if (!ring_push(value)) {
+      return false;
+    }
+    wake_receiver();
+
+    return true;
+  }
+
+  bool pop(std::optional<T>* result) {
+    if (!ring_pop(result)) {
+      return false;
+    }
+    wake_sender();
+
+    return true;
+  }
+
+  std::size_t pop_many(std::vector<T>* values, std::size_t max_count) {
+    std::size_t count = 0;
+    std::optional<T> value;
+
+    for (; count < max_count && ring_pop(&value); ++count) {
+      values->push_back(std::move(*value));
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      if (!wake_sender()) {
+        break;
+      }
+    }
+
+    return count;
+  }
+
+  // The waiter counters are bumped before re-trying the ring operation, and read
+  // after the counterpart ring operation, with full fences in between, so that
+  // either the waiter sees the ring change, or the counterpart sees the waiter.
+  bool send_or_enqueue(send_node* node) {
+    {
+      std::lock_guard guard(lock_);
+
+      if (closed()) {
+        return false;
+      }
+      num_send_waiters_.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!ring_push(&node->value)) {
+        send_waiters_.push_back(node);
+
+        return true;
+      }
+      num_send_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    node->sent = true;
+    wake_receiver();
+
+    return false;
+  }
+
+  bool recv_or_enqueue(recv_node* node) {
+    {
+      std::lock_guard guard(lock_);
+
+      if (closed()) {
+        ring_pop(&node->result);
+
+        return false;
+      }
+      num_recv_waiters_.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!ring_pop(&node->result)) {
+        recv_waiters_.push_back(node);
+
+        return true;
+      }
+      num_recv_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    wake_sender();
+
+    return false;
+  }
+
+  // Called after a value has been pushed, it completes the first waiting receiver
+  // (if any) by popping a value on its behalf.
+  bool wake_receiver() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_recv_waiters_.load(std::memory_order_relaxed) == 0) [[likely]] {
+      return false;
+    }
+
+    recv_node* node;
+    {
+      std::lock_guard guard(lock_);
+
+      node = static_cast<recv_node*>(recv_waiters_.pop_front());
+      if (node == nullptr) {
+        return false;
+      }
+      if (!ring_pop(&node->result)) {
+        // Somebody else got the value, so the receiver keeps its position in line.
+        recv_waiters_.push_front(node);
+
+        return false;
+      }
+      num_recv_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    spawn(node->coro);
+    wake_sender();
+
+    return true;
+  }
+
+  // Called after a value has been popped, it completes the first waiting sender
+  // (if any) by pushing its value on its behalf.
+  bool wake_sender() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_send_waiters_.load(std::memory_order_relaxed) == 0) [[likely]] {
+      return false;
+    }
+
+    send_node* node;
+    {
+      std::lock_guard guard(lock_);
+
+      node = static_cast<send_node*>(send_waiters_.pop_front());
+      if (node == nullptr) {
+        return false;
+      }
+      if (!ring_push(&node->value)) {
+        send_waiters_.push_front(node);
+
+        return false;
+      }
+      num_send_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    node->sent = true;
+    spawn(node->coro);
+    wake_receiver();
+
+    return true;
+  }
+
+  std::size_t mask_;
+  std::unique_ptr<cell[]> cells_;
+  alignas(64) std::atomic<std::size_t> push_pos_ = 0;
+  alignas(64) std::atomic<std::size_t> pop_pos_ = 0;
+  alignas(64) std::atomic<bool> closed_ = false;
+  std::atomic<std::size_t> num_send_waiters_ = 0;
+  std::atomic<std::size_t> num_recv_waiters_ = 0;
+  detail::spin_lock lock_;
+  detail::wait_list send_waiters_;
+  detail::wait_list recv_waiters_;
+};
+
+}
@@ -1,33 +1,73 @@
 #pragma once
 
-#include <functional>
+#include <utility>
 
 #include "dcpl/coro/coro.h"
 #include "dcpl/coro/mutex.h"
+#include "dcpl/coro/utils.h"
+#include "dcpl/coro/wait_list.h"
 
 namespace dcpl::coro {
 
-class condition_variable : public wait_base {
+// A coroutine condition variable, whose waiters are the nodes embedded within the
+// awaiters (no allocations). Notified waiters are queued onto the mutex on their
+// behalf, and once the mutex is handed over to them, their wait function is
+// evaluated (with the mutex held) by the granting thread, so that the coroutine is
+// resumed only when it can proceed, and otherwise goes back waiting without ever
+// being resumed.
+class condition_variable {
+  struct waiter : public detail::wait_node {
+    condition_variable* cv = nullptr;
+    mutex* mtx = nullptr;
+  };
+
  public:
-  [[nodiscard]] auto wait(mutex* mtx, std::function<bool()> wait_fn) {
-    struct awaiter {
-      condition_variable* cv;
-      mutex* mtx;
-      std::function<bool()> wait_fn;
+  condition_variable() = default;
+
+  condition_variable(const condition_variable&) = delete;
+
+  condition_variable& operator=(const condition_variable&) = delete;
+
+  // Must be awaited with the mutex locked, which will be held again once the wait
+  // completes, with wait_fn() returning true.
+  template <typename F>
+  [[nodiscard]] auto wait(mutex* mtx, F wait_fn) {
+    struct awaiter : public waiter {
+      awaiter(condition_variable* cv, mutex* mtx, F wait_fn) :
+          wait_fn(std::move(wait_fn)) {
+        this->cv = cv;
+        this->mtx = mtx;
+        this->on_acquire = &awaiter::acquired;
+      }
 
-      bool await_ready() const noexcept {
+      bool await_ready() {
         return wait_fn();
       }
 
       constexpr void await_resume() const noexcept { }
 
-      bool await_suspend(std::coroutine_handle<> coro) const noexcept {
-        cv->do_wait(coro, mtx, wait_fn);
+      void await_suspend(std::coroutine_handle<> hcoro) noexcept {
+        this->coro = hcoro;
+        this->cv->suspend(this);
+      }
+
+      static bool acquired(detail::wait_node* node) {
+        awaiter* self = static_cast<awaiter*>(node);
+
+        if (!self->wait_fn()) {
+          self->cv->requeue(self);
+
+          return false;
+        }
+        spawn(self->coro);
+
         return true;
       }
+
+      F wait_fn;
     };
 
-    return awaiter{this, mtx, wait_fn};
+    return awaiter(this, mtx, std::move(wait_fn));
   }
 
   void notify_one();
@@ -35,28 +75,14 @@ class condition_variable : public wait_base {
   void notify_all();
 
  private:
-  [[nodiscard]] auto suspend() {
-    struct awaiter {
-      condition_variable* cv;
-
-      constexpr bool await_ready() const noexcept { return false; }
-      constexpr void await_resume() const noexcept { }
-      bool await_suspend(std::coroutine_handle<> coro) const noexcept {
-        cv->do_suspend(coro);
-        return true;
-      }
-    };
-
-    return awaiter{this};
-  }
+  void suspend(waiter* node);
 
-  coro<> waiter(std::coroutine_handle<> coro, mutex* mtx,
-                std::function<bool()> wait_fn);
+  void requeue(waiter* node);
 
-  void do_wait(std::coroutine_handle<> coro, mutex* mtx,
-               std::function<bool()> wait_fn);
+  void wake(waiter* node);
 
-  void do_suspend(std::coroutine_handle<> coro);
+  detail::spin_lock lock_;
+  detail::wait_list waiters_;
 };
 
 }
@@ -5,6 +5,8 @@
 #include <optional>
 #include <type_traits>
 
+#include "dcpl/coro/frame_pool.h"
+
 namespace dcpl::coro {
 
 class exception_base {
@@ -75,15 +77,18 @@ class value_base<no_value> : public exception_base {
   void return_void() {}
 };
 
-template <typename T, typename IS, typename FS>
+template <typename T, typename IS, typename FS, typename FA>
 class coro;
 
+// The FA policy selects how coroutine frames are allocated, with pooled_frames
+// recycling them through the per-thread frame_pool caches.
 template <typename T = no_value,
           typename IS = std::suspend_always,
-          typename FS = std::suspend_always>
-class coro_promise : public value_base<T> {
+          typename FS = std::suspend_always,
+          typename FA = default_frames>
+class coro_promise : public value_base<T>, public FA {
  public:
-  coro<T, IS, FS> get_return_object() {
+  coro<T, IS, FS, FA> get_return_object() {
     return {std::coroutine_handle<coro_promise>::from_promise(*this)};
   }
 
@@ -98,10 +103,11 @@ class coro_promise : public value_base<T> {
 
 template <typename T = no_value,
           typename IS = std::suspend_always,
-          typename FS = std::suspend_always>
+          typename FS = std::suspend_always,
+          typename FA = default_frames>
 class [[nodiscard]] coro {
  public:
-  using promise_type = coro_promise<T, IS, FS>;
+  using promise_type = coro_promise<T, IS, FS, FA>;
 
   coro(std::coroutine_handle<promise_type> coro) noexcept :
       coro_(coro) {
@@ -212,7 +218,13 @@ class [[nodiscard]] coro {
 };
 
 template <typename T = no_value,
+          typename FS = std::suspend_always,
+          typename FA = default_frames>
+using ns_coro = coro<T, std::suspend_never, FS, FA>;
+
+template <typename T = no_value,
+          typename IS = std::suspend_always,
           typename FS = std::suspend_always>
-using ns_coro = coro<T, std::suspend_never, FS>;
+using pooled_coro = coro<T, IS, FS, pooled_frames>;
 
 }
@@ -1,26 +1,53 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
 #include "dcpl/coro/coro.h"
-#include "dcpl/coro/mutex.h"
+#include "dcpl/coro/wait_list.h"
 
 namespace dcpl::coro {
 
-class event : public wait_base {
+// An event which is triggered once set() has been called (with the sum of the
+// counts) at least `trigger` times, releasing all the waiters. Once triggered,
+// waits complete immediately until clear() is called.
+// The state word is either the set marker, or the (possibly empty) stack of the
+// waiters nodes embedded within the awaiters.
+class event {
  public:
   explicit event(std::size_t trigger = 1) : trigger_(trigger) { }
 
+  event(const event&) = delete;
+
+  event& operator=(const event&) = delete;
+
   [[nodiscard]] auto wait() {
-    struct awaiter {
-      event* ev;
+    struct awaiter : public detail::wait_node {
+      explicit awaiter(event* ev) :
+          ev(ev) {
+      }
+
+      bool await_ready() const noexcept {
+        return ev->is_set();
+      }
 
-      constexpr bool await_ready() const noexcept { return false; }
       constexpr void await_resume() const noexcept { }
-      bool await_suspend(std::coroutine_handle<> coro) const noexcept {
-        return ev->do_wait(coro);
+
+      bool await_suspend(std::coroutine_handle<> hcoro) noexcept {
+        coro = hcoro;
+
+        return ev->enqueue(this);
       }
+
+      event* ev;
     };
 
-    return awaiter{this};
+    return awaiter(this);
+  }
+
+  bool is_set() const {
+    return state_.load(std::memory_order_acquire) == set_state;
   }
 
   void set(std::size_t count = 1);
@@ -28,10 +55,13 @@ class event : public wait_base {
   void clear();
 
  private:
-  bool do_wait(std::coroutine_handle<> coro);
+  static constexpr std::uintptr_t set_state = 1;
+
+  bool enqueue(detail::wait_node* node);
 
   std::size_t trigger_;
-  std::size_t count_ = 0;
+  std::atomic<std::size_t> count_ = 0;
+  std::atomic<std::uintptr_t> state_ = 0;
 };
 
 }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "dcpl/coro/io_ring.h"
+#include "dcpl/file.h"
+#include "dcpl/types.h"
+
+namespace dcpl::coro {
+
+// The awaiter of the asynchronous positional file I/O APIs, which (like
+// file::pread() and file::pwrite() do) fails unless the whole buffer has been
+// transferred.
+class file_io_awaiter : public io_ring::awaiter {
+ public:
+  file_io_awaiter(const file& afile, int opcode, const void* data, std::size_t size,
+                  fileoff_t off);
+
+  void await_resume() const;
+
+ private:
+  const std::string* path_;
+};
+
+// Asynchronous versions of file::pread() and file::pwrite(), to be co_await-ed, which
+// do not block the coroutine worker thread. The file must not be closed (and the
+// buffer must remain valid) until the operation completes.
+[[nodiscard]] file_io_awaiter async_pread(const file& afile, void* data, std::size_t size,
+                                          fileoff_t off);
+
+[[nodiscard]] file_io_awaiter async_pwrite(const file& afile, const void* data,
+                                           std::size_t size, fileoff_t off);
+
+}
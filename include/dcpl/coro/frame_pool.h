@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+
+namespace dcpl::coro::frame_pool {
+
+// Coroutine frames up to max_size bytes are recycled through per-thread,
+// size-bucketed free lists, so that generator heavy code does not hit the global
+// allocator for every call. A frame freed on a thread other than the one which
+// allocated it simply lands in the cache of the freeing thread. Each thread caches
+// a bounded amount of frames, with the excess going back to the global allocator.
+static constexpr std::size_t granularity = 64;
+static constexpr std::size_t max_size = 4096;
+static constexpr std::size_t num_classes = max_size / granularity;
+
+struct stats {
+  std::size_t allocs = 0;
+  std::size_t hits = 0;
+  std::size_t large_allocs = 0;
+  std::size_t cached_frames = 0;
+  std::size_t cached_bytes = 0;
+
+  // Fraction of the allocations served by the per-thread caches.
+  double hit_rate() const {
+    return allocs > 0 ? static_cast<double>(hits) / static_cast<double>(allocs) : 0.0;
+  }
+};
+
+void* allocate(std::size_t size);
+
+void deallocate(void* ptr, std::size_t size);
+
+stats get_stats();
+
+}
+
+namespace dcpl::coro {
+
+// Frame allocation policies for coroutine promises. The class specific allocation
+// functions of the policy are inherited by the promise type, which is where the
+// compiler looks for them when allocating the coroutine frame.
+struct default_frames { };
+
+struct pooled_frames {
+  static void* operator new(std::size_t size) {
+    return frame_pool::allocate(size);
+  }
+
+  static void operator delete(void* ptr, std::size_t size) {
+    frame_pool::deallocate(ptr, size);
+  }
+};
+
+}
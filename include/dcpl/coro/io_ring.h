@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+
+#include "dcpl/coro/scheduler.h"
+#include "dcpl/coro/wait_list.h"
+#include "dcpl/threadpool.h"
+#include "dcpl/types.h"
+
+namespace dcpl::coro {
+namespace detail {
+
+struct io_node : public wait_node {
+  static constexpr int op_read = 0;
+  static constexpr int op_write = 1;
+
+  int opcode = op_read;
+  int fd = -1;
+  char* data = nullptr;
+  std::size_t size = 0;
+  fileoff_t offset = 0;
+  // The bytes transferred so far, as short transfers are resubmitted.
+  std::size_t done = 0;
+  // The errno of the failed operation, or zero.
+  int error = 0;
+  // The scheduler where the coroutine is resumed, or nullptr for the default one.
+  scheduler* sched = nullptr;
+};
+
+}
+
+// Asynchronous positional reads and writes. On Linux the operations are submitted
+// to an io_uring (set up with raw system calls, so there is no library dependency),
+// owned by a single thread which collects all the operations issued since its last
+// wakeup, submits them with one io_uring_enter() call, and reaps the completions
+// resuming the waiting coroutines on their scheduler.
+// Where io_uring is not available (or when disabled by setting DCPL_IO_URING=0),
+// the operations are run with blocking system calls on a dedicated threadpool.
+// The file descriptors and buffers must stay valid until the operations complete.
+class io_ring {
+ public:
+  struct stats {
+    bool uring = false;
+    std::size_t submitted = 0;
+    std::size_t completed = 0;
+    // The number of io_uring_enter() calls, which is lower than the number of
+    // submitted operations when these are batched.
+    std::size_t enters = 0;
+  };
+
+  class awaiter : public detail::io_node {
+   public:
+    awaiter(io_ring* ring, int opcode, int fd, const void* data, std::size_t size,
+            fileoff_t offset) :
+        ring_(ring) {
+      this->opcode = opcode;
+      this->fd = fd;
+      this->data = const_cast<char*>(static_cast<const char*>(data));
+      this->size = size;
+      this->offset = offset;
+    }
+
+    bool await_ready() const noexcept {
+      return size == 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> hcoro) {
+      coro = hcoro;
+      sched = scheduler::current();
+      ring_->submit(this);
+    }
+
+    // Returns the number of bytes transferred, which is lower than the requested
+    // size only when reading past the end of file. Throws on I/O errors.
+    std::size_t await_resume() const;
+
+   private:
+    io_ring* ring_;
+  };
+
+  explicit io_ring(std::size_t entries = 256, bool use_uring = true);
+
+  io_ring(const io_ring&) = delete;
+
+  io_ring& operator=(const io_ring&) = delete;
+
+  ~io_ring();
+
+  bool uring() const {
+    return kring_ != nullptr;
+  }
+
+  [[nodiscard]] awaiter read(int fd, void* data, std::size_t size, fileoff_t offset) {
+    return awaiter(this, detail::io_node::op_read, fd, data, size, offset);
+  }
+
+  [[nodiscard]] awaiter write(int fd, const void* data, std::size_t size,
+                              fileoff_t offset) {
+    return awaiter(this, detail::io_node::op_write, fd, data, size, offset);
+  }
+
+  void submit(detail::io_node* node);
+
+  stats get_stats() const;
+
+  static io_ring* get();
+
+ private:
+  struct kernel_ring;
+
+  void run();
+
+  void run_blocking(detail::io_node* node);
+
+  void complete(detail::io_node* node);
+
+  void wakeup();
+
+  static io_ring* create_system_ring();
+
+  std::unique_ptr<kernel_ring> kring_;
+  std::unique_ptr<threadpool> pool_;
+  std::unique_ptr<std::thread> thread_;
+  // The stack of the operations not yet handed over to the ring thread.
+  std::atomic<detail::wait_node*> pending_ = nullptr;
+  std::atomic<bool> stopped_ = false;
+  std::atomic<std::size_t> num_submitted_ = 0;
+  std::atomic<std::size_t> num_completed_ = 0;
+  std::atomic<std::size_t> num_enters_ = 0;
+};
+
+}
@@ -1,73 +1,108 @@
 #pragma once
 
-#include <mutex>
-#include <optional>
-#include <queue>
+#include <atomic>
+#include <cstdint>
 
 #include "dcpl/coro/coro.h"
+#include "dcpl/coro/wait_list.h"
 
 namespace dcpl::coro {
 
-class wait_base {
- protected:
-  std::mutex lock_;
-  std::queue<std::coroutine_handle<>> coros_;
-};
+// A coroutine mutex whose whole state is a single atomic word, which is either
+// unlocked, locked with no waiters, or the pointer to the (LIFO) stack of the
+// waiters nodes embedded within the awaiters. The lock owner is the only one
+// consuming the waiters, which it moves into a private FIFO list at unlock time,
+// handing the ownership over to them in arrival order.
+// Uncontended lock() calls never suspend.
+class mutex {
+  struct guard {
+    mutex* mtx;
+
+    ~guard() {
+      unlock();
+    }
+
+    void unlock() {
+      if (mtx != nullptr) {
+        mtx->unlock();
+      }
+      mtx = nullptr;
+    }
+  };
+
+  struct lock_awaiter : public detail::wait_node {
+    explicit lock_awaiter(mutex* mtx) :
+        mtx(mtx) {
+    }
+
+    bool await_ready() const noexcept {
+      return mtx->try_lock();
+    }
+
+    bool await_suspend(std::coroutine_handle<> hcoro) noexcept {
+      coro = hcoro;
+
+      return mtx->lock_or_enqueue(this);
+    }
+
+    mutex* mtx;
+  };
 
-class mutex : public wait_base {
  public:
+  mutex() = default;
+
+  mutex(const mutex&) = delete;
+
+  mutex& operator=(const mutex&) = delete;
+
   [[nodiscard]] auto lock() {
-    struct awaiter {
-      mutex* mtx;
+    struct awaiter : public lock_awaiter {
+      using lock_awaiter::lock_awaiter;
 
-      constexpr bool await_ready() const noexcept { return false; }
       constexpr void await_resume() const noexcept { }
-      bool await_suspend(std::coroutine_handle<> coro) const noexcept {
-        return mtx->do_lock(coro);
-      }
     };
 
-    return awaiter{this};
+    return awaiter(this);
   }
 
   [[nodiscard]] auto lock_guard() {
-    struct guard {
-      mutex* mtx;
-
-      ~guard() {
-        unlock();
-      }
-
-      void unlock() {
-        if (mtx != nullptr) {
-          mtx->unlock();
-        }
-        mtx = nullptr;
-      }
-    };
-    struct awaiter {
-      mutex* mtx;
-
-      constexpr bool await_ready() const noexcept { return false; }
+    struct awaiter : public lock_awaiter {
+      using lock_awaiter::lock_awaiter;
 
       [[nodiscard]] guard await_resume() const noexcept {
         return guard{mtx};
       }
-
-      bool await_suspend(std::coroutine_handle<> coro) const noexcept {
-        return mtx->do_lock(coro);
-      }
     };
 
-    return awaiter{this};
+    return awaiter(this);
+  }
+
+  bool try_lock() {
+    std::uintptr_t state = unlocked;
+
+    return state_.compare_exchange_strong(state, locked_no_waiters,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
   }
 
   void unlock();
 
+  // Acquires the mutex on behalf of the node if available (returning false), or
+  // queues the node (returning true), which will be granted the mutex by a
+  // following unlock().
+  bool lock_or_enqueue(detail::wait_node* node);
+
+  // Called when the mutex is handed over to the node. Returns false if the node
+  // gave the mutex back (so the caller should go on unlocking).
+  static bool grant(detail::wait_node* node);
+
  private:
-  bool do_lock(std::coroutine_handle<> coro);
+  static constexpr std::uintptr_t locked_no_waiters = 0;
+  static constexpr std::uintptr_t unlocked = 1;
 
-  bool locked_ = false;
+  std::atomic<std::uintptr_t> state_ = unlocked;
+  // Only accessed by the lock owner.
+  detail::wait_node* waiters_ = nullptr;
 };
 
 }
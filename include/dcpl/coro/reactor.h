@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "dcpl/coro/scheduler.h"
+#include "dcpl/coro/task.h"
+#include "dcpl/coro/wait_list.h"
+
+namespace dcpl::coro {
+namespace detail {
+
+struct ready_node : public wait_node {
+  // The scheduler where the coroutine is resumed, or nullptr for the default one.
+  scheduler* sched = nullptr;
+};
+
+}
+
+// An edge-triggered epoll reactor, whose single thread turns file descriptors
+// readiness events into coroutine resumptions on the scheduler the coroutines were
+// waiting from. Descriptors must be registered (and switched to non-blocking mode)
+// by add() before being waited on, and removed by remove() before being closed, as
+// the kernel may reuse their number for a new descriptor, which would otherwise be
+// bound to a stale state no longer registered with epoll.
+// Readiness edges arriving while nobody waits are remembered, and consumed by the
+// next waiter, so that the usual "try the I/O, and wait for readiness on EAGAIN"
+// loop never misses a wakeup. Wakeups can be spurious though, so the I/O must
+// always be retried.
+class reactor {
+  struct fd_state;
+
+ public:
+  static constexpr int dir_read = 0;
+  static constexpr int dir_write = 1;
+
+  class awaiter : public detail::ready_node {
+    friend class reactor;
+
+   public:
+    bool await_ready() {
+      return rct_->consume_ready(state_, dir_);
+    }
+
+    bool await_suspend(std::coroutine_handle<> hcoro) {
+      coro = hcoro;
+      sched = scheduler::current();
+
+      return rct_->ready_or_enqueue(state_, dir_, this);
+    }
+
+    constexpr void await_resume() const noexcept { }
+
+   private:
+    awaiter(reactor* rct, fd_state* state, int dir) :
+        rct_(rct),
+        state_(state),
+        dir_(dir) {
+    }
+
+    reactor* rct_;
+    fd_state* state_;
+    int dir_;
+  };
+
+  reactor();
+
+  reactor(const reactor&) = delete;
+
+  reactor& operator=(const reactor&) = delete;
+
+  ~reactor();
+
+  [[nodiscard]] awaiter readable(int fd) {
+    return awaiter(this, get_state(fd), dir_read);
+  }
+
+  [[nodiscard]] awaiter writable(int fd) {
+    return awaiter(this, get_state(fd), dir_write);
+  }
+
+  void add(int fd);
+
+  // Unregisters the file descriptor, resuming all its waiters. To be called before
+  // closing it.
+  void remove(int fd);
+
+  static reactor* get();
+
+ private:
+  fd_state* get_state(int fd);
+
+  bool consume_ready(fd_state* state, int dir);
+
+  bool ready_or_enqueue(fd_state* state, int dir, detail::ready_node* node);
+
+  void notify(fd_state* state, bool readable, bool writable);
+
+  void run();
+
+  int epoll_fd_ = -1;
+  int wake_fd_ = -1;
+  std::mutex mtx_;
+  std::unordered_map<int, std::unique_ptr<fd_state>> fds_;
+  // The states of removed descriptors, which are freed only once the reactor thread
+  // is done with the events it already fetched.
+  std::vector<std::unique_ptr<fd_state>> retired_;
+  std::atomic<bool> stopped_ = false;
+  std::unique_ptr<std::thread> thread_;
+};
+
+inline auto readable(int fd) {
+  return reactor::get()->readable(fd);
+}
+
+inline auto writable(int fd) {
+  return reactor::get()->writable(fd);
+}
+
+// Reads up to size bytes from the file descriptor (which must have been added to the
+// reactor), waiting for it to be readable if no data is available. Returns the number
+// of bytes read, zero at end of file.
+task<std::size_t> async_read_some(int fd, void* data, std::size_t size);
+
+// Writes the whole buffer to the file descriptor (which must have been added to the
+// reactor), waiting for it to be writable whenever its buffers are full.
+task<> async_write(int fd, const void* data, std::size_t size);
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace dcpl::coro {
+
+// A coroutine executor where each worker thread owns a bounded, allocation free
+// ready queue of coroutine handles. Workers pop from their own queue, then from a
+// shared injection queue (where handles spawned from non worker threads, and
+// overflowing local queues, end up), and finally steal half of the queue of other
+// workers. Awaiters which know which coroutine should run next can use symmetric
+// transfer (returning the handle from await_suspend) and bypass the queues
+// altogether, as the yield() awaitable does.
+class scheduler {
+ public:
+  struct stats {
+    std::size_t num_threads = 0;
+    std::size_t local_pushes = 0;
+    std::size_t injected = 0;
+    std::size_t steals = 0;
+    std::size_t parks = 0;
+  };
+
+  explicit scheduler(std::size_t num_threads = 0);
+
+  ~scheduler();
+
+  std::size_t num_threads() const {
+    return workers_.size();
+  }
+
+  // Makes the coroutine ready to be resumed by one of the workers.
+  void spawn(std::coroutine_handle<> coro);
+
+  stats get_stats() const;
+
+  // Moves the current coroutine onto this scheduler. Use as:
+  //
+  //   co_await sched->schedule();
+  //
+  [[nodiscard]] auto schedule() {
+    struct awaiter {
+      scheduler* sched;
+
+      constexpr bool await_ready() const noexcept { return false; }
+      constexpr void await_resume() const noexcept { }
+      void await_suspend(std::coroutine_handle<> coro) const noexcept {
+        sched->spawn(coro);
+      }
+    };
+
+    return awaiter{this};
+  }
+
+  // Lets other ready coroutines of the current worker run, by directly transferring
+  // control to the next one in the queue. If there is none, the current coroutine
+  // simply continues.
+  [[nodiscard]] auto yield() {
+    struct awaiter {
+      scheduler* sched;
+
+      constexpr bool await_ready() const noexcept { return false; }
+      constexpr void await_resume() const noexcept { }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> coro) const noexcept {
+        return sched->yield_to_next(coro);
+      }
+    };
+
+    return awaiter{this};
+  }
+
+  // Returns the scheduler of the calling worker thread, or nullptr if the calling
+  // thread is not a scheduler worker.
+  static scheduler* current();
+
+  static scheduler* get();
+
+ private:
+  struct worker;
+
+  void run(worker* wrk);
+
+  void push_local(worker* wrk, void* addr);
+
+  bool push_overflow(worker* wrk, std::uint32_t head, std::uint32_t tail, void* addr);
+
+  void* pop_local(worker* wrk);
+
+  void* steal(worker* thief, worker* victim);
+
+  void* pop_injected(worker* wrk);
+
+  void* find_work(worker* wrk);
+
+  bool has_work() const;
+
+  bool park();
+
+  void wake();
+
+  std::coroutine_handle<> yield_to_next(std::coroutine_handle<> coro);
+
+  static scheduler* create_system_scheduler();
+
+  static thread_local worker* current_;
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::mutex inject_mtx_;
+  std::deque<void*> injected_;
+  std::atomic<std::size_t> inject_count_ = 0;
+  std::mutex park_mtx_;
+  std::condition_variable park_cv_;
+  std::atomic<std::size_t> idle_ = 0;
+  bool stopped_ = false;
+  std::atomic<std::size_t> num_injected_ = 0;
+  std::atomic<std::size_t> num_steals_ = 0;
+  std::atomic<std::size_t> num_parks_ = 0;
+};
+
+}
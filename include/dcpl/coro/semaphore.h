@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "dcpl/coro/coro.h"
+#include "dcpl/coro/wait_list.h"
+
+namespace dcpl::coro {
+
+// A counting semaphore whose count goes negative when there are waiters, so that
+// both acquire() and release() are a single atomic operation when they do not
+// need to suspend or resume coroutines. Waiters are resumed in FIFO order.
+class semaphore {
+ public:
+  explicit semaphore(std::ptrdiff_t count = 0) :
+      count_(count) {
+  }
+
+  semaphore(const semaphore&) = delete;
+
+  semaphore& operator=(const semaphore&) = delete;
+
+  [[nodiscard]] auto acquire() {
+    struct awaiter : public detail::wait_node {
+      explicit awaiter(semaphore* sem) :
+          sem(sem) {
+      }
+
+      bool await_ready() const noexcept {
+        return sem->try_acquire();
+      }
+
+      constexpr void await_resume() const noexcept { }
+
+      bool await_suspend(std::coroutine_handle<> hcoro) noexcept {
+        coro = hcoro;
+
+        return sem->acquire_or_enqueue(this);
+      }
+
+      semaphore* sem;
+    };
+
+    return awaiter(this);
+  }
+
+  bool try_acquire();
+
+  void release(std::ptrdiff_t count = 1);
+
+  std::ptrdiff_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  bool acquire_or_enqueue(detail::wait_node* node);
+
+  std::atomic<std::ptrdiff_t> count_;
+  detail::spin_lock lock_;
+  detail::wait_list waiters_;
+  // Releases which found a negative count, but no waiter in the list yet, as the
+  // acquirer decremented the count but did not enqueue its node yet.
+  std::ptrdiff_t pending_ = 0;
+};
+
+}
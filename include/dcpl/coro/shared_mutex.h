@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "dcpl/coro/coro.h"
+#include "dcpl/coro/wait_list.h"
+
+namespace dcpl::coro {
+
+// A reader/writer coroutine mutex. The state word holds the writer bit, the readers
+// count and a waiters bit, so that uncontended lock operations are a single CAS.
+// Once a coroutine has to wait, the waiters bit forces all the following lockers
+// onto the FIFO list of the waiters nodes (embedded within the awaiters), so that
+// writers cannot be starved by a continuous stream of readers. When the lock is
+// released, either the writer at the head of the list, or all the consecutive
+// readers at its head, are granted the lock.
+class shared_mutex {
+  struct waiter : public detail::wait_node {
+    waiter(shared_mutex* mtx, bool shared) :
+        mtx(mtx),
+        shared(shared) {
+    }
+
+    bool await_ready() const noexcept {
+      return shared ? mtx->try_lock_shared() : mtx->try_lock();
+    }
+
+    constexpr void await_resume() const noexcept { }
+
+    bool await_suspend(std::coroutine_handle<> hcoro) noexcept {
+      coro = hcoro;
+
+      return mtx->lock_or_enqueue(this);
+    }
+
+    shared_mutex* mtx;
+    bool shared;
+  };
+
+ public:
+  shared_mutex() = default;
+
+  shared_mutex(const shared_mutex&) = delete;
+
+  shared_mutex& operator=(const shared_mutex&) = delete;
+
+  [[nodiscard]] auto lock() {
+    return waiter(this, /*shared=*/ false);
+  }
+
+  [[nodiscard]] auto lock_shared() {
+    return waiter(this, /*shared=*/ true);
+  }
+
+  bool try_lock();
+
+  bool try_lock_shared();
+
+  void unlock();
+
+  void unlock_shared();
+
+ private:
+  static constexpr std::uint64_t writer_bit = 1;
+  static constexpr std::uint64_t waiters_bit = 2;
+  static constexpr std::uint64_t reader_one = 4;
+
+  bool lock_or_enqueue(waiter* node);
+
+  void dispatch();
+
+  std::atomic<std::uint64_t> state_ = 0;
+  detail::spin_lock lock_;
+  detail::wait_list waiters_;
+};
+
+}
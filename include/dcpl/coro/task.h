@@ -0,0 +1,418 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dcpl/assert.h"
+#include "dcpl/coro/coro.h"
+
+namespace dcpl::coro {
+
+template <typename T = no_value>
+class task;
+
+namespace detail {
+
+template <typename T>
+class task_promise : public value_base<T> {
+ public:
+  task<T> get_return_object() noexcept;
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+
+  // Upon completion, control is transferred to the awaiting coroutine (if any)
+  // without going through the scheduler queues.
+  auto final_suspend() noexcept {
+    struct awaiter {
+      constexpr bool await_ready() const noexcept { return false; }
+      constexpr void await_resume() const noexcept { }
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<task_promise> coro) const noexcept {
+        std::coroutine_handle<> continuation = coro.promise().continuation_;
+
+        return continuation != nullptr ? continuation : std::noop_coroutine();
+      }
+    };
+
+    return awaiter{};
+  }
+
+  void set_continuation(std::coroutine_handle<> continuation) {
+    continuation_ = continuation;
+  }
+
+ private:
+  std::coroutine_handle<> continuation_;
+};
+
+}
+
+// A lazily started coroutine, which begins running only once awaited, and resumes
+// the awaiting coroutine once done. The result of awaiting a task is its return
+// value (or nothing for task<>), and exceptions thrown within the task body are
+// propagated to the awaiter.
+template <typename T>
+class [[nodiscard]] task {
+ public:
+  using promise_type = detail::task_promise<T>;
+
+  task() = default;
+
+  explicit task(std::coroutine_handle<promise_type> coro) noexcept :
+      coro_(coro) {
+  }
+
+  task(task&& other) noexcept :
+      coro_(std::exchange(other.coro_, nullptr)) {
+  }
+
+  task(const task& other) = delete;
+
+  ~task() {
+    destroy();
+  }
+
+  task& operator=(const task& other) = delete;
+
+  task& operator=(task&& other) noexcept {
+    if (this != &other) {
+      destroy();
+      coro_ = std::exchange(other.coro_, nullptr);
+    }
+
+    return *this;
+  }
+
+  void destroy() {
+    if (coro_ != nullptr) {
+      coro_.destroy();
+      coro_ = nullptr;
+    }
+  }
+
+  bool done() const {
+    return coro_ == nullptr || coro_.done();
+  }
+
+  std::coroutine_handle<promise_type> handle() const {
+    return coro_;
+  }
+
+  // Returns the task result, or rethrows the exception which terminated it. Must
+  // be called only once the task is done.
+  auto result() {
+    DCPL_ASSERT(coro_.done()) << "Task not completed";
+
+    if constexpr (std::is_same_v<T, no_value>) {
+      coro_.promise().check_exception();
+    } else {
+      return coro_.promise().extract_value();
+    }
+  }
+
+  auto operator co_await() noexcept {
+    struct awaiter : public ready_awaiter {
+      auto await_resume() {
+        return this->tsk->result();
+      }
+    };
+
+    return awaiter{ { this } };
+  }
+
+  // Returns an awaitable which waits for the task completion, without fetching
+  // its result (hence without rethrowing its exceptions).
+  auto when_ready() noexcept {
+    return ready_awaiter{ this };
+  }
+
+ private:
+  struct ready_awaiter {
+    task* tsk;
+
+    bool await_ready() const noexcept {
+      return tsk->done();
+    }
+
+    constexpr void await_resume() const noexcept { }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> coro) const noexcept {
+      tsk->coro_.promise().set_continuation(coro);
+
+      return tsk->coro_;
+    }
+  };
+
+  std::coroutine_handle<promise_type> coro_;
+};
+
+template <typename T>
+struct when_any_result {
+  std::size_t index = 0;
+  T value;
+};
+
+namespace detail {
+
+template <typename T>
+task<T> task_promise<T>::get_return_object() noexcept {
+  return task<T>(std::coroutine_handle<task_promise>::from_promise(*this));
+}
+
+// A self destroying coroutine, which transfers control to the handle it returns
+// (if not nullptr) upon completion. Its body must not throw.
+class chain_task {
+ public:
+  struct promise_type {
+    chain_task get_return_object() noexcept {
+      return chain_task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+
+    auto final_suspend() noexcept {
+      struct awaiter {
+        constexpr bool await_ready() const noexcept { return false; }
+        constexpr void await_resume() const noexcept { }
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<promise_type> coro) const noexcept {
+          std::coroutine_handle<> next = coro.promise().next;
+
+          coro.destroy();
+
+          return next != nullptr ? next : std::noop_coroutine();
+        }
+      };
+
+      return awaiter{};
+    }
+
+    void return_value(std::coroutine_handle<> handle) noexcept {
+      next = handle;
+    }
+
+    void unhandled_exception() noexcept {
+      std::terminate();
+    }
+
+    std::coroutine_handle<> next;
+  };
+
+  explicit chain_task(std::coroutine_handle<promise_type> coro) noexcept :
+      coro_(coro) {
+  }
+
+  void start() {
+    coro_.resume();
+  }
+
+ private:
+  std::coroutine_handle<promise_type> coro_;
+};
+
+// Counts the completions of a set of tasks, plus the one of the awaiting
+// coroutine, so that the latter does not suspend if all the tasks completed
+// synchronously while being started.
+class completion_latch {
+ public:
+  explicit completion_latch(std::size_t count) :
+      count_(count + 1) {
+  }
+
+  std::coroutine_handle<> arrive() noexcept {
+    return count_.fetch_sub(1, std::memory_order_acq_rel) == 1 ? continuation_ : nullptr;
+  }
+
+  template <typename F>
+  auto start(F start_fn) noexcept {
+    struct awaiter {
+      completion_latch* latch;
+      F start_fn;
+
+      constexpr bool await_ready() const noexcept { return false; }
+      constexpr void await_resume() const noexcept { }
+      bool await_suspend(std::coroutine_handle<> coro) noexcept {
+        latch->continuation_ = coro;
+        start_fn();
+
+        return latch->arrive() == nullptr;
+      }
+    };
+
+    return awaiter{ this, std::move(start_fn) };
+  }
+
+ private:
+  std::atomic<std::size_t> count_;
+  std::coroutine_handle<> continuation_;
+};
+
+template <typename T>
+chain_task all_runner(completion_latch* latch, task<T>* tsk) {
+  co_await tsk->when_ready();
+
+  co_return latch->arrive();
+}
+
+template <typename T>
+T take_result(task<T>& tsk) {
+  if constexpr (std::is_same_v<T, no_value>) {
+    tsk.result();
+
+    return no_value{};
+  } else {
+    return tsk.result();
+  }
+}
+
+template <typename T>
+struct any_state {
+  any_state() :
+      latch(1) {
+  }
+
+  std::coroutine_handle<> complete(std::size_t index, task<T>* tsk) {
+    if (fired.exchange(true, std::memory_order_acq_rel)) {
+      return nullptr;
+    }
+    try {
+      result = when_any_result<T>{ index, take_result(*tsk) };
+    } catch (...) {
+      exptr = std::current_exception();
+    }
+
+    return latch.arrive();
+  }
+
+  completion_latch latch;
+  std::atomic<bool> fired = false;
+  std::optional<when_any_result<T>> result;
+  std::exception_ptr exptr;
+};
+
+// The runner owns the task, as losers keep running after when_any() returned.
+template <typename T>
+chain_task any_runner(std::shared_ptr<any_state<T>> state, std::size_t index,
+                      task<T> tsk) {
+  co_await tsk.when_ready();
+
+  co_return state->complete(index, &tsk);
+}
+
+class sync_state {
+ public:
+  void set() {
+    // Notify with the lock held, as the waiter destroys this object as soon as it
+    // is able to return from wait().
+    std::lock_guard guard(mtx_);
+
+    done_ = true;
+    cv_.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock lock(mtx_);
+
+    cv_.wait(lock, [this]() { return done_; });
+  }
+
+ private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool done_ = false;
+};
+
+template <typename T>
+chain_task sync_runner(sync_state* state, task<T>* tsk) {
+  co_await tsk->when_ready();
+  state->set();
+
+  co_return nullptr;
+}
+
+}
+
+// Waits for the completion of all the tasks, which are started in order on the
+// calling thread, and returns the tuple of their results (with no_value standing
+// in for task<>). If any task throws, the exception is rethrown once all of them
+// completed.
+template <typename... T>
+task<std::tuple<T...>> when_all(task<T>... tasks) {
+  detail::completion_latch latch(sizeof...(T));
+
+  co_await latch.start([&]() {
+    (detail::all_runner(&latch, &tasks).start(), ...);
+  });
+
+  co_return std::tuple<T...>{ detail::take_result(tasks)... };
+}
+
+template <typename T>
+task<std::vector<T>> when_all(std::vector<task<T>> tasks) {
+  detail::completion_latch latch(tasks.size());
+
+  co_await latch.start([&]() {
+    for (auto& tsk : tasks) {
+      detail::all_runner(&latch, &tsk).start();
+    }
+  });
+
+  std::vector<T> results;
+
+  results.reserve(tasks.size());
+  for (auto& tsk : tasks) {
+    results.push_back(detail::take_result(tsk));
+  }
+
+  co_return results;
+}
+
+// Returns the index and result of the first task to complete. There is no
+// cancellation, so the other tasks keep running to completion, with their results
+// being discarded.
+template <typename T>
+task<when_any_result<T>> when_any(std::vector<task<T>> tasks) {
+  DCPL_CHECK_GT(tasks.size(), 0);
+
+  auto state = std::make_shared<detail::any_state<T>>();
+
+  co_await state->latch.start([&]() {
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+      detail::any_runner(state, i, std::move(tasks[i])).start();
+    }
+  });
+
+  if (state->exptr != nullptr) {
+    std::rethrow_exception(state->exptr);
+  }
+
+  co_return std::move(*state->result);
+}
+
+// Runs the task on the calling thread until its first suspension, and then blocks
+// until it completes, returning its result.
+template <typename T>
+auto sync_wait(task<T> tsk) {
+  detail::sync_state state;
+
+  detail::sync_runner(&state, &tsk).start();
+  state.wait();
+
+  return tsk.result();
+}
+
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dcpl/coro/coro.h"
+#include "dcpl/coro/scheduler.h"
+#include "dcpl/coro/task.h"
+#include "dcpl/coro/utils.h"
+#include "dcpl/coro/wait_list.h"
+#include "dcpl/types.h"
+#include "dcpl/utils.h"
+
+namespace dcpl::coro {
+namespace detail {
+
+struct timer_node : public wait_node {
+  static constexpr std::size_t no_index = std::numeric_limits<std::size_t>::max();
+
+  ns_time deadline{ 0 };
+  std::size_t heap_index = no_index;
+  // The scheduler where the coroutine is resumed, or nullptr for the default one.
+  scheduler* sched = nullptr;
+  // When set, it is called (with the timer queue lock held) in place of resuming
+  // the coroutine, once the timer expires.
+  void (*on_expire)(timer_node*) = nullptr;
+};
+
+}
+
+// A min-heap of timer nodes (embedded within the awaiters) served by a single
+// thread, which resumes the expired coroutines on their scheduler. Adding and
+// cancelling a timer are O(log N) operations.
+class timer_queue {
+ public:
+  timer_queue();
+
+  ~timer_queue();
+
+  void add(detail::timer_node* node);
+
+  // Returns true if the timer has been removed before firing. If false is returned,
+  // the timer already fired (and its on_expire() callback completed).
+  bool cancel(detail::timer_node* node);
+
+  std::size_t size();
+
+  static timer_queue* get();
+
+ private:
+  void run();
+
+  void fire(detail::timer_node* node);
+
+  void heap_remove(std::size_t pos);
+
+  void sift_up(std::size_t pos);
+
+  void sift_down(std::size_t pos);
+
+  void heap_set(std::size_t pos, detail::timer_node* node);
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<detail::timer_node*> heap_;
+  bool stopped_ = false;
+  std::unique_ptr<std::thread> thread_;
+};
+
+// Suspends the current coroutine until the given nstime() based deadline, without
+// blocking the worker thread.
+inline auto sleep_until(ns_time deadline) {
+  struct awaiter : public detail::timer_node {
+    explicit awaiter(ns_time deadline) {
+      this->deadline = deadline;
+    }
+
+    bool await_ready() const {
+      return deadline <= nstime();
+    }
+
+    void await_suspend(std::coroutine_handle<> hcoro) {
+      coro = hcoro;
+      sched = scheduler::current();
+      timer_queue::get()->add(this);
+    }
+
+    constexpr void await_resume() const noexcept { }
+  };
+
+  return awaiter(deadline);
+}
+
+inline auto sleep_for(ns_time duration) {
+  return sleep_until(nstime() + duration);
+}
+
+namespace detail {
+
+template <typename A>
+decltype(auto) get_awaiter(A&& awaitable) {
+  if constexpr (requires { std::forward<A>(awaitable).operator co_await(); }) {
+    return std::forward<A>(awaitable).operator co_await();
+  } else {
+    return std::forward<A>(awaitable);
+  }
+}
+
+template <typename A>
+using await_result_t = decltype(get_awaiter(std::declval<A>()).await_resume());
+
+template <typename R>
+struct timeout_state : public timer_node {
+  timeout_state() :
+      latch(1) {
+    on_expire = &timeout_state::expired;
+  }
+
+  bool complete() {
+    return !fired.exchange(true, std::memory_order_acq_rel);
+  }
+
+  static void expired(timer_node* node) {
+    timeout_state* state = static_cast<timeout_state*>(node);
+
+    if (state->complete()) {
+      std::coroutine_handle<> continuation = state->latch.arrive();
+
+      if (continuation != nullptr) {
+        state->sched != nullptr ? state->sched->spawn(continuation) : spawn(continuation);
+      }
+    }
+  }
+
+  completion_latch latch;
+  std::atomic<bool> fired = false;
+  std::optional<R> result;
+  std::exception_ptr exptr;
+};
+
+template <typename A, typename R>
+chain_task timeout_runner(std::shared_ptr<timeout_state<R>> state, A awaitable) {
+  std::optional<R> result;
+  std::exception_ptr exptr;
+
+  try {
+    if constexpr (std::is_void_v<await_result_t<A>>) {
+      co_await std::move(awaitable);
+      result.emplace();
+    } else {
+      result.emplace(co_await std::move(awaitable));
+    }
+  } catch (...) {
+    exptr = std::current_exception();
+  }
+
+  if (!state->complete()) {
+    co_return nullptr;
+  }
+  timer_queue::get()->cancel(state.get());
+  state->result = std::move(result);
+  state->exptr = exptr;
+
+  co_return state->latch.arrive();
+}
+
+}
+
+// Awaits the awaitable for at most the given time. Returns std::nullopt on
+// timeout (or false, for awaitables not returning a value), otherwise the result
+// of the awaitable. The awaitable is not cancelled on timeout: it keeps running
+// (owned by a detached coroutine) and its result, once available, is discarded.
+template <typename A>
+auto with_timeout(A awaitable, ns_time timeout) {
+  using result_type = detail::await_result_t<A>;
+  using value_type = std::conditional_t<std::is_void_v<result_type>, no_value, result_type>;
+  using state_type = detail::timeout_state<value_type>;
+
+  auto run = [](A awaitable, ns_time timeout) -> task<std::optional<value_type>> {
+    auto state = std::make_shared<state_type>();
+
+    co_await state->latch.start([&]() {
+      state->deadline = nstime() + timeout;
+      state->sched = scheduler::current();
+      timer_queue::get()->add(state.get());
+      detail::timeout_runner<A, value_type>(state, std::move(awaitable)).start();
+    });
+
+    if (state->exptr != nullptr) {
+      std::rethrow_exception(state->exptr);
+    }
+
+    co_return std::move(state->result);
+  };
+
+  if constexpr (std::is_void_v<result_type>) {
+    return [](task<std::optional<value_type>> tsk) -> task<bool> {
+      std::optional<value_type> result = co_await tsk;
+
+      co_return result.has_value();
+    }(run(std::move(awaitable), timeout));
+  } else {
+    return run(std::move(awaitable), timeout);
+  }
+}
+
+}
@@ -3,7 +3,7 @@
 #include <type_traits>
 
 #include "dcpl/coro/coro.h"
-#include "dcpl/threadpool.h"
+#include "dcpl/coro/scheduler.h"
 
 namespace dcpl::coro {
 
@@ -24,8 +24,12 @@ T extract_value(std::coroutine_handle<> coro) {
   return value_base_ptr<T>(coro)->extract_value();
 }
 
+// Schedules the coroutine on the scheduler of the calling worker thread, or on the
+// default one if not called from a scheduler worker.
 inline void spawn(std::coroutine_handle<> coro) {
-  dcpl::threadpool::get()->push_work([coro]() { coro.resume(); });
+  scheduler* sched = scheduler::current();
+
+  (sched != nullptr ? sched : scheduler::get())->spawn(coro);
 }
 
 inline auto schedule() {
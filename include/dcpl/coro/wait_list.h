@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <thread>
+
+namespace dcpl::coro::detail {
+
+// The waiter entry of the coroutine synchronization primitives, which is embedded
+// within their awaiter objects (hence living in the suspended coroutine frame), so
+// that suspending does not require any allocation.
+struct wait_node {
+  wait_node* next = nullptr;
+  std::coroutine_handle<> coro;
+  // When set, it is called in place of resuming the coroutine, once a coro::mutex
+  // is handed over to the node. Returns false if the node gave the mutex back.
+  bool (*on_acquire)(wait_node*) = nullptr;
+};
+
+// Reverses a singly linked list of nodes, turning a LIFO stack into a FIFO one.
+inline wait_node* reverse_nodes(wait_node* node) {
+  wait_node* head = nullptr;
+
+  while (node != nullptr) {
+    wait_node* next = node->next;
+
+    node->next = head;
+    head = node;
+    node = next;
+  }
+
+  return head;
+}
+
+// An intrusive FIFO list of nodes. Not thread safe.
+class wait_list {
+ public:
+  bool empty() const {
+    return head_ == nullptr;
+  }
+
+  wait_node* front() const {
+    return head_;
+  }
+
+  void push_back(wait_node* node) {
+    node->next = nullptr;
+    if (tail_ != nullptr) {
+      tail_->next = node;
+    } else {
+      head_ = node;
+    }
+    tail_ = node;
+  }
+
+  void push_front(wait_node* node) {
+    node->next = head_;
+    head_ = node;
+    if (tail_ == nullptr) {
+      tail_ = node;
+    }
+  }
+
+  wait_node* pop_front() {
+    wait_node* node = head_;
+
+    if (node != nullptr) {
+      head_ = node->next;
+      if (head_ == nullptr) {
+        tail_ = nullptr;
+      }
+    }
+
+    return node;
+  }
+
+  // Detaches all the nodes, returning the list head.
+  wait_node* take() {
+    wait_node* node = head_;
+
+    head_ = tail_ = nullptr;
+
+    return node;
+  }
+
+ private:
+  wait_node* head_ = nullptr;
+  wait_node* tail_ = nullptr;
+};
+
+// A lock for the very short critical sections updating the wait lists (a few
+// pointer updates), where an OS mutex would be overkill.
+class spin_lock {
+ public:
+  void lock() {
+    while (flag_.test_and_set(std::memory_order_acquire)) {
+      while (flag_.test(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void unlock() {
+    flag_.clear(std::memory_order_release);
+  }
+
+ private:
+  std::atomic_flag flag_;
+};
+
+}
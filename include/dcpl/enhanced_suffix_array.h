@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "dcpl/assert.h"
+#include "dcpl/constants.h"
+#include "dcpl/suffix_array.h"
+#include "dcpl/suffix_array_stats.h"
+
+namespace dcpl::suffix_array {
+
+// An enhanced suffix array (Abouelhoda, Kurtz, Ohlebusch), which stores the LCP
+// array and the child tables (up, down and next l-index) next to the suffix array,
+// exposing the lcp-interval tree (the equivalent of the suffix tree internal nodes)
+// without any pointer based structure. It also stores the LCP-LR arrays of Manber
+// and Myers, for O(m + log n) lookups.
+// The suffix array must list the suffixes in their lexicographic order, where a
+// suffix sorts before all the ones it is a prefix of, like the compute_sais() and
+// compute_parallel() ones do.
+template <typename T, typename S>
+class enhanced_suffix_array {
+ public:
+  using data_type = T;
+  using array_type = S;
+  using index_type = typename S::value_type;
+
+  // An lcp-interval, whose [begin, end) suffix array entries are all the suffixes
+  // starting with the same lcp long prefix. Singleton intervals are leaves.
+  struct interval {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    std::size_t lcp = 0;
+
+    auto operator<=>(const interval&) const = default;
+  };
+
+  enhanced_suffix_array(T data, S suffix_array, std::size_t num_threads = 0) :
+      data_(std::move(data)),
+      suffix_array_(std::move(suffix_array)) {
+    DCPL_CHECK_EQ(data_.size(), suffix_array_.size()) << "Suffix array size mismatch";
+
+    lcp_ = compute_lcp_parallel<index_type>(data_, suffix_array_, num_threads);
+    compute_child_tables();
+    compute_lcp_lr();
+  }
+
+  const T& data() const {
+    return data_;
+  }
+
+  const S& suffix_array() const {
+    return suffix_array_;
+  }
+
+  const std::vector<index_type>& lcp() const {
+    return lcp_;
+  }
+
+  std::size_t size() const {
+    return suffix_array_.size();
+  }
+
+  interval root() const {
+    std::size_t n = size();
+
+    return { 0, n, n > 1 ? interval_lcp(0, n) : n };
+  }
+
+  // Calls fn(child) for all the child intervals of the lcp-interval, in suffix
+  // order, each one in O(1).
+  template <typename F>
+  void for_each_child(const interval& parent, const F& fn) const {
+    if (parent.end - parent.begin <= 1) {
+      return;
+    }
+
+    std::size_t pos = first_child_end(parent.begin, parent.end);
+
+    fn(make_interval(parent.begin, pos));
+    for (std::size_t next = next_[pos]; next != 0; next = next_[pos]) {
+      fn(make_interval(pos, next));
+      pos = next;
+    }
+    fn(make_interval(pos, parent.end));
+  }
+
+  std::vector<interval> children(const interval& parent) const {
+    std::vector<interval> result;
+
+    for_each_child(parent, [&](const interval& child) { result.push_back(child); });
+
+    return result;
+  }
+
+  // Returns the partition (see suffix_array::find()) of the suffixes starting with
+  // seq, in O(m + log n) time. The binary searches use the LCP-LR arrays to skip the
+  // symbols already known to match, so that no pattern symbol is compared more
+  // than once per step where the matched prefix grows.
+  template <typename V>
+  partition find(const V& seq) const {
+    const std::size_t n = size();
+    std::size_t begin = search(seq, /*upper=*/ false);
+    std::size_t end = search(seq, /*upper=*/ true);
+
+    return (begin < end) ? partition{ begin, end, 0 } : partition{ n, n, 0 };
+  }
+
+  // Calls fn(repeat) for all the maximal repeats at least min_length long (see
+  // suffix_array::maximal_repeats(), also for the threads calling fn), where the
+  // repeat interval lists the suffixes the occurrences start at, and its lcp is the
+  // repeat length.
+  template <typename F>
+  void maximal_repeats(std::size_t min_length, const F& fn,
+                       std::size_t num_threads = consts::all) const {
+    dcpl::suffix_array::maximal_repeats(
+        data_, suffix_array_, lcp_, min_length,
+        [&](const substring_stat& stat) {
+          fn(interval{ stat.begin, stat.end, stat.max_length });
+        },
+        num_threads);
+  }
+
+ private:
+  // The LCP value at the given position, with the -1 sentinels at both ends which
+  // let the child tables of the root be built like the other ones.
+  std::ptrdiff_t lcp_at(std::size_t pos) const {
+    return (pos == 0 || pos >= size()) ? -1 : static_cast<std::ptrdiff_t>(lcp_[pos]);
+  }
+
+  // Builds the child tables (all sized n + 1, with zero marking undefined entries)
+  // with the two stack based passes of Abouelhoda et al. Given an lcp-interval
+  // [i, j] (closed, like in the paper), up[j + 1] or down[i] are its first l-index
+  // (the end of its first child) and the next l-indices follow the next_ links.
+  void compute_child_tables() {
+    const std::size_t n = size();
+    std::vector<std::size_t> stack;
+
+    DCPL_CHECK_LT(n, std::numeric_limits<index_type>::max())
+        << "Suffix array type too small for the child tables";
+
+    up_.assign(n + 1, 0);
+    down_.assign(n + 1, 0);
+    next_.assign(n + 1, 0);
+
+    std::size_t last = 0;
+
+    stack.push_back(0);
+    for (std::size_t i = 1; i <= n; ++i) {
+      bool popped = false;
+
+      while (lcp_at(i) < lcp_at(stack.back())) {
+        last = stack.back();
+        stack.pop_back();
+        popped = true;
+        if (lcp_at(i) <= lcp_at(stack.back()) && lcp_at(stack.back()) != lcp_at(last)) {
+          down_[stack.back()] = static_cast<index_type>(last);
+        }
+      }
+      if (popped) {
+        up_[i] = static_cast<index_type>(last);
+      }
+      stack.push_back(i);
+    }
+
+    stack.clear();
+    stack.push_back(0);
+    for (std::size_t i = 1; i <= n; ++i) {
+      while (lcp_at(i) < lcp_at(stack.back())) {
+        stack.pop_back();
+      }
+      if (lcp_at(i) == lcp_at(stack.back())) {
+        if (stack.back() != 0) {
+          next_[stack.back()] = static_cast<index_type>(i);
+        }
+        stack.pop_back();
+      }
+      stack.push_back(i);
+    }
+  }
+
+  // The binary searches of find() run over the implicit tree of the (left, right)
+  // open row ranges, starting with (-1, n), and splitting each one at its middle
+  // row. Every row is the middle of exactly one range, for which llcp_ and rlcp_
+  // store its LCP with the left and right bounds (zero for the virtual -1 and n
+  // bounds). Returns the LCP of the left and right bounds.
+  std::size_t compute_lcp_lr(std::ptrdiff_t left, std::ptrdiff_t right) {
+    const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(size());
+
+    if (right - left == 1) {
+      return (left < 0 || right >= n) ? 0 : lcp_[right];
+    }
+
+    std::ptrdiff_t mid = (left + right) / 2;
+    std::size_t left_lcp = compute_lcp_lr(left, mid);
+    std::size_t right_lcp = compute_lcp_lr(mid, right);
+
+    llcp_[mid] = static_cast<index_type>(left_lcp);
+    rlcp_[mid] = static_cast<index_type>(right_lcp);
+
+    return (left < 0 || right >= n) ? 0 : std::min(left_lcp, right_lcp);
+  }
+
+  void compute_lcp_lr() {
+    const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(size());
+
+    llcp_.assign(size(), 0);
+    rlcp_.assign(size(), 0);
+    if (n > 0) {
+      compute_lcp_lr(-1, n);
+    }
+  }
+
+  // Returns the first row whose suffix sorts after seq (if upper) or does not sort
+  // before it (otherwise), where suffixes starting with seq compare equal to it.
+  // Along the search, left_match and right_match are the symbols seq shares with
+  // the suffixes of the bounds. When the larger one is not larger than the LCP of
+  // the middle row with its bound, the middle suffix compares with seq like that
+  // bound, or the LCP tells where it differs. Otherwise the comparison resumes at
+  // the larger match, which never decreases.
+  template <typename V>
+  std::size_t search(const V& seq, bool upper) const {
+    const std::size_t n = size();
+    std::ptrdiff_t left = -1;
+    std::ptrdiff_t right = static_cast<std::ptrdiff_t>(n);
+    std::size_t left_match = 0;
+    std::size_t right_match = 0;
+
+    while (right - left > 1) {
+      std::ptrdiff_t mid = (left + right) / 2;
+      std::size_t match = std::max(left_match, right_match);
+
+      if (left_match >= right_match) {
+        std::size_t mid_lcp = llcp_[mid];
+
+        if (mid_lcp > left_match) {
+          left = mid;
+          continue;
+        }
+        if (mid_lcp < left_match) {
+          right = mid;
+          right_match = mid_lcp;
+          continue;
+        }
+      } else {
+        std::size_t mid_lcp = rlcp_[mid];
+
+        if (mid_lcp > right_match) {
+          right = mid;
+          continue;
+        }
+        if (mid_lcp < right_match) {
+          left = mid;
+          left_match = mid_lcp;
+          continue;
+        }
+      }
+
+      std::size_t start = suffix_array_[mid];
+
+      for (; match < seq.size() && start + match < n &&
+               data_[start + match] == seq[match]; ++match) { }
+
+      bool before;
+
+      if (match == seq.size()) {
+        before = upper;
+      } else {
+        before = start + match == n || data_[start + match] < seq[match];
+      }
+      if (before) {
+        left = mid;
+        left_match = match;
+      } else {
+        right = mid;
+        right_match = match;
+      }
+    }
+
+    return static_cast<std::size_t>(right);
+  }
+
+  // Returns the end of the first child of the (non singleton) lcp-interval.
+  std::size_t first_child_end(std::size_t begin, std::size_t end) const {
+    std::size_t up = up_[end];
+
+    return (begin < up && up < end) ? up : down_[begin];
+  }
+
+  std::size_t interval_lcp(std::size_t begin, std::size_t end) const {
+    return lcp_[first_child_end(begin, end)];
+  }
+
+  interval make_interval(std::size_t begin, std::size_t end) const {
+    std::size_t lcp = (end - begin > 1) ? interval_lcp(begin, end) :
+        size() - suffix_array_[begin];
+
+    return { begin, end, lcp };
+  }
+
+  T data_;
+  S suffix_array_;
+  std::vector<index_type> lcp_;
+  std::vector<index_type> up_;
+  std::vector<index_type> down_;
+  std::vector<index_type> next_;
+  std::vector<index_type> llcp_;
+  std::vector<index_type> rlcp_;
+};
+
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "dcpl/assert.h"
+#include "dcpl/rank_bitset.h"
+#include "dcpl/suffix_array.h"
+
+namespace dcpl::suffix_array {
+namespace detail {
+
+// A wavelet matrix, storing a sequence of symbols in one rank_bitset per symbol bit
+// (rather than one per wavelet tree node), with rank() and access() in O(log sigma).
+class wavelet_matrix {
+ public:
+  wavelet_matrix() = default;
+
+  // The symbols are reordered level by level while building the matrix.
+  wavelet_matrix(std::vector<std::size_t> symbols, std::size_t num_bits) :
+      size_(symbols.size()),
+      levels_(num_bits),
+      zeros_(num_bits) {
+    std::vector<std::size_t> ones;
+
+    for (std::size_t level = 0; level < num_bits; ++level) {
+      std::size_t shift = num_bits - level - 1;
+      rank_bitset bits(size_);
+      std::size_t zeros = 0;
+
+      ones.clear();
+      for (std::size_t i = 0; i < size_; ++i) {
+        if ((symbols[i] >> shift) & 1) {
+          bits.set(i);
+          ones.push_back(symbols[i]);
+        } else {
+          symbols[zeros++] = symbols[i];
+        }
+      }
+      std::copy(ones.begin(), ones.end(), symbols.begin() + zeros);
+      bits.build();
+      levels_[level] = std::move(bits);
+      zeros_[level] = zeros;
+    }
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  std::size_t access(std::size_t pos) const {
+    std::size_t symbol = 0;
+
+    for (std::size_t level = 0; level < levels_.size(); ++level) {
+      const rank_bitset& bits = levels_[level];
+
+      if (bits.get(pos)) {
+        symbol = (symbol << 1) | 1;
+        pos = zeros_[level] + bits.rank1(pos);
+      } else {
+        symbol <<= 1;
+        pos = bits.rank0(pos);
+      }
+    }
+
+    return symbol;
+  }
+
+  // Returns the number of occurrences of symbol within [0, pos).
+  std::size_t rank(std::size_t symbol, std::size_t pos) const {
+    std::size_t begin = 0;
+
+    for (std::size_t level = 0; level < levels_.size(); ++level) {
+      const rank_bitset& bits = levels_[level];
+
+      if ((symbol >> (levels_.size() - level - 1)) & 1) {
+        begin = zeros_[level] + bits.rank1(begin);
+        pos = zeros_[level] + bits.rank1(pos);
+      } else {
+        begin = bits.rank0(begin);
+        pos = bits.rank0(pos);
+      }
+    }
+
+    return pos - begin;
+  }
+
+  std::size_t memory_size() const {
+    std::size_t size = zeros_.size() * sizeof(zeros_[0]);
+
+    for (const auto& bits : levels_) {
+      size += bits.memory_size();
+    }
+
+    return size;
+  }
+
+ private:
+  std::size_t size_ = 0;
+  std::vector<rank_bitset> levels_;
+  std::vector<std::size_t> zeros_;
+};
+
+}
+
+// A compressed replacement of the suffix array, made of the Burrows-Wheeler
+// transform of data (stored within a wavelet matrix) and of the suffix array entries
+// of the positions multiple of sample_rate (stored as T).
+// Counting the occurrences of a pattern takes O(m log sigma) wavelet matrix rank
+// operations (backward search), while every suffix array entry is recovered in at
+// most sample_rate LF steps. The index takes about (log2(sigma) * 1.125 + 1.125) bits
+// per symbol, plus sizeof(T) / sample_rate bytes.
+// The index can be used in place of the suffix array with sequence_index (see the
+// find() and bounds() overloads), as long as only whole array partitions are
+// queried. The suffix array must list the suffixes like compute_sais() does.
+template <typename T>
+class fm_index {
+ public:
+  using value_type = std::size_t;
+
+  fm_index() = default;
+
+  template <typename C, typename S>
+  fm_index(const C& data, const S& sa, std::size_t sample_rate = 32) :
+      size_(data.size()),
+      sample_rate_(sample_rate) {
+    DCPL_CHECK_EQ(data.size(), sa.size()) << "Suffix array size mismatch";
+    DCPL_CHECK_GT(sample_rate, 0);
+    DCPL_CHECK_LT(size_, std::numeric_limits<T>::max())
+        << "Sample type too small for the input data";
+
+    // Symbols are shifted by one, leaving zero to the end of data sentinel, whose
+    // suffix is the smallest one and takes the first row.
+    std::size_t max_symbol = 0;
+
+    for (const auto& value : data) {
+      max_symbol = std::max<std::size_t>(max_symbol, static_cast<std::size_t>(value) + 1);
+    }
+    alphabet_size_ = max_symbol + 1;
+
+    std::vector<std::size_t> counts(alphabet_size_ + 1, 0);
+    std::vector<std::size_t> bwt(size_ + 1);
+
+    sampled_ = rank_bitset(size_ + 1);
+    bwt[0] = size_ > 0 ? static_cast<std::size_t>(data[size_ - 1]) + 1 : 0;
+    for (std::size_t row = 1; row <= size_; ++row) {
+      std::size_t pos = sa[row - 1];
+
+      bwt[row] = pos > 0 ? static_cast<std::size_t>(data[pos - 1]) + 1 : 0;
+      if (pos % sample_rate_ == 0) {
+        sampled_.set(row);
+      }
+    }
+    sampled_.build();
+
+    samples_.resize(sampled_.rank1(size_ + 1));
+    for (std::size_t row = 1, count = 0; row <= size_; ++row) {
+      if (sampled_.get(row)) {
+        samples_[count++] = static_cast<T>(sa[row - 1]);
+      }
+    }
+
+    for (auto symbol : bwt) {
+      ++counts[symbol + 1];
+    }
+    for (std::size_t i = 1; i < counts.size(); ++i) {
+      counts[i] += counts[i - 1];
+    }
+    counts_ = std::move(counts);
+
+    bwt_ = detail::wavelet_matrix(std::move(bwt),
+                                  std::max<std::size_t>(std::bit_width(max_symbol), 1));
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // Returns the suffix array entry at pos.
+  std::size_t operator[](std::size_t pos) const {
+    std::size_t row = pos + 1;
+    std::size_t steps = 0;
+
+    while (!sampled_.get(row)) {
+      std::size_t symbol = bwt_.access(row);
+
+      // Only the suffix at zero (which is always sampled) is preceded by the
+      // sentinel.
+      row = counts_[symbol] + bwt_.rank(symbol, row);
+      ++steps;
+    }
+
+    return samples_[sampled_.rank1(row)] + steps;
+  }
+
+  // Returns the partition of the suffix array entries whose suffixes start with the
+  // seq, like suffix_array::find() does.
+  template <typename V>
+  partition find(const V& seq) const {
+    std::size_t begin = 0;
+    std::size_t end = size_ + 1;
+
+    for (std::size_t i = seq.size(); i > 0 && begin < end; --i) {
+      std::size_t symbol = static_cast<std::size_t>(seq[i - 1]) + 1;
+
+      if (symbol >= alphabet_size_) {
+        begin = end;
+        break;
+      }
+      begin = counts_[symbol] + bwt_.rank(symbol, begin);
+      end = counts_[symbol] + bwt_.rank(symbol, end);
+    }
+    if (begin >= end) {
+      return { size_, size_, 0 };
+    }
+
+    // The first row belongs to the sentinel suffix, which never matches a non
+    // empty sequence.
+    return { std::max<std::size_t>(begin, 1) - 1, end - 1, 0 };
+  }
+
+  template <typename V>
+  std::size_t count(const V& seq) const {
+    partition part = find(seq);
+
+    return part.end - part.begin;
+  }
+
+  template <typename V>
+  partition bounds(V value) const {
+    std::size_t symbol = static_cast<std::size_t>(value) + 1;
+
+    if (symbol >= alphabet_size_ || counts_[symbol] == counts_[symbol + 1]) {
+      return { size_, size_, 0 };
+    }
+
+    return { counts_[symbol] - 1, counts_[symbol + 1] - 1, 0 };
+  }
+
+  std::size_t memory_size() const {
+    return bwt_.memory_size() + sampled_.memory_size() + samples_.size() * sizeof(T) +
+        counts_.size() * sizeof(counts_[0]);
+  }
+
+ private:
+  std::size_t size_ = 0;
+  std::size_t sample_rate_ = 1;
+  std::size_t alphabet_size_ = 1;
+  // The number of BWT symbols lower than each symbol (the C array).
+  std::vector<std::size_t> counts_;
+  detail::wavelet_matrix bwt_;
+  rank_bitset sampled_;
+  std::vector<T> samples_;
+};
+
+template <typename D, typename T, typename V>
+partition bounds(const D& /* data */, const fm_index<T>& index, V value,
+                 const partition& part) {
+  DCPL_ASSERT(part.begin == 0 && part.end == index.size() && part.offset == 0)
+      << "FM-index only supports whole array partitions";
+
+  return index.bounds(value);
+}
+
+template <typename D, typename T, typename V>
+partition find(const D& /* data */, const fm_index<T>& index, const V& seq,
+               const partition& part) {
+  DCPL_ASSERT(part.begin == 0 && part.end == index.size() && part.offset == 0)
+      << "FM-index only supports whole array partitions";
+
+  return index.find(seq);
+}
+
+}
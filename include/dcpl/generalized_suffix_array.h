@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "dcpl/assert.h"
+#include "dcpl/rank_bitset.h"
+#include "dcpl/suffix_array.h"
+
+namespace dcpl::suffix_array {
+namespace detail {
+
+// A tree of the minimum values of blocks of block_size consecutive values (stored
+// elsewhere), used to list all the values lower than a bound within a range in
+// O((count + 1) * (log(n) + block_size)) time, rather than scanning the range.
+template <typename V>
+class min_tree {
+ public:
+  static constexpr std::size_t block_size = 64;
+
+  min_tree() = default;
+
+  explicit min_tree(const std::vector<V>& values) :
+      size_(values.size()) {
+    std::size_t num_blocks = (size_ + block_size - 1) / block_size;
+
+    leaves_ = std::bit_ceil(std::max<std::size_t>(num_blocks, 1));
+    tree_.assign(2 * leaves_, std::numeric_limits<V>::max());
+    for (std::size_t i = 0; i < size_; ++i) {
+      V& leaf = tree_[leaves_ + i / block_size];
+
+      leaf = std::min(leaf, values[i]);
+    }
+    for (std::size_t node = leaves_ - 1; node > 0; --node) {
+      tree_[node] = std::min(tree_[2 * node], tree_[2 * node + 1]);
+    }
+  }
+
+  // Calls fn(i) for all the i within [begin, end) whose values[i] is lower than
+  // bound, in increasing order.
+  template <typename F>
+  void for_each_lower(const std::vector<V>& values, std::size_t begin, std::size_t end,
+                      V bound, const F& fn) const {
+    if (begin < end) {
+      visit(values, 1, 0, leaves_ * block_size, begin, end, bound, fn);
+    }
+  }
+
+  std::size_t memory_size() const {
+    return tree_.size() * sizeof(V);
+  }
+
+ private:
+  template <typename F>
+  void visit(const std::vector<V>& values, std::size_t node, std::size_t lo,
+             std::size_t hi, std::size_t begin, std::size_t end, V bound,
+             const F& fn) const {
+    if (hi <= begin || end <= lo || tree_[node] >= bound) {
+      return;
+    }
+    if (node >= leaves_) {
+      for (std::size_t i = std::max(lo, begin); i < std::min({ hi, end, size_ }); ++i) {
+        if (values[i] < bound) {
+          fn(i);
+        }
+      }
+    } else {
+      std::size_t mid = lo + (hi - lo) / 2;
+
+      visit(values, 2 * node, lo, mid, begin, end, bound, fn);
+      visit(values, 2 * node + 1, mid, hi, begin, end, bound, fn);
+    }
+  }
+
+  std::size_t size_ = 0;
+  std::size_t leaves_ = 1;
+  std::vector<V> tree_;
+};
+
+}
+
+// A suffix array over a collection of documents, concatenated into a single data
+// sequence with a separator symbol (which must not appear within the documents)
+// following each one. Since patterns cannot contain the separator, matches never
+// span more than one document.
+// Every position is mapped to its document in constant time, by a bit vector
+// marking the document starts. The documents holding the matches of a pattern are
+// listed (or counted) in time proportional to their number (times log(n)), rather
+// than to the number of matches, as in Muthukrishnan's document listing: each suffix
+// array row links to the previous row of the same document, and the rows of a
+// partition whose link falls before it are exactly the first match of every
+// document, which a tree of the link minimums finds without scanning the partition.
+// The document frequencies instead take time linear with the number of matches.
+template <typename T, typename S>
+class generalized_suffix_array {
+ public:
+  using data_type = T;
+  using array_type = S;
+  using value_type = typename T::value_type;
+
+  struct document_count {
+    std::size_t doc = 0;
+    std::size_t count = 0;
+
+    auto operator<=>(const document_count&) const = default;
+  };
+
+  generalized_suffix_array(T data, S suffix_array, value_type separator,
+                           std::vector<std::size_t> doc_starts) :
+      data_(std::move(data)),
+      suffix_array_(std::move(suffix_array)),
+      separator_(separator),
+      doc_starts_(std::move(doc_starts)),
+      doc_bits_(data_.size() + 1) {
+    DCPL_CHECK_EQ(data_.size(), suffix_array_.size()) << "Suffix array size mismatch";
+    DCPL_CHECK_LT(data_.size(), std::numeric_limits<link_type>::max())
+        << "Suffix array type too small for the input data";
+    DCPL_ASSERT(!doc_starts_.empty() && doc_starts_.front() == 0)
+        << "Document starts must begin with zero";
+
+    for (std::size_t i = 0; i < doc_starts_.size(); ++i) {
+      // Every document is followed by its separator, so starts are strictly
+      // increasing, and lower than the data size.
+      DCPL_ASSERT(i == 0 || doc_starts_[i] > doc_starts_[i - 1])
+          << "Document starts must be strictly increasing";
+      DCPL_CHECK_LT(doc_starts_[i], data_.size()) << "Document start out of range";
+      doc_bits_.set(doc_starts_[i]);
+    }
+    doc_bits_.build();
+    build_links();
+  }
+
+  // Concatenates the documents and computes their suffix array, using num_threads
+  // threads (see compute_parallel()).
+  template <typename D>
+  static generalized_suffix_array create(const D& documents, value_type separator,
+                                         std::size_t num_threads = 0) {
+    std::vector<std::size_t> doc_starts;
+    T data;
+
+    doc_starts.reserve(documents.size());
+    for (const auto& doc : documents) {
+      doc_starts.push_back(data.size());
+      for (const auto& value : doc) {
+        DCPL_ASSERT(value != separator) << "Separator found within document "
+                                        << doc_starts.size() - 1;
+        data.push_back(value);
+      }
+      data.push_back(separator);
+    }
+
+    S sa = compute_parallel<typename S::value_type>(data, num_threads);
+
+    return generalized_suffix_array(std::move(data), std::move(sa), separator,
+                                    std::move(doc_starts));
+  }
+
+  const T& data() const {
+    return data_;
+  }
+
+  const S& suffix_array() const {
+    return suffix_array_;
+  }
+
+  const std::vector<std::size_t>& doc_starts() const {
+    return doc_starts_;
+  }
+
+  std::size_t num_documents() const {
+    return doc_starts_.size();
+  }
+
+  // Returns the document holding the data position (separators belong to the
+  // document they follow).
+  std::size_t document(std::size_t pos) const {
+    return doc_bits_.rank1(pos + 1) - 1;
+  }
+
+  // Returns the [begin, end) range of the document within data, separator excluded.
+  std::pair<std::size_t, std::size_t> document_range(std::size_t doc) const {
+    std::size_t end = doc + 1 < doc_starts_.size() ? doc_starts_[doc + 1] : data_.size();
+
+    return { doc_starts_[doc], end - 1 };
+  }
+
+  template <typename V>
+  partition find(const V& seq) const {
+    const std::size_t n = data_.size();
+
+    if (std::find(std::begin(seq), std::end(seq), separator_) != std::end(seq)) {
+      return { n, n, 0 };
+    }
+
+    auto [begin, end] = detail::match_range(data_, suffix_array_, seq, 0, 0, 0, n);
+
+    if (begin == end) {
+      return { n, n, 0 };
+    }
+
+    return { begin, end, 0 };
+  }
+
+  // Returns the sorted list of the documents holding the suffixes of the partition.
+  std::vector<std::size_t> list_documents(const partition& part) const {
+    std::vector<std::size_t> docs;
+
+    for_each_first_match(part, [&](std::size_t row) {
+      docs.push_back(document(suffix_array_[row]));
+    });
+    std::sort(docs.begin(), docs.end());
+
+    return docs;
+  }
+
+  std::size_t count_documents(const partition& part) const {
+    std::size_t count = 0;
+
+    for_each_first_match(part, [&](std::size_t) { ++count; });
+
+    return count;
+  }
+
+  // Returns the documents holding the suffixes of the partition, together with how
+  // many suffixes each one holds.
+  std::vector<document_count> document_frequencies(const partition& part) const {
+    std::vector<document_count> counts;
+    // The index within counts of the document of every partition row, found by
+    // following the link to the previous row of the same document.
+    std::vector<std::size_t> slots(part.end - part.begin);
+
+    for (std::size_t i = part.begin; i < part.end; ++i) {
+      std::size_t link = links_[i];
+      std::size_t& slot = slots[i - part.begin];
+
+      if (link > part.begin) {
+        slot = slots[link - 1 - part.begin];
+      } else {
+        slot = counts.size();
+        counts.push_back({ document(suffix_array_[i]), 0 });
+      }
+      ++counts[slot].count;
+    }
+    std::sort(counts.begin(), counts.end());
+
+    return counts;
+  }
+
+ private:
+  using link_type = typename S::value_type;
+
+  // Links every suffix array row to the previous one of the same document (plus one,
+  // so that zero marks the first row of every document).
+  void build_links() {
+    std::vector<link_type> last_rows(doc_starts_.size(), 0);
+
+    links_.resize(suffix_array_.size());
+    for (std::size_t i = 0; i < suffix_array_.size(); ++i) {
+      link_type& last_row = last_rows[document(suffix_array_[i])];
+
+      links_[i] = last_row;
+      last_row = static_cast<link_type>(i + 1);
+    }
+    link_tree_ = detail::min_tree<link_type>(links_);
+  }
+
+  // Calls fn(row) for the first row of every document within the partition, which
+  // are the ones linking to a row before the partition.
+  template <typename F>
+  void for_each_first_match(const partition& part, const F& fn) const {
+    link_tree_.for_each_lower(links_, part.begin, part.end,
+                              static_cast<link_type>(part.begin + 1), fn);
+  }
+
+  T data_;
+  S suffix_array_;
+  value_type separator_{};
+  std::vector<std::size_t> doc_starts_;
+  rank_bitset doc_bits_;
+  std::vector<link_type> links_;
+  detail::min_tree<link_type> link_tree_;
+};
+
+}
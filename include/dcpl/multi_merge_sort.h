@@ -21,32 +21,29 @@ struct range {
   I end;
 };
 
-template <typename T, typename C>
-std::vector<typename container_type<T>::value_type>
-multi_merge(const T& streams, const C& cmp) {
+// Merges the sorted streams calling fn(value) for each value, in order, so that the
+// merged sequence never needs to be held in memory.
+template <typename T, typename C, typename F>
+void multi_merge(const T& streams, const C& cmp, const F& fn) {
   using container_type = container_type<T>;
-  using value_type = typename container_type::value_type;
 
   auto it_cmp = [&](const container_type& it1, const container_type& it2) {
     return !cmp(*it1.begin, *it2.begin);
   };
-  std::size_t count = 0;
   std::priority_queue<container_type,
                       std::vector<container_type>,
                       decltype(it_cmp)> queue(it_cmp);
 
   for (const auto& stream : streams) {
-    queue.push(stream);
-    count += std::distance(stream.begin, stream.end);
+    if (stream.begin != stream.end) {
+      queue.push(stream);
+    }
   }
 
-  std::vector<value_type> merged;
-
-  merged.reserve(count);
   while (!queue.empty()) {
     container_type top = queue.top();
 
-    merged.push_back(*top.begin);
+    fn(*top.begin);
 
     queue.pop();
     ++top.begin;
@@ -54,6 +51,23 @@ multi_merge(const T& streams, const C& cmp) {
       queue.push(top);
     }
   }
+}
+
+template <typename T, typename C>
+std::vector<typename container_type<T>::value_type>
+multi_merge(const T& streams, const C& cmp) {
+  using value_type = typename container_type<T>::value_type;
+
+  std::size_t count = 0;
+
+  for (const auto& stream : streams) {
+    count += std::distance(stream.begin, stream.end);
+  }
+
+  std::vector<value_type> merged;
+
+  merged.reserve(count);
+  multi_merge(streams, cmp, [&](const value_type& value) { merged.push_back(value); });
 
   return merged;
 }
@@ -2,6 +2,7 @@
 
 #include <unistd.h>
 
+#include <array>
 #include <cstdint>
 #include <cstddef>
 #include <ctime>
@@ -16,4 +17,9 @@ std::tm localtime(std::time_t epoc_time);
 
 std::size_t page_size();
 
+// Creates a pair of connected stream sockets.
+std::array<int, 2> socketpair();
+
+void close(int fd);
+
 }
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dcpl {
+
+// A bit vector with constant time rank support, storing the count of the set bits
+// preceding every 512 bits block (a 12.5% space overhead).
+class rank_bitset {
+ public:
+  rank_bitset() = default;
+
+  explicit rank_bitset(std::size_t size) :
+      size_(size),
+      words_((size + word_bits - 1) / word_bits + 1, 0) {
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  bool get(std::size_t pos) const {
+    return ((words_[pos / word_bits] >> (pos % word_bits)) & 1) != 0;
+  }
+
+  void set(std::size_t pos) {
+    words_[pos / word_bits] |= std::uint64_t(1) << (pos % word_bits);
+  }
+
+  // To be called once all the bits have been set, before any rank query.
+  void build() {
+    std::uint64_t count = 0;
+
+    blocks_.resize(words_.size() / block_words + 1);
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+      if (i % block_words == 0) {
+        blocks_[i / block_words] = count;
+      }
+      count += std::popcount(words_[i]);
+    }
+  }
+
+  // Returns the number of set bits within [0, pos).
+  std::size_t rank1(std::size_t pos) const {
+    std::size_t word = pos / word_bits;
+    std::size_t count = blocks_[word / block_words];
+
+    for (std::size_t i = word - word % block_words; i < word; ++i) {
+      count += std::popcount(words_[i]);
+    }
+
+    std::uint64_t mask = (std::uint64_t(1) << (pos % word_bits)) - 1;
+
+    return count + std::popcount(words_[word] & mask);
+  }
+
+  std::size_t rank0(std::size_t pos) const {
+    return pos - rank1(pos);
+  }
+
+  std::size_t memory_size() const {
+    return words_.size() * sizeof(words_[0]) + blocks_.size() * sizeof(blocks_[0]);
+  }
+
+ private:
+  static constexpr std::size_t word_bits = 64;
+  static constexpr std::size_t block_words = 8;
+
+  std::size_t size_ = 0;
+  std::vector<std::uint64_t> words_;
+  std::vector<std::uint64_t> blocks_;
+};
+
+}
@@ -4,11 +4,17 @@
 #include <new>
 #include <type_traits>
 
+#include "dcpl/rcu/pool.h"
 #include "dcpl/rcu/rcu.h"
 
 namespace dcpl::rcu {
 
+template <typename T>
+inline constexpr bool is_pooled = alignof(T) <= pool::alignment;
+
 // NOTE: Using this allocator fed into stdc++ classes does not make them RCU safe!
+// Allocations are served by the RCU node pool (see "dcpl/rcu/pool.h"), and the
+// memory released with deallocate() returns to the pool only after a grace period.
 template<typename T = char>
 struct allocator {
   using value_type = T;
@@ -26,7 +32,13 @@ struct allocator {
       throw std::bad_array_new_length();
     }
 
-    T* ptr = static_cast<T*>(operator new(n * sizeof(T)));
+    T* ptr = nullptr;
+
+    if constexpr (is_pooled<T>) {
+      ptr = static_cast<T*>(pool::allocate(n * sizeof(T)));
+    } else {
+      ptr = static_cast<T*>(operator new(n * sizeof(T)));
+    }
 
     if (ptr == nullptr) {
       throw std::bad_alloc();
@@ -36,10 +48,33 @@ struct allocator {
   }
 
   void deallocate(T* p, size_type n) noexcept {
-    mem_delete(p);
+    if constexpr (is_pooled<T>) {
+      pool::retire(p, n * sizeof(T));
+    } else {
+      mem_delete(p);
+    }
   }
 };
 
+template <typename T>
+void node_release(void* ptr) {
+  T* node = reinterpret_cast<T*>(ptr);
+
+  node->~T();
+  if constexpr (is_pooled<T>) {
+    pool::deallocate(node, sizeof(T));
+  } else {
+    operator delete(node);
+  }
+}
+
+// Destroys an object created with allocator<T>().allocate(1), and releases its
+// memory, once the current RCU grace period expires.
+template <typename T>
+void free_node(T* ptr) {
+  enqueue_callback(ptr, &node_release<T>, sizeof(T));
+}
+
 template <typename T, typename U>
 bool operator==(const allocator<T>&, const allocator<U>&) {
   return true;
@@ -0,0 +1,649 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include "dcpl/assert.h"
+#include "dcpl/rcu/allocator.h"
+#include "dcpl/rcu/pointers.h"
+#include "dcpl/rcu/rcu.h"
+
+namespace dcpl::rcu {
+
+template <typename Key, typename T, typename Compare>
+class map;
+
+namespace impl {
+
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class map {
+  friend class dcpl::rcu::map<Key, T, Compare>;
+
+  static constexpr std::size_t order = 16;
+  static constexpr std::size_t min_fill = order / 4;
+
+  // Leaves store the keys inline, together with pointers to the value_type objects,
+  // while inner nodes store the minimum key of each child subtree. Once published
+  // nodes are never modified, as writers copy the whole path from the root to the
+  // modified leaf.
+  struct node {
+    bool leaf = true;
+    std::size_t count = 0;
+    std::array<Key, order> keys;
+    std::array<void*, order> ptrs{};
+
+    const node* child(std::size_t i) const {
+      return static_cast<const node*>(ptrs[i]);
+    }
+  };
+
+  struct split_result {
+    node* left = nullptr;
+    node* right = nullptr;
+  };
+
+ public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using key_compare = Compare;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+
+  class const_iterator {
+    friend class map;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = map::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    const_iterator() = default;
+
+    bool operator==(const const_iterator& rhs) const {
+      return leaf_ == rhs.leaf_ && pos_ == rhs.pos_;
+    }
+
+    reference operator*() const {
+      return *value(leaf_, pos_);
+    }
+
+    pointer operator->() const {
+      return value(leaf_, pos_);
+    }
+
+    const_iterator& operator++() {
+      pos_ += 1;
+      if (pos_ >= leaf_->count) {
+        std::tie(leaf_, pos_) = map_->seek(map_->root_, leaf_->keys[leaf_->count - 1],
+                                           /*upper=*/ true);
+      }
+
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator it(*this);
+
+      ++(*this);
+
+      return it;
+    }
+
+   private:
+    const_iterator(const map* map, const node* leaf, size_type pos) :
+        map_(map),
+        leaf_(leaf),
+        pos_(pos) {
+    }
+
+    const map* map_ = nullptr;
+    const node* leaf_ = nullptr;
+    size_type pos_ = 0;
+  };
+
+  using iterator = const_iterator;
+
+  size_type size() const {
+    return count_;
+  }
+
+  bool empty() const {
+    return count_ == 0;
+  }
+
+  const_iterator begin() const {
+    const node* cnode = root_;
+
+    if (cnode == nullptr) {
+      return end();
+    }
+    while (!cnode->leaf) {
+      cnode = cnode->child(0);
+    }
+
+    return { this, cnode, 0 };
+  }
+
+  const_iterator end() const {
+    return { this, nullptr, 0 };
+  }
+
+  const_iterator lower_bound(const key_type& key) const {
+    auto [leaf, pos] = seek(root_, key, /*upper=*/ false);
+
+    return { this, leaf, pos };
+  }
+
+  const_iterator upper_bound(const key_type& key) const {
+    auto [leaf, pos] = seek(root_, key, /*upper=*/ true);
+
+    return { this, leaf, pos };
+  }
+
+  const_iterator find(const key_type& key) const {
+    const_iterator it = lower_bound(key);
+
+    return (it != end() && !comp_(key, it->first)) ? it : end();
+  }
+
+  size_type count(const key_type& key) const {
+    return find(key) != end() ? 1 : 0;
+  }
+
+  const mapped_type& at(const key_type& key) const {
+    const_iterator it = find(key);
+
+    if (it == end()) {
+      throw std::out_of_range("Requested key not found");
+    }
+
+    return it->second;
+  }
+
+  // Calls fn(value) for all the values with keys within the [lo, hi) range.
+  template <typename F>
+  void for_each(const key_type& lo, const key_type& hi, const F& fn) const {
+    for (const_iterator it = lower_bound(lo); it != end() && comp_(it->first, hi); ++it) {
+      fn(*it);
+    }
+  }
+
+ private:
+  map(const node* root, size_type count) :
+      root_(root),
+      count_(count) {
+  }
+
+  static const value_type* value(const node* leaf, size_type pos) {
+    return static_cast<const value_type*>(leaf->ptrs[pos]);
+  }
+
+  size_type key_index(const node* cnode, const key_type& key, bool upper) const {
+    auto kbegin = cnode->keys.begin();
+    auto kend = kbegin + cnode->count;
+    auto it = upper ? std::upper_bound(kbegin, kend, key, comp_) :
+        std::lower_bound(kbegin, kend, key, comp_);
+
+    return static_cast<size_type>(std::distance(kbegin, it));
+  }
+
+  size_type child_index(const node* cnode, const key_type& key) const {
+    auto kbegin = cnode->keys.begin();
+    auto it = std::upper_bound(kbegin + 1, kbegin + cnode->count, key, comp_);
+
+    return static_cast<size_type>(std::distance(kbegin, it)) - 1;
+  }
+
+  std::pair<const node*, size_type> seek(const node* cnode, const key_type& key,
+                                         bool upper) const {
+    if (cnode == nullptr) {
+      return { nullptr, 0 };
+    }
+    if (cnode->leaf) {
+      size_type pos = key_index(cnode, key, upper);
+
+      return pos < cnode->count ?
+          std::pair<const node*, size_type>{ cnode, pos } :
+          std::pair<const node*, size_type>{ nullptr, 0 };
+    }
+    // Only the first child (the one which might contain the key) can fail to have
+    // a matching entry, as all the following ones have bigger keys.
+    for (size_type idx = child_index(cnode, key); idx < cnode->count; ++idx) {
+      auto result = seek(cnode->child(idx), key, upper);
+
+      if (result.first != nullptr) {
+        return result;
+      }
+    }
+
+    return { nullptr, 0 };
+  }
+
+  static node* new_node(bool leaf) {
+    node* cnode = allocator<node>().allocate(1);
+
+    new (cnode) node();
+    cnode->leaf = leaf;
+
+    return cnode;
+  }
+
+  static node* copy_node(const node* src) {
+    node* cnode = allocator<node>().allocate(1);
+
+    new (cnode) node(*src);
+
+    return cnode;
+  }
+
+  // Used for nodes which have never been published, and hence cannot be seen by
+  // any reader.
+  static void destroy_node(node* cnode) {
+    node_release<node>(cnode);
+  }
+
+  static void retire_node(const node* cnode) {
+    free_node(const_cast<node*>(cnode));
+  }
+
+  static void retire_value(void* ptr) {
+    free_node(static_cast<value_type*>(ptr));
+  }
+
+  static void free_tree(const node* cnode) {
+    for (size_type i = 0; i < cnode->count; ++i) {
+      if (cnode->leaf) {
+        retire_value(cnode->ptrs[i]);
+      } else {
+        free_tree(cnode->child(i));
+      }
+    }
+    retire_node(cnode);
+  }
+
+  static void set_child(node* cnode, size_type idx, node* child) {
+    cnode->keys[idx] = child->keys[0];
+    cnode->ptrs[idx] = child;
+  }
+
+  static void insert_at(node* cnode, size_type pos, const key_type& key, void* ptr) {
+    for (size_type i = cnode->count; i > pos; --i) {
+      cnode->keys[i] = std::move(cnode->keys[i - 1]);
+      cnode->ptrs[i] = cnode->ptrs[i - 1];
+    }
+    cnode->keys[pos] = key;
+    cnode->ptrs[pos] = ptr;
+    cnode->count += 1;
+  }
+
+  static void remove_at(node* cnode, size_type pos) {
+    for (size_type i = pos + 1; i < cnode->count; ++i) {
+      cnode->keys[i - 1] = std::move(cnode->keys[i]);
+      cnode->ptrs[i - 1] = cnode->ptrs[i];
+    }
+    cnode->count -= 1;
+    cnode->keys[cnode->count] = key_type();
+    cnode->ptrs[cnode->count] = nullptr;
+  }
+
+  static void append(node* cnode, const key_type& key, void* ptr) {
+    cnode->keys[cnode->count] = key;
+    cnode->ptrs[cnode->count] = ptr;
+    cnode->count += 1;
+  }
+
+  // Splits the full `cnode` in two, with the new entry inserted at `pos`.
+  static split_result split_insert(const node* cnode, size_type pos,
+                                   const key_type& key, void* ptr) {
+    size_type total = cnode->count + 1;
+    split_result result{ new_node(cnode->leaf), new_node(cnode->leaf) };
+
+    for (size_type i = 0, src = 0; i < total; ++i) {
+      node* dest = i < total / 2 ? result.left : result.right;
+
+      if (i == pos) {
+        append(dest, key, ptr);
+      } else {
+        append(dest, cnode->keys[src], cnode->ptrs[src]);
+        ++src;
+      }
+    }
+
+    return result;
+  }
+
+  // Merges two sibling nodes into one, or redistributes their entries evenly among
+  // two new nodes if they do not fit a single one.
+  static split_result merge_nodes(const node* lnode, const node* rnode) {
+    size_type total = lnode->count + rnode->count;
+    split_result result{ new_node(lnode->leaf), nullptr };
+    size_type lcount = total;
+
+    if (total > order) {
+      result.right = new_node(lnode->leaf);
+      lcount = total / 2;
+    }
+    for (size_type i = 0; i < total; ++i) {
+      const node* src = i < lnode->count ? lnode : rnode;
+      size_type spos = i < lnode->count ? i : i - lnode->count;
+      node* dest = i < lcount ? result.left : result.right;
+
+      append(dest, src->keys[spos], src->ptrs[spos]);
+    }
+
+    return result;
+  }
+
+  split_result insert_node(const node* cnode, value_type* kv, bool* inserted) const {
+    if (cnode->leaf) {
+      size_type pos = key_index(cnode, kv->first, /*upper=*/ false);
+
+      if (pos < cnode->count && !comp_(kv->first, cnode->keys[pos])) {
+        node* ncnode = copy_node(cnode);
+
+        retire_value(ncnode->ptrs[pos]);
+        ncnode->ptrs[pos] = kv;
+        *inserted = false;
+
+        return { ncnode, nullptr };
+      }
+
+      *inserted = true;
+      if (cnode->count < order) {
+        node* ncnode = copy_node(cnode);
+
+        insert_at(ncnode, pos, kv->first, kv);
+
+        return { ncnode, nullptr };
+      }
+
+      return split_insert(cnode, pos, kv->first, kv);
+    }
+
+    size_type idx = child_index(cnode, kv->first);
+    const node* child = cnode->child(idx);
+    split_result cresult = insert_node(child, kv, inserted);
+    node* ncnode = copy_node(cnode);
+
+    retire_node(child);
+    set_child(ncnode, idx, cresult.left);
+    if (cresult.right == nullptr) {
+      return { ncnode, nullptr };
+    }
+    if (ncnode->count < order) {
+      insert_at(ncnode, idx + 1, cresult.right->keys[0], cresult.right);
+
+      return { ncnode, nullptr };
+    }
+
+    split_result result = split_insert(ncnode, idx + 1, cresult.right->keys[0],
+                                       cresult.right);
+
+    destroy_node(ncnode);
+
+    return result;
+  }
+
+  // The key must be present in the subtree. Returns the new version of `cnode`,
+  // or nullptr if it became empty.
+  node* erase_node(const node* cnode, const key_type& key) const {
+    if (cnode->leaf) {
+      size_type pos = key_index(cnode, key, /*upper=*/ false);
+
+      retire_value(cnode->ptrs[pos]);
+      if (cnode->count == 1) {
+        return nullptr;
+      }
+
+      node* ncnode = copy_node(cnode);
+
+      remove_at(ncnode, pos);
+
+      return ncnode;
+    }
+
+    size_type idx = child_index(cnode, key);
+    const node* child = cnode->child(idx);
+    node* nchild = erase_node(child, key);
+    node* ncnode = copy_node(cnode);
+
+    retire_node(child);
+    if (nchild == nullptr) {
+      remove_at(ncnode, idx);
+      if (ncnode->count == 0) {
+        destroy_node(ncnode);
+
+        return nullptr;
+      }
+
+      return ncnode;
+    }
+
+    set_child(ncnode, idx, nchild);
+    if (nchild->count < min_fill && ncnode->count > 1) {
+      size_type lidx = (idx + 1 < ncnode->count) ? idx : idx - 1;
+      const node* lnode = ncnode->child(lidx);
+      const node* rnode = ncnode->child(lidx + 1);
+      split_result result = merge_nodes(lnode, rnode);
+
+      for (const node* mnode : { lnode, rnode }) {
+        if (mnode == nchild) {
+          destroy_node(nchild);
+        } else {
+          retire_node(mnode);
+        }
+      }
+
+      set_child(ncnode, lidx, result.left);
+      if (result.right != nullptr) {
+        set_child(ncnode, lidx + 1, result.right);
+      } else {
+        remove_at(ncnode, lidx + 1);
+      }
+    }
+
+    return ncnode;
+  }
+
+  map* insert(value_type* kv) const {
+    bool inserted = false;
+    const node* root = nullptr;
+
+    if (root_ == nullptr) {
+      node* leaf = new_node(/*leaf=*/ true);
+
+      append(leaf, kv->first, kv);
+      root = leaf;
+      inserted = true;
+    } else {
+      split_result result = insert_node(root_, kv, &inserted);
+
+      retire_node(root_);
+      if (result.right != nullptr) {
+        node* nroot = new_node(/*leaf=*/ false);
+
+        append(nroot, result.left->keys[0], result.left);
+        append(nroot, result.right->keys[0], result.right);
+        root = nroot;
+      } else {
+        root = result.left;
+      }
+    }
+
+    return new map(root, inserted ? count_ + 1 : count_);
+  }
+
+  map* erase(const key_type& key) const {
+    node* root = erase_node(root_, key);
+
+    retire_node(root_);
+    while (root != nullptr && !root->leaf && root->count == 1) {
+      node* child = static_cast<node*>(root->ptrs[0]);
+
+      destroy_node(root);
+      root = child;
+    }
+
+    return new map(root, count_ - 1);
+  }
+
+  key_compare comp_;
+  const node* root_ = nullptr;
+  size_type count_ = 0;
+};
+
+}
+
+// In RCU there is a single writer (eventually serializing among themselves with
+// external locks) and multiple readers which do not serialize at all, except for
+// accessing data within a section where the rcu::context is held.
+// This ordered map is a copy-on-write B+tree, where every update copies the nodes
+// on the path from the root to the modified leaf, and publishes a new map_type
+// version pointing to the new root. Replaced nodes and values are freed once the
+// RCU grace period expires.
+// The Key type must be default constructible, as keys are stored inline within the
+// tree nodes.
+// Readers should grab an rcu::context in scope, and then use the map_type reference
+// returned by the get() API, which provides a consistent snapshot of the map.
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class map {
+ public:
+  using map_type = impl::map<Key, T, Compare>;
+
+  using key_type = map_type::key_type;
+  using mapped_type = map_type::mapped_type;
+  using value_type = map_type::value_type;
+  using key_compare = map_type::key_compare;
+  using size_type = map_type::size_type;
+  using difference_type = map_type::difference_type;
+  using reference = map_type::reference;
+  using const_reference = map_type::const_reference;
+  using pointer = map_type::pointer;
+  using const_pointer = map_type::const_pointer;
+  using iterator = map_type::iterator;
+  using const_iterator = map_type::const_iterator;
+
+  map() :
+      map_(new map_type(nullptr, 0)) {
+  }
+
+  map(const map&) = delete;
+
+  ~map() {
+    free_data();
+  }
+
+  map& operator=(const map&) = delete;
+
+  const map_type& get() const {
+    return *map_;
+  }
+
+  size_type size() const {
+    return map_->size();
+  }
+
+  bool empty() const {
+    return map_->empty();
+  }
+
+  void clear() {
+    free_data();
+
+    unique_ptr<map_type> nmap(new map_type(nullptr, 0));
+
+    map_.swap(nmap);
+  }
+
+  // Like rcu::unordered_map, inserting an existing key replaces its value.
+  template <typename U>
+  std::pair<const_iterator, bool> insert(U&& value) {
+    value_type* kv = allocator<value_type>().allocate(1);
+
+    try {
+      new (kv) value_type(std::forward<U>(value));
+    } catch (...) {
+      allocator<value_type>().deallocate(kv, 1);
+      throw;
+    }
+
+    size_type count = map_->size();
+    unique_ptr<map_type> nmap(map_->insert(kv));
+
+    map_.swap(nmap);
+
+    return { map_->find(kv->first), map_->size() > count };
+  }
+
+  template <typename... ARGS>
+  std::pair<const_iterator, bool> emplace(ARGS&&... args) {
+    return insert(value_type(std::forward<ARGS>(args)...));
+  }
+
+  size_type erase(const key_type& key) {
+    if (map_->count(key) == 0) {
+      return 0;
+    }
+
+    unique_ptr<map_type> nmap(map_->erase(key));
+
+    map_.swap(nmap);
+
+    return 1;
+  }
+
+  const_iterator begin() const {
+    return map_->begin();
+  }
+
+  const_iterator end() const {
+    return map_->end();
+  }
+
+  const_iterator find(const key_type& key) const {
+    return map_->find(key);
+  }
+
+  const_iterator lower_bound(const key_type& key) const {
+    return map_->lower_bound(key);
+  }
+
+  const_iterator upper_bound(const key_type& key) const {
+    return map_->upper_bound(key);
+  }
+
+  size_type count(const key_type& key) const {
+    return map_->count(key);
+  }
+
+  const mapped_type& at(const key_type& key) const {
+    return map_->at(key);
+  }
+
+  void swap(map& other) {
+    map_.swap(other.map_);
+  }
+
+ private:
+  void free_data() {
+    if (map_->root_ != nullptr) {
+      map_type::free_tree(map_->root_);
+    }
+  }
+
+  unique_ptr<map_type> map_;
+};
+
+}
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <memory>
 #include <type_traits>
+#include <utility>
 
+#include "dcpl/assert.h"
 #include "dcpl/rcu/rcu.h"
 
 namespace dcpl::rcu {
@@ -46,5 +49,90 @@ std::shared_ptr<T> create_shared(std::remove_extent_t<T>* ptr) {
   return std::shared_ptr<T>(ptr, deleter<T>());
 }
 
-}
+// An atomically swappable pointer to a read mostly object, whose replaced
+// versions are freed (using free_object()) once the RCU grace period expires.
+// Readers should grab an rcu::context in scope, and use the pointer returned by
+// load() only while the context is held, without any reference counting.
+// Unlike the RCU containers, writers do not need external serialization, as the
+// update() API retries the copy-modify-publish sequence if another writer wins.
+template <typename T>
+class atomic_ptr {
+ public:
+  atomic_ptr() = default;
+
+  explicit atomic_ptr(unique_ptr<T> ptr) :
+      ptr_(ptr.release()) {
+  }
+
+  atomic_ptr(const atomic_ptr&) = delete;
 
+  ~atomic_ptr() {
+    store(nullptr);
+  }
+
+  atomic_ptr& operator=(const atomic_ptr&) = delete;
+
+  const T* load() const {
+    return ptr_.load(std::memory_order_acquire);
+  }
+
+  const T* operator->() const {
+    return load();
+  }
+
+  const T& operator*() const {
+    return *load();
+  }
+
+  explicit operator bool() const {
+    return load() != nullptr;
+  }
+
+  void store(unique_ptr<T> ptr) {
+    exchange(std::move(ptr));
+  }
+
+  // The returned pointer frees the old object in an RCU fashion once dropped, so
+  // it can be still inspected by the caller.
+  unique_ptr<T> exchange(unique_ptr<T> ptr) {
+    return unique_ptr<T>(ptr_.exchange(ptr.release(), std::memory_order_acq_rel));
+  }
+
+  // Publishes `desired` only if the current object is `expected`, in which case
+  // `desired` ownership is taken (and the old object freed).
+  bool compare_exchange(const T* expected, unique_ptr<T>& desired) {
+    T* current = const_cast<T*>(expected);
+
+    if (!ptr_.compare_exchange_strong(current, desired.get(), std::memory_order_acq_rel)) {
+      return false;
+    }
+    desired.release();
+    free_object(current);
+
+    return true;
+  }
+
+  // Copies the current object, calls fn(T*) on the copy, and publishes it.
+  template <typename F>
+  void update(const F& fn) {
+    context ctx;
+
+    for (;;) {
+      const T* current = load();
+
+      DCPL_ASSERT(current != nullptr) << "Cannot update a null atomic_ptr";
+
+      unique_ptr<T> copy(new T(*current));
+
+      fn(copy.get());
+      if (compare_exchange(current, copy)) {
+        break;
+      }
+    }
+  }
+
+ private:
+  std::atomic<T*> ptr_ = nullptr;
+};
+
+}
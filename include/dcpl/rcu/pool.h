@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace dcpl::rcu::pool {
+
+// Nodes up to max_size bytes are served by per-thread, size-classed caches sitting
+// on top of slabs which are never returned to the system. Bigger allocations go
+// straight to the global allocator.
+// Nodes freed with retire() go back to the pool only after an RCU grace period,
+// so they can be safely used to back objects still visible to readers.
+static constexpr std::size_t alignment = 16;
+static constexpr std::size_t max_size = 512;
+static constexpr std::size_t num_classes = max_size / alignment;
+
+struct class_stats {
+  std::size_t node_size = 0;
+  std::size_t total_nodes = 0;
+  std::size_t free_nodes = 0;
+};
+
+struct stats {
+  std::size_t slab_count = 0;
+  std::size_t slab_bytes = 0;
+  std::size_t total_nodes = 0;
+  std::size_t free_nodes = 0;
+  std::size_t used_nodes = 0;
+  std::size_t large_allocs = 0;
+  std::vector<class_stats> classes;
+};
+
+void* allocate(std::size_t size);
+
+// Immediately returns the node to the pool, and must be used only when it is
+// known that no readers can be referencing it.
+void deallocate(void* ptr, std::size_t size);
+
+// Returns the node to the pool once the current RCU grace period expires.
+void retire(void* ptr, std::size_t size);
+
+stats get_stats();
+
+}
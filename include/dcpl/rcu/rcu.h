@@ -1,21 +1,89 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <limits>
 #include <new>
+#include <optional>
 #include <thread>
 #include <utility>
+#include <vector>
+
+#include "dcpl/types.h"
 
 namespace dcpl::rcu {
 
+using gen_t = std::uintmax_t;
+
+// Bucket N counts the samples within the [2^N, 2^(N+1)) microseconds range, with
+// the first and last buckets also collecting the underflows and overflows.
+struct time_histogram {
+  static constexpr std::size_t num_buckets = 32;
+
+  void add(ns_time value);
+
+  ns_time percentile(double pct) const;
+
+  std::array<std::size_t, num_buckets> buckets{};
+  std::size_t count = 0;
+  ns_time total{ 0 };
+  ns_time max{ 0 };
+};
+
+struct generation_stats {
+  gen_t generation = 0;
+  std::size_t callbacks = 0;
+  std::size_t bytes = 0;
+  ns_time age{ 0 };
+};
+
+// The held_time is only tracked while reader stats or stall detection are enabled
+// (it is zero otherwise), as it costs a clock read on every read-side entry.
+struct reader_stats {
+  std::thread::id thread_id;
+  gen_t generation = 0;
+  ns_time held_time{ 0 };
+};
+
+struct stats {
+  gen_t generation = 0;
+  std::size_t pending_callbacks = 0;
+  std::size_t pending_bytes = 0;
+  std::vector<generation_stats> pending;
+  std::size_t active_pins = 0;
+  std::size_t reader_stalls = 0;
+  std::size_t purge_runs = 0;
+  std::size_t executed_callbacks = 0;
+  time_histogram grace_period;
+  time_histogram purge_time;
+  std::optional<reader_stats> oldest_reader;
+};
+
+stats get_stats();
+
+// When set to a non zero value, the purger logs the reader sections which have
+// been held for longer than the threshold. The initial value is taken from the
+// RCU_STALL_THRESHOLD environment variable (milliseconds).
+void set_stall_threshold(ns_time threshold);
+
+// Runs the stall detection, which the purger otherwise runs at every period.
+void check_stalls();
+
+// Enables tracking the time readers have been holding their sections, reported by
+// get_stats() for the oldest reader. The initial value is taken from the
+// RCU_READER_STATS environment variable.
+void set_reader_stats(bool enabled);
+
 void flush_callbacks();
 
 void enter();
 
 void exit();
 
-void enqueue_callback(void* data, void (*fn)(void*));
+// The size is only used for accounting the memory pending release.
+void enqueue_callback(void* data, void (*fn)(void*), std::size_t size = 0);
 
 void synchronize();
 
@@ -31,7 +99,7 @@ void array_release(void* ptr) {
 
 template <typename T>
 void free_object(T* ptr) {
-  enqueue_callback(ptr, &object_release<T>);
+  enqueue_callback(ptr, &object_release<T>, sizeof(T));
 }
 
 template <typename T>
@@ -53,5 +121,26 @@ struct context {
   }
 };
 
+// Pins the current generation like a context does, but without being bound to the
+// calling thread, so that it can be moved among threads, and used to protect long
+// running scans (eventually executed by multiple workers).
+class pin {
+ public:
+  pin();
+
+  pin(pin&& ref) noexcept :
+      handle_(std::exchange(ref.handle_, nullptr)) {
+  }
+
+  pin(const pin&) = delete;
+
+  ~pin();
+
+  pin& operator=(const pin&) = delete;
+
+ private:
+  void* handle_ = nullptr;
+};
+
 }
 
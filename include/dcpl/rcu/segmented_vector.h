@@ -0,0 +1,355 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <utility>
+
+#include "dcpl/assert.h"
+#include "dcpl/rcu/allocator.h"
+#include "dcpl/rcu/pointers.h"
+#include "dcpl/rcu/rcu.h"
+
+namespace dcpl::rcu {
+
+template <typename T>
+class segmented_vector;
+
+namespace impl {
+
+template <typename T>
+class segmented_vector {
+  friend class dcpl::rcu::segmented_vector<T>;
+
+  // Segment K holds (base_size << K) elements, and starts at index
+  // base_size * (2^K - 1), so that the directory never needs to be resized.
+  static constexpr std::size_t base_shift = 4;
+  static constexpr std::size_t base_size = static_cast<std::size_t>(1) << base_shift;
+  static constexpr std::size_t max_segments =
+      sizeof(std::size_t) * 8 - base_shift;
+
+ public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator() = default;
+
+    const_iterator(const segmented_vector* svect, size_type pos) :
+        svect_(svect),
+        pos_(pos) {
+    }
+
+    auto operator<=>(const const_iterator& rhs) const {
+      return pos_ <=> rhs.pos_;
+    }
+
+    bool operator==(const const_iterator& rhs) const {
+      return pos_ == rhs.pos_;
+    }
+
+    reference operator*() const {
+      return (*svect_)[pos_];
+    }
+
+    pointer operator->() const {
+      return &(*svect_)[pos_];
+    }
+
+    reference operator[](difference_type n) const {
+      return (*svect_)[pos_ + n];
+    }
+
+    const_iterator& operator++() {
+      ++pos_;
+
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator it(*this);
+
+      ++pos_;
+
+      return it;
+    }
+
+    const_iterator& operator--() {
+      --pos_;
+
+      return *this;
+    }
+
+    const_iterator operator--(int) {
+      const_iterator it(*this);
+
+      --pos_;
+
+      return it;
+    }
+
+    const_iterator& operator+=(difference_type n) {
+      pos_ += n;
+
+      return *this;
+    }
+
+    const_iterator& operator-=(difference_type n) {
+      pos_ -= n;
+
+      return *this;
+    }
+
+    const_iterator operator+(difference_type n) const {
+      return { svect_, pos_ + n };
+    }
+
+    const_iterator operator-(difference_type n) const {
+      return { svect_, pos_ - n };
+    }
+
+    difference_type operator-(const const_iterator& rhs) const {
+      return static_cast<difference_type>(pos_) - static_cast<difference_type>(rhs.pos_);
+    }
+
+   private:
+    const segmented_vector* svect_ = nullptr;
+    size_type pos_ = 0;
+  };
+
+  using iterator = const_iterator;
+
+  ~segmented_vector() {
+    size_type count = count_.load(std::memory_order_relaxed);
+
+    for (size_type i = 0; i < count; ++i) {
+      (*this)[i].~T();
+    }
+    for (size_type seg = 0; seg < max_segments; ++seg) {
+      T* segment = segments_[seg].load(std::memory_order_relaxed);
+
+      if (segment != nullptr) {
+        allocator<T>().deallocate(segment, segment_size(seg));
+      }
+    }
+  }
+
+  size_type size() const {
+    return count_.load(std::memory_order_acquire);
+  }
+
+  size_type capacity() const {
+    return capacity_;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  const T& operator[](size_type pos) const {
+    auto [seg, offset] = locate(pos);
+
+    return segments_[seg].load(std::memory_order_acquire)[offset];
+  }
+
+  const T& at(size_type pos) const {
+    DCPL_CHECK_LT(pos, size());
+
+    return (*this)[pos];
+  }
+
+  const T& front() const {
+    DCPL_ASSERT(!empty());
+
+    return (*this)[0];
+  }
+
+  const T& back() const {
+    size_type count = size();
+
+    DCPL_ASSERT(count != 0);
+
+    return (*this)[count - 1];
+  }
+
+  const_iterator begin() const {
+    return { this, 0 };
+  }
+
+  const_iterator end() const {
+    return { this, size() };
+  }
+
+  // Calls fn(span) for each of the contiguous chunks storing the [0, size())
+  // elements range, which is much faster than per element indexing.
+  template <typename F>
+  void for_each_segment(const F& fn) const {
+    size_type count = size();
+
+    for (size_type seg = 0, base = 0; base < count; ++seg) {
+      size_type seg_count = std::min(segment_size(seg), count - base);
+
+      fn(std::span<const T>(segments_[seg].load(std::memory_order_acquire),
+                            seg_count));
+      base += seg_count;
+    }
+  }
+
+ private:
+  segmented_vector() = default;
+
+  static constexpr size_type segment_size(size_type seg) {
+    return base_size << seg;
+  }
+
+  static std::pair<size_type, size_type> locate(size_type pos) {
+    size_type bpos = pos + base_size;
+    size_type seg = static_cast<size_type>(std::bit_width(bpos)) - 1 - base_shift;
+
+    return { seg, bpos - (base_size << seg) };
+  }
+
+  void reserve(size_type capacity) {
+    while (capacity_ < capacity) {
+      size_type seg = locate(capacity_).first;
+      size_type seg_size = segment_size(seg);
+
+      segments_[seg].store(allocator<T>().allocate(seg_size), std::memory_order_release);
+      capacity_ += seg_size;
+    }
+  }
+
+  template <typename... ARGS>
+  void emplace_back(ARGS&&... args) {
+    size_type count = count_.load(std::memory_order_relaxed);
+
+    reserve(count + 1);
+
+    auto [seg, offset] = locate(count);
+
+    new (segments_[seg].load(std::memory_order_relaxed) + offset)
+        T(std::forward<ARGS>(args)...);
+    count_.store(count + 1, std::memory_order_release);
+  }
+
+  std::array<std::atomic<T*>, max_segments> segments_{};
+  std::atomic<size_type> count_ = 0;
+  size_type capacity_ = 0;
+};
+
+}
+
+// An append only vector whose storage is a directory of geometrically growing
+// segments. Differently from rcu::vector, growing never moves (or copies) the
+// existing elements, as new segments are simply published in the directory, and
+// readers can index it in O(1) without holding any reference other than the
+// rcu::context.
+// The same single writer model of the other RCU containers applies, and readers
+// should grab an rcu::context in scope, and then use the vector_type reference
+// returned by the get() API (or the accessors of this class).
+// The clear() API is the only one which creates a new version of the container,
+// with the old one (and its elements) being freed after the grace period.
+template <typename T>
+class segmented_vector {
+ public:
+  using vector_type = impl::segmented_vector<T>;
+
+  using value_type = vector_type::value_type;
+  using size_type = vector_type::size_type;
+  using difference_type = vector_type::difference_type;
+  using reference = vector_type::reference;
+  using const_reference = vector_type::const_reference;
+  using pointer = vector_type::pointer;
+  using const_pointer = vector_type::const_pointer;
+  using iterator = vector_type::iterator;
+  using const_iterator = vector_type::const_iterator;
+
+  segmented_vector() :
+      vect_(new vector_type()) {
+  }
+
+  const vector_type& get() const {
+    return *vect_;
+  }
+
+  size_type size() const {
+    return vect_->size();
+  }
+
+  size_type capacity() const {
+    return vect_->capacity();
+  }
+
+  bool empty() const {
+    return vect_->empty();
+  }
+
+  const T& operator[](size_type pos) const {
+    return vect_->operator[](pos);
+  }
+
+  const T& at(size_type pos) const {
+    return vect_->at(pos);
+  }
+
+  const T& front() const {
+    return vect_->front();
+  }
+
+  const T& back() const {
+    return vect_->back();
+  }
+
+  // See rcu::vector about the safety of using begin()/end() outside the writer.
+  const_iterator begin() const {
+    return vect_->begin();
+  }
+
+  const_iterator end() const {
+    return vect_->end();
+  }
+
+  void reserve(size_type capacity) {
+    vect_->reserve(capacity);
+  }
+
+  void clear() {
+    unique_ptr<vector_type> new_vect(new vector_type());
+
+    vect_.swap(new_vect);
+  }
+
+  void push_back(const T& value) {
+    vect_->emplace_back(value);
+  }
+
+  void push_back(T&& value) {
+    vect_->emplace_back(std::move(value));
+  }
+
+  template <typename... ARGS>
+  void emplace_back(ARGS&&... args) {
+    vect_->emplace_back(std::forward<ARGS>(args)...);
+  }
+
+ private:
+  unique_ptr<vector_type> vect_;
+};
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dcpl/assert.h"
+#include "dcpl/rcu/rcu.h"
+#include "dcpl/rcu/unordered_map.h"
+
+namespace dcpl::rcu {
+
+// A multi writer variant of rcu::unordered_map, where the key space is partitioned
+// among a number of shards, each one being an independently versioned (and resized)
+// rcu::unordered_map with its own writer lock. Writers touching different shards
+// proceed in parallel, while readers remain lock-free, and should grab an
+// rcu::context in scope before using the read APIs (whose results are valid only
+// while the context is held).
+template <typename Key, typename T,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class sharded_unordered_map {
+ public:
+  using shard_map = unordered_map<Key, T, Hash, KeyEqual>;
+  using map_type = shard_map::map_type;
+
+  using key_type = shard_map::key_type;
+  using mapped_type = shard_map::mapped_type;
+  using hasher = shard_map::hasher;
+  using key_equal = shard_map::key_equal;
+  using value_type = shard_map::value_type;
+  using size_type = shard_map::size_type;
+
+  explicit sharded_unordered_map(size_type num_shards = 0) :
+      shards_(num_shards != 0 ? num_shards : default_shards()) {
+  }
+
+  size_type num_shards() const {
+    return shards_.size();
+  }
+
+  const map_type& get(size_type shard) const {
+    return shards_[shard].umap.get();
+  }
+
+  size_type size() const {
+    size_type count = 0;
+
+    for (const auto& shard : shards_) {
+      count += shard.umap.size();
+    }
+
+    return count;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  void clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard guard(shard.mtx);
+
+      shard.umap.clear();
+    }
+  }
+
+  // Unlike rcu::unordered_map, the insert APIs do not return an iterator, as it
+  // could be invalidated by a concurrent writer as soon as the shard lock is
+  // released.
+  template <typename U>
+  bool insert(U&& value) {
+    shard& cshard = get_shard(value.first);
+    std::lock_guard guard(cshard.mtx);
+
+    return cshard.umap.insert(std::forward<U>(value)).second;
+  }
+
+  template <typename... ARGS>
+  bool emplace(ARGS&&... args) {
+    return insert(value_type(std::forward<ARGS>(args)...));
+  }
+
+  size_type erase(const key_type& key) {
+    shard& cshard = get_shard(key);
+    std::lock_guard guard(cshard.mtx);
+
+    if (cshard.umap.count(key) == 0) {
+      return 0;
+    }
+    cshard.umap.erase(key);
+
+    return 1;
+  }
+
+  // Returns a pointer to the value mapped to `key`, or nullptr if missing.
+  const mapped_type* lookup(const key_type& key) const {
+    const map_type& umap = get_shard(key).umap.get();
+    auto it = umap.find(key);
+
+    return it != umap.end() ? &it->second : nullptr;
+  }
+
+  bool contains(const key_type& key) const {
+    return count(key) != 0;
+  }
+
+  size_type count(const key_type& key) const {
+    return get_shard(key).umap.get().count(key);
+  }
+
+  const mapped_type& at(const key_type& key) const {
+    return get_shard(key).umap.get().at(key);
+  }
+
+  // Calls fn(value) for all the values of the map, one shard at a time.
+  template <typename F>
+  void for_each(const F& fn) const {
+    for (const auto& cshard : shards_) {
+      for (const auto& value : cshard.umap.get()) {
+        fn(value);
+      }
+    }
+  }
+
+ private:
+  // Shards are cache line aligned to avoid false sharing among writers.
+  struct alignas(64) shard {
+    std::mutex mtx;
+    shard_map umap;
+  };
+
+  static size_type default_shards() {
+    return std::max<size_type>(std::thread::hardware_concurrency(), 1);
+  }
+
+  size_type shard_index(const key_type& key) const {
+    // The shard maps use the hash modulo their (prime) size to select the slot, so
+    // here we mix the hash bits to avoid correlation between the two choices.
+    std::uint64_t hash = static_cast<std::uint64_t>(hasher_(key));
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return static_cast<size_type>(hash % shards_.size());
+  }
+
+  shard& get_shard(const key_type& key) {
+    return shards_[shard_index(key)];
+  }
+
+  const shard& get_shard(const key_type& key) const {
+    return shards_[shard_index(key)];
+  }
+
+  hasher hasher_;
+  std::vector<shard> shards_;
+};
+
+}
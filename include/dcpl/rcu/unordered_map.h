@@ -8,13 +8,16 @@
 #include <iterator>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "dcpl/assert.h"
+#include "dcpl/constants.h"
 #include "dcpl/core_utils.h"
 #include "dcpl/logging.h"
 #include "dcpl/rcu/allocator.h"
 #include "dcpl/rcu/pointers.h"
 #include "dcpl/rcu/rcu.h"
+#include "dcpl/threadpool.h"
 
 namespace dcpl::rcu {
 
@@ -150,7 +153,7 @@ class unordered_map {
     std::uintptr_t iptr = data_[index];
     value_type* kv = reinterpret_cast<value_type*>(iptr);
 
-    return { this, kv, index };
+    return { const_cast<unordered_map*>(this), kv, index };
   }
 
   size_type count(const key_type& key) const {
@@ -172,6 +175,47 @@ class unordered_map {
     return kv->second;
   }
 
+  // Splits the slots array in ranges which are scanned by the threadpool workers,
+  // calling fn(value) for every value within the map. The fn() function must be
+  // thread safe, and the caller must hold an rcu::context (or rcu::pin) for the
+  // whole duration of the call, which is what keeps this version alive for the
+  // workers.
+  template <typename F>
+  void parallel_for_each(const F& fn, std::size_t num_threads = consts::all) const {
+    static constexpr size_type min_chunk = 4096;
+    using range = std::pair<size_type, size_type>;
+
+    // Like dcpl::map(), consts::all runs on the shared pool, sized by the default
+    // number of threads.
+    size_type nthreads =
+        effective_num_threads(num_threads == consts::all ? 0 : num_threads,
+                              std::max<size_type>(size_ / min_chunk, 1));
+    size_type max_chunks = nthreads > 1 ? 4 * nthreads : 1;
+    size_type chunk_size = std::max(min_chunk, (size_ + max_chunks - 1) / max_chunks);
+    std::function<bool (const range&)> scan_fn = [&](const range& rng) {
+      for (size_type i = rng.first; i < rng.second; ++i) {
+        std::uintptr_t iptr = data_[i];
+
+        if (iptr != empty_slot && iptr != skip_slot) {
+          fn(*reinterpret_cast<const value_type*>(iptr));
+        }
+      }
+
+      return true;
+    };
+    std::vector<range> ranges;
+
+    for (size_type base = 0; base < size_; base += chunk_size) {
+      ranges.emplace_back(base, std::min(base + chunk_size, size_));
+    }
+
+    if (ranges.size() == 1) {
+      scan_fn(ranges.front());
+    } else {
+      dcpl::map(scan_fn, ranges.begin(), ranges.end(), num_threads);
+    }
+  }
+
  private:
   static constexpr std::uintptr_t empty_slot = 0;
   static constexpr std::uintptr_t skip_slot = -1;
@@ -292,6 +336,7 @@ class unordered_map {
       new (kv) value_type(std::forward<U>(value));
     } catch (...) {
       allocator<value_type>().deallocate(kv, 1);
+      throw;
     }
 
     replace_slot(index, kv);
@@ -385,7 +430,7 @@ class unordered_map {
     if (ipptr != skip_slot && ipptr != empty_slot) {
       value_type* pkv = reinterpret_cast<value_type*>(ipptr);
 
-      free_object(pkv);
+      free_node(pkv);
     }
   }
 
@@ -395,7 +440,7 @@ class unordered_map {
     if (ipptr != skip_slot && ipptr != empty_slot) {
       value_type* pkv = reinterpret_cast<value_type*>(ipptr);
 
-      free_object(pkv);
+      free_node(pkv);
 
       data_[index] = skip_slot;
       count_ -= 1;
@@ -413,7 +458,7 @@ class unordered_map {
       if (iptr != skip_slot && iptr != empty_slot) {
         value_type* kv = reinterpret_cast<value_type*>(iptr);
 
-        free_object(kv);
+        free_node(kv);
       }
     }
     allocator<atomic_ptr>().deallocate(data_, size_);
@@ -463,6 +508,35 @@ class unordered_map {
   using iterator = map_type::iterator;
   using const_iterator = map_type::const_iterator;
 
+  // Pins the version of the map current at creation time, which (together with all
+  // the values reachable from it) remains valid for the whole life of the snapshot,
+  // without blocking writers. Unlike an rcu::context, a snapshot is not bound to a
+  // thread. Note that updates which do not trigger a new version (all except resizes
+  // and clear()) are done in place, so, exactly like scans within an rcu::context,
+  // scans may or may not observe concurrent updates.
+  class snapshot_type {
+    friend class unordered_map;
+
+   public:
+    const map_type& get() const {
+      return *umap_;
+    }
+
+    template <typename F>
+    void parallel_for_each(const F& fn, size_type num_threads = consts::all) const {
+      umap_->parallel_for_each(fn, num_threads);
+    }
+
+   private:
+    snapshot_type(pin spin, const map_type* umap) :
+        pin_(std::move(spin)),
+        umap_(umap) {
+    }
+
+    pin pin_;
+    const map_type* umap_ = nullptr;
+  };
+
   unordered_map() :
       umap_(new map_type(init_size)) {
   }
@@ -547,6 +621,20 @@ class unordered_map {
     umap_.swap(other.umap_);
   }
 
+  snapshot_type snapshot() const {
+    // The pin must be taken before loading the current version pointer.
+    pin spin;
+
+    return { std::move(spin), umap_.get() };
+  }
+
+  template <typename F>
+  void parallel_for_each(const F& fn, size_type num_threads = consts::all) const {
+    context ctx;
+
+    umap_->parallel_for_each(fn, num_threads);
+  }
+
  private:
   unique_ptr<map_type> umap_;
 };
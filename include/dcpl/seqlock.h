@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace dcpl {
+
+// A sequence lock, where writers bump the sequence number to an odd value while
+// modifying the protected data, and back to an even one when done, and readers
+// optimistically copy the data and retry if the sequence changed in the meantime.
+// Readers never write shared memory, so they do not bounce cache lines among them.
+// Writers exclude each other spinning on the sequence number, hence critical
+// sections must be very short.
+class seqlock {
+ public:
+  using seq_t = std::uint64_t;
+
+  seq_t read_begin() const {
+    for (;;) {
+      seq_t seq = seq_.load(std::memory_order_acquire);
+
+      if ((seq & 1) == 0) [[likely]] {
+        return seq;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  bool read_retry(seq_t seq) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return seq_.load(std::memory_order_relaxed) != seq;
+  }
+
+  void write_lock() {
+    for (;;) {
+      seq_t seq = seq_.load(std::memory_order_relaxed);
+
+      if ((seq & 1) == 0 &&
+          seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire)) {
+        break;
+      }
+      std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void write_unlock() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Returns the result of fn(), retrying until a consistent read is achieved. The
+  // fn() function must only copy data, as it can observe torn values.
+  template <typename F>
+  auto read(const F& fn) const {
+    for (;;) {
+      seq_t seq = read_begin();
+      auto result = fn();
+
+      if (!read_retry(seq)) [[likely]] {
+        return result;
+      }
+    }
+  }
+
+  template <typename F>
+  void write(const F& fn) {
+    write_lock();
+    try {
+      fn();
+    } catch (...) {
+      write_unlock();
+      throw;
+    }
+    write_unlock();
+  }
+
+  // Copies a trivially copyable object which might be concurrently written.
+  template <typename T>
+  static T load(const T* src) {
+    static_assert(std::is_trivially_copyable_v<T>, "Type must be trivially copyable");
+
+    T value;
+
+    std::memcpy(&value, src, sizeof(T));
+
+    return value;
+  }
+
+ private:
+  std::atomic<seq_t> seq_ = 0;
+};
+
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+
+#include "dcpl/assert.h"
+#include "dcpl/seqlock.h"
+
+namespace dcpl {
+
+// A fixed capacity, open addressed hash table for trivially copyable keys and
+// values, which are stored inline (no pointer chasing, no per entry allocations).
+// Slots are clustered in cache line aligned groups of group_size entries, each one
+// protected by its own seqlock. Lookups are lock-free, optimistically copying the
+// group contents and retrying if a writer changed its version in the meantime.
+// Updates of existing keys only take the write side of the target group seqlock, so
+// writers touching different groups proceed in parallel, while inserts of new keys
+// and erases are serialized by a mutex.
+// Every group counts the entries which overflowed it (while it was full) on their way
+// to the group they have been stored into, so erased slots are simply emptied (no
+// tombstones), and a lookup stops at the first group with no overflowing entries,
+// however many inserts and erases the table has gone through.
+// Since values are returned by copy, there is no need of any reclamation scheme,
+// but the table cannot grow, and inserting into a full table throws.
+template <typename Key, typename T,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class seqlock_map {
+  static_assert(std::is_trivially_copyable_v<Key>, "Key must be trivially copyable");
+  static_assert(std::is_trivially_copyable_v<T>, "Value must be trivially copyable");
+
+ public:
+  using key_type = Key;
+  using mapped_type = T;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using size_type = std::size_t;
+
+  static constexpr size_type group_size = 8;
+
+  explicit seqlock_map(size_type capacity) :
+      num_groups_(std::bit_ceil(std::max<size_type>(
+          (capacity + capacity / 4 + group_size - 1) / group_size, 1))),
+      groups_(std::make_unique<group[]>(num_groups_)) {
+  }
+
+  size_type size() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  size_type capacity() const {
+    return num_groups_ * group_size;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  std::optional<T> find(const Key& key) const {
+    T value;
+    size_type pos;
+
+    if (!lookup(key, &value, &pos)) {
+      return std::nullopt;
+    }
+
+    return value;
+  }
+
+  bool contains(const Key& key) const {
+    size_type pos;
+
+    return lookup(key, nullptr, &pos);
+  }
+
+  // Inserts the (key, value) entry, or overwrites the existing value. Returns true
+  // if a new entry has been inserted.
+  bool insert_or_assign(const Key& key, const T& value) {
+    return update(key, [&](T& cvalue) { cvalue = value; });
+  }
+
+  // Calls fn(value) with the write lock of the key group held, where the value is
+  // value initialized if the key is not present in the table. Returns true if a
+  // new entry has been inserted. The fn() function should be very short, as it
+  // stalls both readers and writers of the same group.
+  template <typename F>
+  bool update(const Key& key, const F& fn) {
+    size_type pos;
+
+    // Fast path, updating an existing key without taking the insert lock.
+    if (lookup(key, nullptr, &pos) && modify(pos, key, fn)) [[likely]] {
+      return false;
+    }
+
+    std::lock_guard guard(mtx_);
+
+    // Erases need the insert lock, so if the key is found here, it cannot vanish
+    // before we take the group write lock.
+    if (lookup(key, nullptr, &pos)) {
+      DCPL_ASSERT(modify(pos, key, fn));
+
+      return false;
+    }
+
+    // Slot states only change with the insert lock held, so they can be read
+    // without the group seqlock.
+    size_type hash = hash_key(key);
+
+    for (size_type n = 0; n < num_groups_; ++n) {
+      group& grp = groups_[(hash + n) & (num_groups_ - 1)];
+
+      for (size_type i = 0; i < group_size; ++i) {
+        if (grp.states[i] == state_empty) {
+          // The groups being overflowed are marked before the entry shows up, so
+          // that lookups can never stop short of it.
+          update_overflows(hash, n, /*add=*/ true);
+          grp.lock.write([&]() {
+            grp.slots[i].key = key;
+            grp.slots[i].value = T{};
+            fn(grp.slots[i].value);
+            grp.states[i] = state_full;
+          });
+          count_.fetch_add(1, std::memory_order_relaxed);
+
+          return true;
+        }
+      }
+    }
+
+    DCPL_THROW() << "Table is full: capacity=" << capacity();
+  }
+
+  bool erase(const Key& key) {
+    std::lock_guard guard(mtx_);
+    size_type pos;
+
+    if (!lookup(key, nullptr, &pos)) {
+      return false;
+    }
+
+    size_type hash = hash_key(key);
+    size_type gidx = pos / group_size;
+    group& grp = groups_[gidx];
+
+    grp.lock.write([&]() { grp.states[pos % group_size] = state_empty; });
+    update_overflows(hash, (gidx - hash) & (num_groups_ - 1), /*add=*/ false);
+    count_.fetch_sub(1, std::memory_order_relaxed);
+
+    return true;
+  }
+
+  void clear() {
+    std::lock_guard guard(mtx_);
+
+    for (size_type g = 0; g < num_groups_; ++g) {
+      group& grp = groups_[g];
+
+      grp.lock.write([&]() {
+        grp.states.fill(state_empty);
+        grp.overflows = 0;
+      });
+    }
+    count_.store(0, std::memory_order_relaxed);
+  }
+
+  // Calls fn(key, value) for all the entries of the table. Each group is read
+  // consistently, but the table as a whole is not a point in time snapshot.
+  template <typename F>
+  void for_each(const F& fn) const {
+    for (size_type g = 0; g < num_groups_; ++g) {
+      const group& grp = groups_[g];
+      std::array<std::uint8_t, group_size> states;
+      std::array<slot, group_size> slots;
+
+      for (;;) {
+        seqlock::seq_t seq = grp.lock.read_begin();
+
+        states = seqlock::load(&grp.states);
+        slots = seqlock::load(&grp.slots);
+        if (!grp.lock.read_retry(seq)) [[likely]] {
+          break;
+        }
+      }
+
+      for (size_type i = 0; i < group_size; ++i) {
+        if (states[i] == state_full) {
+          fn(slots[i].key, slots[i].value);
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr std::uint8_t state_empty = 0;
+  static constexpr std::uint8_t state_full = 1;
+
+  struct slot {
+    Key key;
+    T value;
+  };
+
+  struct alignas(64) group {
+    seqlock lock;
+    // The number of entries stored past this group, within their probe sequence.
+    size_type overflows = 0;
+    std::array<std::uint8_t, group_size> states{};
+    std::array<slot, group_size> slots{};
+  };
+
+  enum class scan_result {
+    found,
+    missing,
+    next_group,
+  };
+
+  size_type hash_key(const Key& key) const {
+    // Hash functions like std::hash<int> are the identity, so mix the bits before
+    // masking with the (power of two) number of groups.
+    std::uint64_t hash = static_cast<std::uint64_t>(hasher_(key));
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return static_cast<size_type>(hash);
+  }
+
+  scan_result scan_group(const group& grp, const Key& key, T* value,
+                         size_type* index) const {
+    for (size_type i = 0; i < group_size; ++i) {
+      std::uint8_t state = seqlock::load(&grp.states[i]);
+
+      if (state == state_full) {
+        Key ckey = seqlock::load(&grp.slots[i].key);
+
+        if (equal_(ckey, key)) {
+          if (value != nullptr) {
+            *value = seqlock::load(&grp.slots[i].value);
+          }
+          *index = i;
+
+          return scan_result::found;
+        }
+      }
+    }
+
+    return seqlock::load(&grp.overflows) == 0 ? scan_result::missing :
+        scan_result::next_group;
+  }
+
+  // Increments (or decrements) the overflow counts of the first count groups of the
+  // probe sequence starting at hash. Must be called with the insert lock held.
+  void update_overflows(size_type hash, size_type count, bool add) {
+    for (size_type n = 0; n < count; ++n) {
+      group& grp = groups_[(hash + n) & (num_groups_ - 1)];
+
+      grp.lock.write([&]() {
+        if (add) {
+          grp.overflows += 1;
+        } else {
+          grp.overflows -= 1;
+        }
+      });
+    }
+  }
+
+  bool lookup(const Key& key, T* value, size_type* pos) const {
+    size_type hash = hash_key(key);
+
+    for (size_type n = 0; n < num_groups_; ++n) {
+      size_type gidx = (hash + n) & (num_groups_ - 1);
+      const group& grp = groups_[gidx];
+      scan_result result;
+      size_type index = 0;
+
+      for (;;) {
+        seqlock::seq_t seq = grp.lock.read_begin();
+
+        result = scan_group(grp, key, value, &index);
+        if (!grp.lock.read_retry(seq)) [[likely]] {
+          break;
+        }
+      }
+
+      if (result == scan_result::found) {
+        *pos = gidx * group_size + index;
+
+        return true;
+      }
+      if (result == scan_result::missing) {
+        break;
+      }
+    }
+
+    return false;
+  }
+
+  // Applies fn() to the value at `pos`, if that slot still holds `key`.
+  template <typename F>
+  bool modify(size_type pos, const Key& key, const F& fn) {
+    group& grp = groups_[pos / group_size];
+    size_type index = pos % group_size;
+    bool modified = false;
+
+    grp.lock.write([&]() {
+      if (grp.states[index] == state_full && equal_(grp.slots[index].key, key)) {
+        fn(grp.slots[index].value);
+        modified = true;
+      }
+    });
+
+    return modified;
+  }
+
+  hasher hasher_;
+  key_equal equal_;
+  size_type num_groups_ = 0;
+  std::unique_ptr<group[]> groups_;
+  std::atomic<size_type> count_ = 0;
+  std::mutex mtx_;
+};
+
+}
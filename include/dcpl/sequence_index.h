@@ -14,6 +14,7 @@
 #include "dcpl/core_utils.h"
 #include "dcpl/logging.h"
 #include "dcpl/multi_merge_sort.h"
+#include "dcpl/rank_bitset.h"
 #include "dcpl/sequence.h"
 #include "dcpl/suffix_array.h"
 #include "dcpl/type_traits.h"
@@ -51,9 +52,26 @@ class sequence_index {
     auto operator<=>(const fuzzy_match&) const = default;
   };
 
-  explicit sequence_index(T data, S suffix_array) :
+  // When data is the concatenation of many documents, doc_starts lists the position
+  // of the first symbol of each one (see generalized_suffix_array), and fuzzy
+  // matches never span more than one document.
+  explicit sequence_index(T data, S suffix_array,
+                          std::vector<std::size_t> doc_starts = {}) :
       data_(std::move(data)),
-      suffix_array_(std::move(suffix_array)) {
+      suffix_array_(std::move(suffix_array)),
+      doc_starts_(std::move(doc_starts)) {
+    if (!doc_starts_.empty()) {
+      DCPL_ASSERT(doc_starts_.front() == 0) << "Document starts must begin with zero";
+
+      doc_bits_ = rank_bitset(data_.size() + 1);
+      for (std::size_t i = 0; i < doc_starts_.size(); ++i) {
+        DCPL_ASSERT(i == 0 || doc_starts_[i] > doc_starts_[i - 1])
+            << "Document starts must be strictly increasing";
+        DCPL_CHECK_LT(doc_starts_[i], data_.size()) << "Document start out of range";
+        doc_bits_.set(doc_starts_[i]);
+      }
+      doc_bits_.build();
+    }
   }
 
   template <typename V>
@@ -220,9 +238,15 @@ class sequence_index {
                                            std::size_t min_span,
                                            const fuzzy_params& params) {
     std::map<std::size_t, std::size_t> sqmatches;
+    std::size_t doc = select_document(qmatches, begin, end);
 
     for (std::size_t i = begin; i < end; ++i) {
       const qmatch& qm = qmatches[i];
+
+      if (!anchor_docs_.empty() && anchor_docs_[i - begin] != doc) {
+        continue;
+      }
+
       auto it = sqmatches.emplace(qm.query_pos, qm.data_pos);
 
       if (!it.second) {
@@ -242,12 +266,14 @@ class sequence_index {
     std::size_t data_begin = bit->second;
     std::size_t data_end = eit->second + 1;
 
-    while (query_begin > 0 && data_begin > 0 &&
+    auto [doc_begin, doc_end] = document_range(doc);
+
+    while (query_begin > 0 && data_begin > doc_begin &&
            query[query_begin - 1] == data_[data_begin - 1]) {
       --query_begin;
       --data_begin;
     }
-    while (query.size() > query_end && data_.size() > data_end &&
+    while (query.size() > query_end && doc_end > data_end &&
            query[query_end] == data_[data_end]) {
       ++query_end;
       ++data_end;
@@ -263,8 +289,57 @@ class sequence_index {
     return fuzzy_match{ query_begin, query_end, data_begin, data_end, distance };
   }
 
+  std::size_t document(std::size_t pos) const {
+    return doc_bits_.rank1(pos + 1) - 1;
+  }
+
+  std::pair<std::size_t, std::size_t> document_range(std::size_t doc) const {
+    if (doc_starts_.empty()) {
+      return { 0, data_.size() };
+    }
+
+    return { doc_starts_[doc],
+             doc + 1 < doc_starts_.size() ? doc_starts_[doc + 1] : data_.size() };
+  }
+
+  // Returns the document with the most anchors among the [begin, end) ones (the
+  // lowest one, on ties), and stores the document of every anchor within
+  // anchor_docs_. Without documents, anchor_docs_ is left empty.
+  template <typename Q>
+  std::size_t select_document(const Q& qmatches, std::size_t begin, std::size_t end) {
+    anchor_docs_.clear();
+    if (doc_starts_.empty()) {
+      return 0;
+    }
+
+    for (std::size_t i = begin; i < end; ++i) {
+      anchor_docs_.push_back(document(qmatches[i].data_pos));
+    }
+
+    sorted_docs_.assign(anchor_docs_.begin(), anchor_docs_.end());
+    std::sort(sorted_docs_.begin(), sorted_docs_.end());
+
+    std::size_t doc = 0;
+    std::size_t max_count = 0;
+
+    for (std::size_t i = 0, count = 0; i < sorted_docs_.size(); ++i) {
+      count = (i > 0 && sorted_docs_[i] == sorted_docs_[i - 1]) ? count + 1 : 1;
+      if (count > max_count) {
+        max_count = count;
+        doc = sorted_docs_[i];
+      }
+    }
+
+    return doc;
+  }
+
   T data_;
   S suffix_array_;
+  std::vector<std::size_t> doc_starts_;
+  rank_bitset doc_bits_;
+  // Scratch buffers of select_document(), reused across matches.
+  std::vector<std::size_t> anchor_docs_;
+  std::vector<std::size_t> sorted_docs_;
   std::unordered_map<value_type, std::vector<std::size_t>> cache_;
 };
 
@@ -1,19 +1,33 @@
 #pragma once
 
 #include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <functional>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <span>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <unordered_set>
 #include <vector>
 
+#include "dcpl/assert.h"
+#include "dcpl/constants.h"
 #include "dcpl/core_utils.h"
+#include "dcpl/file.h"
 #include "dcpl/hash.h"
 #include "dcpl/logging.h"
+#include "dcpl/multi_merge_sort.h"
+#include "dcpl/temp_file.h"
+#include "dcpl/threadpool.h"
 
 namespace dcpl::suffix_array {
 
@@ -94,6 +108,776 @@ std::vector<T> compute(const C& data) {
   return p;
 }
 
+namespace detail {
+
+// The symbol accessors of the SA-IS recursion levels. The input data is seen with
+// a virtual sentinel appended, which is smaller than any other symbol.
+template <typename C>
+struct sentinel_symbols {
+  std::size_t operator()(std::size_t i) const {
+    return i < data->size() ? static_cast<std::size_t>((*data)[i]) + 1 : 0;
+  }
+
+  const C* data;
+};
+
+template <typename T>
+struct array_symbols {
+  std::size_t operator()(std::size_t i) const {
+    return static_cast<std::size_t>(data[i]);
+  }
+
+  const T* data;
+};
+
+template <typename T, typename F>
+void sais_buckets(const F& chr, std::size_t n, bool end, std::vector<T>* bkt) {
+  std::fill(bkt->begin(), bkt->end(), 0);
+  for (std::size_t i = 0; i < n; ++i) {
+    ++(*bkt)[chr(i)];
+  }
+
+  T sum = 0;
+
+  for (auto& count : *bkt) {
+    sum += count;
+    count = end ? sum : sum - count;
+  }
+}
+
+template <typename T, typename F>
+void sais_induce(const F& chr, const std::vector<bool>& stype, T* sa, std::size_t n,
+                 std::vector<T>* bkt) {
+  static constexpr T empty = std::numeric_limits<T>::max();
+
+  sais_buckets(chr, n, /*end=*/ false, bkt);
+  for (std::size_t i = 0; i < n; ++i) {
+    T j = sa[i];
+
+    if (j != empty && j > 0 && !stype[j - 1]) {
+      sa[(*bkt)[chr(j - 1)]++] = j - 1;
+    }
+  }
+
+  sais_buckets(chr, n, /*end=*/ true, bkt);
+  for (std::size_t i = n; i > 0; --i) {
+    T j = sa[i - 1];
+
+    if (j != empty && j > 0 && stype[j - 1]) {
+      sa[--(*bkt)[chr(j - 1)]] = j - 1;
+    }
+  }
+}
+
+// The SA-IS algorithm (Nong, Zhang and Chan), where the input string of size n
+// (whose last symbol is a unique sentinel, smaller than all the others) has symbols
+// in the [0, k) range. The reduced problem of each recursion level is stored within
+// the suffix array itself, so that the memory used is the suffix array, plus one
+// bit per symbol and the bucket counters.
+template <typename T, typename F>
+void sais(const F& chr, T* sa, std::size_t n, std::size_t k) {
+  static constexpr T empty = std::numeric_limits<T>::max();
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+  std::vector<bool> stype(n);
+  auto is_lms = [&](std::size_t i) {
+    return i > 0 && stype[i] && !stype[i - 1];
+  };
+
+  stype[n - 1] = true;
+  for (std::size_t i = n - 1; i > 0; --i) {
+    std::size_t c0 = chr(i - 1);
+    std::size_t c1 = chr(i);
+
+    stype[i - 1] = c0 < c1 || (c0 == c1 && stype[i]);
+  }
+
+  // Stage 1: sort the LMS substrings, by inducing them from their buckets tails.
+  std::vector<T> bkt(k);
+
+  sais_buckets(chr, n, /*end=*/ true, &bkt);
+  std::fill(sa, sa + n, empty);
+  for (std::size_t i = 1; i < n; ++i) {
+    if (is_lms(i)) {
+      sa[--bkt[chr(i)]] = static_cast<T>(i);
+    }
+  }
+  sais_induce(chr, stype, sa, n, &bkt);
+
+  // Name the sorted LMS substrings, storing the reduced string (LMS substrings
+  // are at least two positions apart) at the end of the suffix array.
+  std::size_t n1 = 0;
+
+  for (std::size_t i = 0; i < n; ++i) {
+    if (is_lms(sa[i])) {
+      sa[n1++] = sa[i];
+    }
+  }
+  std::fill(sa + n1, sa + n, empty);
+
+  std::size_t name = 0;
+  std::size_t prev = npos;
+
+  for (std::size_t i = 0; i < n1; ++i) {
+    std::size_t pos = sa[i];
+    bool diff = false;
+
+    for (std::size_t d = 0; d < n; ++d) {
+      if (prev == npos || chr(pos + d) != chr(prev + d) ||
+          stype[pos + d] != stype[prev + d]) {
+        diff = true;
+        break;
+      }
+      if (d > 0 && (is_lms(pos + d) || is_lms(prev + d))) {
+        break;
+      }
+    }
+    if (diff) {
+      ++name;
+      prev = pos;
+    }
+    sa[n1 + pos / 2] = static_cast<T>(name - 1);
+  }
+  for (std::size_t i = n, j = n; i > n1; --i) {
+    if (sa[i - 1] != empty) {
+      sa[--j] = sa[i - 1];
+    }
+  }
+
+  // Stage 2: sort the suffixes of the reduced string, recursing only if the names
+  // are not unique already.
+  T* sa1 = sa;
+  T* s1 = sa + n - n1;
+
+  if (name < n1) {
+    sais(array_symbols<T>{ s1 }, sa1, n1, name);
+  } else {
+    for (std::size_t i = 0; i < n1; ++i) {
+      sa1[s1[i]] = static_cast<T>(i);
+    }
+  }
+
+  // Stage 3: induce the suffix array from the sorted LMS suffixes.
+  for (std::size_t i = 1, j = 0; i < n; ++i) {
+    if (is_lms(i)) {
+      s1[j++] = static_cast<T>(i);
+    }
+  }
+  for (std::size_t i = 0; i < n1; ++i) {
+    sa1[i] = s1[sa1[i]];
+  }
+  std::fill(sa + n1, sa + n, empty);
+
+  sais_buckets(chr, n, /*end=*/ true, &bkt);
+  for (std::size_t i = n1; i > 0; --i) {
+    T j = sa[i - 1];
+
+    sa[i - 1] = empty;
+    sa[--bkt[chr(j)]] = j;
+  }
+  sais_induce(chr, stype, sa, n, &bkt);
+}
+
+}
+
+// Computes the suffix array in linear time, with the SA-IS algorithm. Suffixes are
+// sorted lexicographically, with a suffix sorting before all the longer ones it is a
+// prefix of. The result is the same of compute() (which sorts cyclic shifts) when
+// the last symbol of data does not appear elsewhere (like with an end of data
+// terminator), as only then cyclic shifts and suffixes compare the same.
+template <typename T, typename C>
+std::vector<T> compute_sais(const C& data) {
+  using value_type = typename C::value_type;
+
+  static_assert(std::is_unsigned_v<value_type>,
+                "Input data must have an unsigned type");
+
+  if (data.empty()) {
+    return { };
+  }
+
+  // The sentinel takes one more suffix array slot, and the largest value of T is
+  // used as empty marker.
+  DCPL_CHECK_LT(data.size(), std::numeric_limits<T>::max() - 1)
+      << "Suffix array type too small for the input data";
+
+  const std::size_t n = data.size();
+  const std::size_t vocab_size =
+      static_cast<std::size_t>(*std::max_element(data.begin(), data.end())) + 1;
+  std::vector<T> sa(n + 1);
+
+  detail::sais(detail::sentinel_symbols<C>{ &data }, sa.data(), n + 1, vocab_size + 1);
+
+  // The sentinel suffix is the smallest one.
+  sa.erase(sa.begin());
+
+  return sa;
+}
+
+namespace detail {
+
+// Below this size, sorting and scanning ranges are not worth splitting among
+// threads.
+static constexpr std::size_t min_parallel_size = 4096;
+
+template <typename T>
+using group_list = std::vector<std::pair<T, T>>;
+
+// Runs fn(i) for all the i in [0, count) on the pool, waits for all of them, and
+// rethrows the first exception (if any).
+template <typename F>
+void parallel_run(threadpool* pool, std::size_t count, const F& fn) {
+  dcpl::detail::multi_result<bool> mresult(count);
+
+  for (std::size_t i = 0; i < count; ++i) {
+    pool->push_work([&fn, &mresult, i]() {
+      mresult.set(i, dcpl::detail::run<bool>([&]() {
+        fn(i);
+        return true;
+      }));
+    });
+  }
+  mresult.wait();
+  for (std::size_t i = 0; i < count; ++i) {
+    mresult.get(i);
+  }
+}
+
+// The pool running the work split among num_threads threads: the shared
+// threadpool::get() one for consts::all (like dcpl::map() does), or a new one sized
+// to the work otherwise, and none if the work is not worth splitting.
+class work_pool {
+ public:
+  work_pool(std::size_t num_threads, std::size_t parallelism) :
+      num_threads_(effective_num_threads(num_threads == consts::all ? 0 : num_threads,
+                                         parallelism)) {
+    if (num_threads_ > 1) {
+      if (num_threads == consts::all) {
+        pool_ = threadpool::get();
+      } else {
+        owned_pool_ = std::make_unique<threadpool>(num_threads_);
+        pool_ = owned_pool_.get();
+      }
+    }
+  }
+
+  std::size_t num_threads() const {
+    return num_threads_;
+  }
+
+  threadpool* get() const {
+    return pool_;
+  }
+
+ private:
+  std::size_t num_threads_ = 1;
+  std::unique_ptr<threadpool> owned_pool_;
+  threadpool* pool_ = nullptr;
+};
+
+template <typename I, typename C>
+void parallel_sort(threadpool* pool, std::size_t num_threads, I begin, I end,
+                   const C& comp) {
+  const std::size_t size = static_cast<std::size_t>(std::distance(begin, end));
+  const std::size_t parts = std::min(num_threads, size / min_parallel_size);
+
+  if (parts <= 1) {
+    std::sort(begin, end, comp);
+    return;
+  }
+
+  std::vector<std::size_t> bounds(parts + 1);
+
+  for (std::size_t i = 0; i <= parts; ++i) {
+    bounds[i] = size * i / parts;
+  }
+  parallel_run(pool, parts, [&](std::size_t i) {
+    std::sort(begin + bounds[i], begin + bounds[i + 1], comp);
+  });
+  for (std::size_t width = 1; width < parts; width *= 2) {
+    parallel_run(pool, (parts + 2 * width - 1) / (2 * width), [&](std::size_t i) {
+      std::size_t lo = 2 * width * i;
+      std::size_t mid = std::min(lo + width, parts);
+      std::size_t hi = std::min(lo + 2 * width, parts);
+
+      if (mid < hi) {
+        std::inplace_merge(begin + bounds[lo], begin + bounds[mid], begin + bounds[hi],
+                           comp);
+      }
+    });
+  }
+}
+
+// One prefix doubling round: sorts the members of every unsorted group by key(),
+// flags the heads of the resulting sub-groups, and then (once all the key() reads
+// are done) assigns each suffix the rank of its sub-group (its start position, plus
+// one, so that zero can stand for the end of data). Returns the sub-groups which
+// still have more than one member.
+template <typename T, typename K>
+group_list<T> refine_groups(threadpool* pool, std::size_t num_threads,
+                            const group_list<T>& groups, const K& key, T* sa,
+                            T* rank, std::uint8_t* heads) {
+  std::size_t total = 0;
+
+  for (const auto& group : groups) {
+    total += group.second - group.first;
+  }
+
+  // Groups taking more than a thread share are sorted with all the threads, while
+  // the other ones are packed into chunks of about the same number of members.
+  const std::size_t big_size = std::max(total / num_threads, min_parallel_size);
+  const std::size_t chunk_size = std::max(total / (4 * num_threads), min_parallel_size);
+  std::vector<std::pair<std::size_t, std::size_t>> chunks;
+  std::vector<std::size_t> big_groups;
+
+  for (std::size_t i = 0; i < groups.size();) {
+    std::size_t start = i;
+    std::size_t count = 0;
+
+    for (; i < groups.size() && count < chunk_size; ++i) {
+      std::size_t size = groups[i].second - groups[i].first;
+
+      if (size >= big_size) {
+        if (i == start) {
+          big_groups.push_back(i++);
+          ++start;
+        }
+        break;
+      }
+      count += size;
+    }
+    if (i > start) {
+      chunks.emplace_back(start, i);
+    }
+  }
+
+  auto key_less = [&](T i1, T i2) { return key(i1) < key(i2); };
+  auto set_heads = [&](std::size_t begin, std::size_t end, std::size_t group_begin) {
+    for (std::size_t j = begin; j < end; ++j) {
+      heads[j] = j == group_begin || key(sa[j]) != key(sa[j - 1]);
+    }
+  };
+
+  for (std::size_t g : big_groups) {
+    const auto& group = groups[g];
+    const std::size_t size = group.second - group.first;
+    const std::size_t parts = std::min(num_threads, size / min_parallel_size);
+
+    parallel_sort(pool, num_threads, sa + group.first, sa + group.second, key_less);
+    parallel_run(pool, parts, [&](std::size_t i) {
+      set_heads(group.first + size * i / parts, group.first + size * (i + 1) / parts,
+                group.first);
+    });
+  }
+  parallel_run(pool, chunks.size(), [&](std::size_t c) {
+    for (std::size_t g = chunks[c].first; g < chunks[c].second; ++g) {
+      std::sort(sa + groups[g].first, sa + groups[g].second, key_less);
+      set_heads(groups[g].first, groups[g].second, groups[g].first);
+    }
+  });
+
+  // Ranks are written only after all the sorts (which read them) completed.
+  for (std::size_t g : big_groups) {
+    chunks.emplace_back(g, g + 1);
+  }
+
+  std::vector<group_list<T>> chunk_groups(chunks.size());
+
+  parallel_run(pool, chunks.size(), [&](std::size_t c) {
+    for (std::size_t g = chunks[c].first; g < chunks[c].second; ++g) {
+      std::size_t start = groups[g].first;
+
+      for (std::size_t j = groups[g].first; j < groups[g].second; ++j) {
+        if (heads[j]) {
+          if (j - start > 1) {
+            chunk_groups[c].emplace_back(start, j);
+          }
+          start = j;
+        }
+        rank[sa[j]] = static_cast<T>(start + 1);
+      }
+      if (groups[g].second - start > 1) {
+        chunk_groups[c].emplace_back(start, groups[g].second);
+      }
+    }
+  });
+
+  group_list<T> next_groups;
+
+  for (auto& cgroups : chunk_groups) {
+    next_groups.insert(next_groups.end(), cgroups.begin(), cgroups.end());
+  }
+
+  return next_groups;
+}
+
+}
+
+// Computes the same suffix array of compute_sais(), using num_threads threads (or
+// the default number of threads of dcpl::threadpool, if zero). Suffixes are sorted
+// by prefix doubling (as in Larsson-Sadakane), where each round sorts only the groups
+// of suffixes still sharing the same prefix, and groups are spread among the threads
+// (with the largest ones sorted by all the threads together).
+template <typename T, typename C>
+std::vector<T> compute_parallel(const C& data, std::size_t num_threads = 0) {
+  using value_type = typename C::value_type;
+
+  static_assert(std::is_unsigned_v<value_type>,
+                "Input data must have an unsigned type");
+
+  const std::size_t n = data.size();
+  const std::size_t nthreads =
+      effective_num_threads(num_threads,
+                            std::max<std::size_t>(n / detail::min_parallel_size, 1));
+
+  if (nthreads <= 1) {
+    return compute_sais<T>(data);
+  }
+
+  DCPL_CHECK_LT(n, std::numeric_limits<T>::max())
+      << "Suffix array type too small for the input data";
+
+  threadpool pool(nthreads);
+  std::vector<T> sa(n);
+  std::vector<T> rank(n);
+  std::vector<std::uint8_t> heads(n);
+
+  for (std::size_t i = 0; i < n; ++i) {
+    sa[i] = static_cast<T>(i);
+  }
+
+  detail::group_list<T> groups{ { 0, static_cast<T>(n) } };
+
+  groups = detail::refine_groups(&pool, nthreads, groups,
+                                 [&](T i) { return data[i]; },
+                                 sa.data(), rank.data(), heads.data());
+  for (std::size_t h = 1; !groups.empty(); h *= 2) {
+    auto key = [&](T i) -> T {
+      return i + h < n ? rank[i + h] : 0;
+    };
+
+    groups = detail::refine_groups(&pool, nthreads, groups, key,
+                                   sa.data(), rank.data(), heads.data());
+  }
+
+  return sa;
+}
+
+namespace detail {
+
+// A suffix, together with its prefix doubling sort key, as stored in the runs of
+// compute_external().
+template <typename T>
+struct external_suffix {
+  std::uint64_t rank = 0;
+  T next_rank = 0;
+  T index = 0;
+
+  bool operator<(const external_suffix& other) const {
+    return rank != other.rank ? rank < other.rank : next_rank < other.next_rank;
+  }
+
+  bool same_key(const external_suffix& other) const {
+    return rank == other.rank && next_rank == other.next_rank;
+  }
+};
+
+// A suffix and its new rank, as stored in the runs which compute_external() sorts
+// back into text order.
+template <typename T>
+struct external_rank {
+  T index = 0;
+  T rank = 0;
+
+  bool operator<(const external_rank& other) const {
+    return index < other.index;
+  }
+};
+
+// Sorts the values and stores them into a new temporary file next to path.
+template <typename V>
+std::unique_ptr<temp_file> spill_run(const work_pool& pool, std::vector<V>* run,
+                                     const std::string& path) {
+  if (pool.get() != nullptr) {
+    parallel_sort(pool.get(), pool.num_threads(), run->begin(), run->end(),
+                  std::less<V>());
+  } else {
+    std::sort(run->begin(), run->end());
+  }
+
+  auto run_file = std::make_unique<temp_file>(std::ios::binary, path);
+
+  run_file->file().write(reinterpret_cast<const char*>(run->data()),
+                         run->size() * sizeof(V));
+  DCPL_ASSERT(run_file->file().good())
+      << "Failed to write suffix array run: " << run_file->path();
+  run_file->close();
+
+  return run_file;
+}
+
+// Merges the sorted runs, calling fn(value) for all their values in order.
+template <typename V, typename F>
+void merge_runs(const std::vector<std::unique_ptr<temp_file>>& run_files, const F& fn) {
+  using it_type = typename std::span<V>::iterator;
+
+  std::vector<file::mmap> run_views;
+  std::vector<sort::range<it_type>> ranges;
+
+  for (const auto& run_file : run_files) {
+    run_views.push_back(file::view(run_file->path(), file::mmap_read, 0, 0));
+
+    std::span<V> run_data = run_views.back().data<V>();
+
+    ranges.push_back({ run_data.begin(), run_data.end() });
+  }
+
+  sort::multi_merge(ranges, std::less<V>(), fn);
+}
+
+}
+
+// Computes the same suffix array of compute_sais() into the file at path (created,
+// or truncated), for inputs whose suffix array does not fit in memory, and returns a
+// writable mapping of it (as an array of T).
+// Suffixes are sorted by prefix doubling, where every round sorts the suffixes by the
+// ranks of their h long prefix and of the following one, and assigns them the ranks
+// of their 2h long prefix, until all the ranks are distinct (so at most log2 of the
+// longest repeat rounds). Every pass of a round is either a sort of fixed size
+// records, in runs sorted in memory (with num_threads threads, or the default
+// number of threads of dcpl::threadpool, if zero) and merged from temporary files
+// next to path, or a sequential scan:
+// - A scan of the ranks, in text order, builds the sort keys.
+// - The merge of the sorted keys writes the suffix array, and spills the suffixes
+//   with their new ranks into runs sorted by text position.
+// - The merge of those runs writes the ranks of the next round, in text order.
+// Besides the about mem_budget bytes of the runs, memory is only used by the I/O
+// buffers and the merge cursors (one per run), and the temporary files take about
+// n * (sizeof(detail::external_suffix<T>) + 2 * sizeof(T)) bytes of disk space.
+template <typename T, typename C>
+file::mmap compute_external(const C& data, const std::string& path,
+                            std::size_t mem_budget, std::size_t num_threads = 0) {
+  using value_type = typename C::value_type;
+  using suffix_type = detail::external_suffix<T>;
+  using rank_type = detail::external_rank<T>;
+
+  static_assert(std::is_unsigned_v<value_type>,
+                "Input data must have an unsigned type");
+
+  const std::size_t n = data.size();
+
+  DCPL_CHECK_LT(n, std::numeric_limits<T>::max())
+      << "Suffix array type too small for the input data";
+
+  auto map_output = [&]() {
+    file out_file(path, file::open_read | file::open_write);
+
+    return out_file.view(file::mmap_read | file::mmap_write, 0, n * sizeof(T));
+  };
+
+  // Half of the budget is left to the buffer of the merges of the parallel sort.
+  const std::size_t run_size =
+      std::max<std::size_t>(mem_budget / (2 * sizeof(suffix_type)), 1);
+  const std::size_t rank_run_size =
+      std::max<std::size_t>(mem_budget / (2 * sizeof(rank_type)), 1);
+
+  if (n <= run_size) {
+    std::vector<T> sa = compute_parallel<T>(data, num_threads);
+    std::ofstream out_stream(path, std::ios::binary | std::ios::trunc);
+
+    out_stream.write(reinterpret_cast<const char*>(sa.data()), n * sizeof(T));
+    DCPL_ASSERT(out_stream.good()) << "Failed to write suffix array: " << path;
+    out_stream.close();
+
+    return map_output();
+  }
+
+  detail::work_pool pool(num_threads,
+                         std::max<std::size_t>(run_size / detail::min_parallel_size, 1));
+  // The ranks of the suffixes, in text order. Ranks are the position of the first
+  // suffix with the same prefix, plus one, so that zero can stand for the end of
+  // data (like compute_parallel() does).
+  std::unique_ptr<temp_file> rank_file;
+
+  for (std::size_t h = 0;; h = std::max<std::size_t>(2 * h, 1)) {
+    std::vector<std::unique_ptr<temp_file>> run_files;
+
+    {
+      // The first round sorts by the first symbol only, the following ones read
+      // the ranks at i and i + h with two sequential cursors.
+      std::optional<file::mmap> rank_view;
+      std::span<T> ranks;
+      std::vector<suffix_type> run;
+
+      if (rank_file != nullptr) {
+        rank_view.emplace(file::view(rank_file->path(), file::mmap_read, 0, 0));
+        ranks = rank_view->data<T>();
+      }
+
+      run.reserve(run_size);
+      for (std::size_t i = 0; i < n; ++i) {
+        if (rank_file == nullptr) {
+          run.push_back({ static_cast<std::uint64_t>(data[i]), 0, static_cast<T>(i) });
+        } else {
+          run.push_back({ ranks[i], i + h < n ? ranks[i + h] : static_cast<T>(0),
+                          static_cast<T>(i) });
+        }
+        if (run.size() == run_size || i + 1 == n) {
+          run_files.push_back(detail::spill_run(pool, &run, path));
+          run.clear();
+        }
+      }
+    }
+    rank_file.reset();
+
+    std::ofstream out_stream(path, std::ios::binary | std::ios::trunc);
+    std::vector<std::unique_ptr<temp_file>> rank_run_files;
+    std::vector<rank_type> rank_run;
+    std::size_t pos = 0;
+    std::size_t head = 0;
+    std::size_t num_groups = 0;
+    suffix_type last;
+
+    rank_run.reserve(rank_run_size);
+    detail::merge_runs<suffix_type>(run_files, [&](const suffix_type& value) {
+      if (pos == 0 || !value.same_key(last)) {
+        head = pos;
+        ++num_groups;
+      }
+      last = value;
+      ++pos;
+
+      out_stream.write(reinterpret_cast<const char*>(&value.index), sizeof(T));
+      rank_run.push_back({ value.index, static_cast<T>(head + 1) });
+      if (rank_run.size() == rank_run_size) {
+        rank_run_files.push_back(detail::spill_run(pool, &rank_run, path));
+        rank_run.clear();
+      }
+    });
+    DCPL_ASSERT(out_stream.good()) << "Failed to write suffix array: " << path;
+    out_stream.close();
+    run_files.clear();
+
+    if (num_groups == n) {
+      break;
+    }
+    if (!rank_run.empty()) {
+      rank_run_files.push_back(detail::spill_run(pool, &rank_run, path));
+    }
+    rank_run = std::vector<rank_type>();
+
+    rank_file = std::make_unique<temp_file>(std::ios::binary, path);
+    detail::merge_runs<rank_type>(rank_run_files, [&](const rank_type& value) {
+      rank_file->file().write(reinterpret_cast<const char*>(&value.rank), sizeof(T));
+    });
+    DCPL_ASSERT(rank_file->file().good())
+        << "Failed to write suffix array ranks: " << rank_file->path();
+    rank_file->close();
+  }
+
+  return map_output();
+}
+
+// Computes the LCP array of the suffix array, where lcp[i] is the length of the
+// longest common prefix of the suffixes at sa[i - 1] and sa[i] (and lcp[0] is zero),
+// with the Kasai algorithm.
+template <typename T, typename C, typename S>
+std::vector<T> compute_lcp(const C& data, const S& sa) {
+  const std::size_t n = sa.size();
+  std::vector<T> rank(n);
+
+  for (std::size_t i = 0; i < n; ++i) {
+    rank[sa[i]] = static_cast<T>(i);
+  }
+
+  std::vector<T> lcp(n);
+  std::size_t h = 0;
+
+  for (std::size_t i = 0; i < n; ++i) {
+    if (rank[i] > 0) {
+      std::size_t j = sa[rank[i] - 1];
+
+      while (i + h < n && j + h < n && data[i + h] == data[j + h]) {
+        ++h;
+      }
+      lcp[rank[i]] = static_cast<T>(h);
+      if (h > 0) {
+        --h;
+      }
+    } else {
+      h = 0;
+    }
+  }
+
+  return lcp;
+}
+
+// Computes the same LCP array of compute_lcp() using num_threads threads (or the
+// default number of threads of dcpl::threadpool, if zero). The permuted LCP array
+// (PLCP, in text order) is computed in place of the PHI array (the suffix preceding
+// each suffix in the suffix array), by splitting the text among the threads. As the
+// PLCP[i] >= PLCP[i - 1] - 1 invariant lets each thread resume matching where the
+// previous position left off, the work stays linear, but for the restart at every
+// chunk boundary.
+template <typename T, typename C, typename S>
+std::vector<T> compute_lcp_parallel(const C& data, const S& sa,
+                                    std::size_t num_threads = 0) {
+  const std::size_t n = sa.size();
+  const std::size_t nthreads =
+      effective_num_threads(num_threads,
+                            std::max<std::size_t>(n / detail::min_parallel_size, 1));
+
+  if (nthreads <= 1) {
+    return compute_lcp<T>(data, sa);
+  }
+
+  DCPL_CHECK_LT(n, std::numeric_limits<T>::max())
+      << "LCP array type too small for the input data";
+
+  threadpool pool(nthreads);
+  const std::size_t parts = 4 * nthreads;
+  auto part_run = [&](const auto& fn) {
+    detail::parallel_run(&pool, parts, [&](std::size_t p) {
+      fn(n * p / parts, n * (p + 1) / parts);
+    });
+  };
+  std::vector<T> plcp(n);
+
+  part_run([&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      plcp[sa[i]] = i > 0 ? sa[i - 1] : static_cast<T>(n);
+    }
+  });
+  part_run([&](std::size_t begin, std::size_t end) {
+    std::size_t h = 0;
+
+    for (std::size_t i = begin; i < end; ++i) {
+      std::size_t j = plcp[i];
+
+      if (j == n) {
+        h = 0;
+      } else {
+        while (i + h < n && j + h < n && data[i + h] == data[j + h]) {
+          ++h;
+        }
+      }
+      plcp[i] = static_cast<T>(h);
+      if (h > 0) {
+        --h;
+      }
+    }
+  });
+
+  std::vector<T> lcp(n);
+
+  part_run([&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      lcp[i] = plcp[sa[i]];
+    }
+  });
+
+  return lcp;
+}
+
 struct partition {
   std::size_t begin = 0;
   std::size_t end = 0;
@@ -182,5 +966,178 @@ split(const T& data, const S& sa, const partition& part) {
   return parts;
 }
 
+namespace detail {
+
+// Returns the length of the common prefix of the [lhs, lhs + size) and
+// [rhs, rhs + size) ranges. Contiguous ranges of the same integer type are compared
+// a 64 bit word at a time, and the first mismatching symbol is then found from the
+// lowest differing bit (the first in memory order, on little endian machines).
+template <typename L, typename R>
+std::size_t common_prefix(L lhs, R rhs, std::size_t size) {
+  using lvalue_type = std::iter_value_t<L>;
+  using rvalue_type = std::iter_value_t<R>;
+
+  std::size_t pos = 0;
+
+  if constexpr (std::contiguous_iterator<L> && std::contiguous_iterator<R> &&
+                std::is_same_v<lvalue_type, rvalue_type> &&
+                std::is_integral_v<lvalue_type> &&
+                sizeof(lvalue_type) <= sizeof(std::uint64_t) &&
+                std::endian::native == std::endian::little) {
+    constexpr std::size_t step = sizeof(std::uint64_t) / sizeof(lvalue_type);
+    const lvalue_type* lptr = std::to_address(lhs);
+    const rvalue_type* rptr = std::to_address(rhs);
+
+    for (; pos + step <= size; pos += step) {
+      std::uint64_t lword;
+      std::uint64_t rword;
+
+      std::memcpy(&lword, lptr + pos, sizeof(lword));
+      std::memcpy(&rword, rptr + pos, sizeof(rword));
+      if (lword != rword) {
+        return pos + std::countr_zero(lword ^ rword) / (8 * sizeof(lvalue_type));
+      }
+    }
+  }
+  for (; pos < size && lhs[pos] == rhs[pos]; ++pos) { }
+
+  return pos;
+}
+
+// Returns the range of the suffixes within sa[begin, end) starting with seq (at the
+// offset position), whose first depth symbols are known to match. Every binary search
+// step compares the whole remaining seq against a suffix.
+template <typename T, typename S, typename V>
+std::pair<std::size_t, std::size_t> match_range(const T& data, const S& sa, const V& seq,
+                                                std::size_t depth, std::size_t offset,
+                                                std::size_t begin, std::size_t end) {
+  const std::size_t rsize = seq.size() - depth;
+  // Returns the position of the first symbol of the suffix at idx differing from
+  // seq (past depth), or rsize if the whole seq matches, or the suffix length (past
+  // depth) if the suffix ends first, together with whether it does.
+  auto compare = [&](auto idx) {
+    std::size_t start = offset + idx + depth;
+    std::size_t avail = start < data.size() ? data.size() - start : 0;
+    std::size_t count = common_prefix(std::begin(data) + start,
+                                      std::begin(seq) + depth,
+                                      std::min(avail, rsize));
+
+    return std::pair{ count, count == avail && avail < rsize };
+  };
+  auto lcomp = [&](auto idx, int) {
+    auto [count, shorter] = compare(idx);
+
+    if (count < rsize && !shorter) {
+      return data[offset + idx + depth + count] < seq[depth + count];
+    }
+
+    return shorter;
+  };
+  auto rcomp = [&](int, auto idx) {
+    auto [count, shorter] = compare(idx);
+
+    if (count < rsize && !shorter) {
+      return seq[depth + count] < data[offset + idx + depth + count];
+    }
+
+    return false;
+  };
+  auto lit = std::lower_bound(sa.begin() + begin, sa.begin() + end, 0, lcomp);
+  auto eit = std::upper_bound(lit, sa.begin() + end, 0, rcomp);
+
+  return { static_cast<std::size_t>(std::distance(sa.begin(), lit)),
+           static_cast<std::size_t>(std::distance(sa.begin(), eit)) };
+}
+
+template <typename T, typename S, typename P>
+void find_sorted(const T& data, const S& sa, const P& patterns,
+                 const std::vector<std::size_t>& order, std::size_t begin,
+                 std::size_t end, const partition& part,
+                 std::vector<partition>* results) {
+  struct matched {
+    std::size_t depth = 0;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+  };
+
+  // The partitions of the previous patterns which are prefixes of the current one,
+  // the bottom one being the whole part (matched by the empty prefix).
+  std::vector<matched> stack{ { 0, part.begin, part.end } };
+  std::size_t lower = part.begin;
+
+  for (std::size_t i = begin; i < end; ++i) {
+    const auto& seq = patterns[order[i]];
+
+    if (i > begin) {
+      const auto& prev = patterns[order[i - 1]];
+      std::size_t prefix = common_prefix(std::begin(prev), std::begin(seq),
+                                         std::min(prev.size(), seq.size()));
+
+      while (stack.back().depth > prefix) {
+        stack.pop_back();
+      }
+    }
+
+    const matched base = stack.back();
+    // Patterns are sorted, so the current one cannot start before the previous.
+    auto [mbegin, mend] = match_range(data, sa, seq, base.depth, part.offset,
+                                      std::max(base.begin, lower), base.end);
+
+    lower = mbegin;
+    if (mbegin == mend) {
+      (*results)[order[i]] = { part.end, part.end, part.offset };
+    } else {
+      (*results)[order[i]] = { mbegin, mend, part.offset };
+      stack.push_back({ seq.size(), mbegin, mend });
+    }
+  }
+}
+
+}
+
+// Finds all the patterns within the part partition, returning their partitions (in
+// the same order, see find()). Patterns are sorted first, so that each search is
+// restricted to the partition of the longest previous pattern which is a prefix of
+// the current one, and starts no earlier than the previous match. Every binary
+// search step compares the whole remaining pattern against a suffix (a word at a
+// time for integer symbols), rather than a single symbol per pattern position.
+// The sorted patterns are split among num_threads threads (the shared
+// dcpl::threadpool::get() pool for consts::all, or a new pool of the default number
+// of threads of dcpl::threadpool, if zero).
+// Suffixes shorter than a pattern, but matching it up to their end, are taken to
+// sort before the pattern (like compute_sais() sorts them).
+template <typename T, typename S, typename P>
+std::vector<partition> find_batch(const T& data, const S& sa, const P& patterns,
+                                  const partition& part,
+                                  std::size_t num_threads = consts::all) {
+  static constexpr std::size_t min_thread_patterns = 64;
+  std::vector<std::size_t> order(patterns.size());
+
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t lhs, std::size_t rhs) {
+    const auto& lpat = patterns[lhs];
+    const auto& rpat = patterns[rhs];
+
+    return std::lexicographical_compare(std::begin(lpat), std::end(lpat),
+                                        std::begin(rpat), std::end(rpat));
+  });
+
+  std::vector<partition> results(patterns.size());
+  detail::work_pool pool(num_threads,
+                         std::max<std::size_t>(patterns.size() / min_thread_patterns, 1));
+  const std::size_t nthreads = pool.num_threads();
+
+  if (pool.get() == nullptr) {
+    detail::find_sorted(data, sa, patterns, order, 0, order.size(), part, &results);
+  } else {
+    detail::parallel_run(pool.get(), nthreads, [&](std::size_t i) {
+      detail::find_sorted(data, sa, patterns, order, order.size() * i / nthreads,
+                          order.size() * (i + 1) / nthreads, part, &results);
+    });
+  }
+
+  return results;
+}
+
 }
 
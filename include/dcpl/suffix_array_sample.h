@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "dcpl/archive.h"
+#include "dcpl/assert.h"
+#include "dcpl/suffix_array.h"
+
+namespace dcpl::suffix_array {
+
+// A small search structure over every sample_rate-th suffix array entry, storing
+// the first key_size symbols of the sampled suffixes inline, in Eytzinger (BFS) order.
+// A lookup first walks the samples, whose top levels share few cache lines and
+// never touch the suffix array or the data, to narrow the search to the rows
+// between the last sample lower than the pattern and the first greater one (two
+// consecutive samples, unless the pattern prefix of up to key_size symbols matches
+// several keys), and only then binary searches the suffix array.
+// The index is built from the suffix array (which must list the suffixes like
+// compute_sais() does), and can be stored and loaded with dcpl::archive, next to
+// the suffix array it was built from.
+template <typename V>
+class sample_index {
+ public:
+  sample_index() = default;
+
+  template <typename T, typename S>
+  sample_index(const T& data, const S& sa, std::size_t sample_rate = 64,
+               std::size_t key_size = 8) :
+      size_(sa.size()),
+      sample_rate_(sample_rate),
+      key_size_(key_size) {
+    DCPL_CHECK_EQ(data.size(), sa.size()) << "Suffix array size mismatch";
+    DCPL_CHECK_GT(sample_rate, 0);
+    DCPL_CHECK_LE(key_size, std::numeric_limits<std::uint8_t>::max());
+
+    const std::size_t count = (size_ + sample_rate_ - 1) / sample_rate_;
+
+    keys_.resize((count + 1) * key_size_);
+    key_sizes_.resize(count + 1);
+    ranks_.resize(count + 1);
+
+    // An in-order visit of the implicit tree assigns the sorted samples to the
+    // Eytzinger positions.
+    std::size_t rank = 0;
+    std::vector<std::size_t> stack;
+
+    for (std::size_t node = 1; node <= count || !stack.empty();) {
+      if (node <= count) {
+        stack.push_back(node);
+        node = 2 * node;
+      } else {
+        node = stack.back();
+        stack.pop_back();
+
+        std::size_t pos = sa[rank * sample_rate_];
+        std::size_t ksize = std::min(key_size_, size_ - pos);
+
+        for (std::size_t i = 0; i < ksize; ++i) {
+          keys_[node * key_size_ + i] = static_cast<V>(data[pos + i]);
+        }
+        key_sizes_[node] = static_cast<std::uint8_t>(ksize);
+        ranks_[node] = rank++;
+        node = 2 * node + 1;
+      }
+    }
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // Returns the partition of the suffix array rows which might hold the suffixes
+  // starting with seq.
+  template <typename Q>
+  partition narrow(const Q& seq) const {
+    const std::size_t count = num_samples();
+
+    if (count == 0) {
+      return { 0, size_, 0 };
+    }
+
+    // The sample preceding the first one not lower than seq is lower than all the
+    // matches, and the first sample greater than seq follows all of them.
+    std::size_t lower = search(seq, [](int cmp) { return cmp < 0; });
+    std::size_t upper = search(seq, [](int cmp) { return cmp <= 0; });
+    std::size_t begin = 0;
+
+    if (lower == 0) {
+      begin = (count - 1) * sample_rate_ + 1;
+    } else if (ranks_[lower] > 0) {
+      begin = (ranks_[lower] - 1) * sample_rate_ + 1;
+    }
+
+    std::size_t end = upper == 0 ? size_ : ranks_[upper] * sample_rate_;
+
+    return { begin, std::max(begin, end), 0 };
+  }
+
+  // Returns the partition of the suffixes starting with seq, like find() does.
+  template <typename T, typename S, typename Q>
+  partition find(const T& data, const S& sa, const Q& seq) const {
+    partition part = narrow(seq);
+    auto [begin, end] = detail::match_range(data, sa, seq, 0, 0, part.begin, part.end);
+
+    if (begin == end) {
+      return { size_, size_, 0 };
+    }
+
+    return { begin, end, 0 };
+  }
+
+  void store(archive* ar) const {
+    ar->store(size_);
+    ar->store(sample_rate_);
+    ar->store(key_size_);
+    ar->store(keys_);
+    ar->store(key_sizes_);
+    ar->store(ranks_);
+  }
+
+  void load(archive* ar) {
+    ar->load(size_);
+    ar->load(sample_rate_);
+    ar->load(key_size_);
+    ar->load(keys_);
+    ar->load(key_sizes_);
+    ar->load(ranks_);
+  }
+
+ private:
+  std::size_t num_samples() const {
+    return ranks_.empty() ? 0 : ranks_.size() - 1;
+  }
+
+  // Compares the key of the sample at node with the first key_size symbols of seq,
+  // returning zero when they cannot tell the two apart.
+  template <typename Q>
+  int compare(std::size_t node, const Q& seq) const {
+    const V* key = keys_.data() + node * key_size_;
+    std::size_t ksize = key_sizes_[node];
+    std::size_t size = std::min(key_size_, seq.size());
+    std::size_t csize = std::min(ksize, size);
+    std::size_t count = detail::common_prefix(key, std::begin(seq), csize);
+
+    if (count < csize) {
+      return key[count] < seq[count] ? -1 : 1;
+    }
+
+    // A key shorter than key_size belongs to a suffix ending there, which sorts
+    // before seq if it is a proper prefix of it.
+    return ksize < size ? -1 : 0;
+  }
+
+  // Returns the Eytzinger position of the first sample for which pred(cmp) is
+  // false, or zero if there is none.
+  template <typename Q, typename F>
+  std::size_t search(const Q& seq, const F& pred) const {
+    const std::size_t count = num_samples();
+    std::size_t node = 1;
+
+    while (node <= count) {
+      node = 2 * node + (pred(compare(node, seq)) ? 1 : 0);
+    }
+
+    return node >> (std::countr_one(node) + 1);
+  }
+
+  std::size_t size_ = 0;
+  std::size_t sample_rate_ = 1;
+  std::size_t key_size_ = 0;
+  // The key_size symbols of the key of every sample, in Eytzinger order (starting
+  // from position one).
+  std::vector<V> keys_;
+  std::vector<std::uint8_t> key_sizes_;
+  // The sorted rank of every sample, whose suffix array row is the rank times
+  // sample_rate.
+  std::vector<std::size_t> ranks_;
+};
+
+}
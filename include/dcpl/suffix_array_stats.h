@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "dcpl/constants.h"
+#include "dcpl/suffix_array.h"
+#include "dcpl/threadpool.h"
+
+namespace dcpl::suffix_array {
+
+// The substrings data[pos, pos + length), for every length within [min_length,
+// max_length], all occurring at the suffixes of the [begin, end) suffix array rows.
+struct substring_stat {
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  std::size_t pos = 0;
+  std::size_t min_length = 0;
+  std::size_t max_length = 0;
+
+  std::size_t count() const {
+    return end - begin;
+  }
+
+  auto operator<=>(const substring_stat&) const = default;
+};
+
+namespace detail {
+
+// Splits the suffix array rows into segments starting at rows whose LCP is lower
+// than min_lcp (so that no lcp-interval with at least min_lcp LCP spans two of
+// them), and calls fn(begin, end) for all of them, on num_threads threads (see
+// work_pool).
+template <typename L, typename F>
+void for_each_segment(const L& lcp, std::size_t min_lcp, std::size_t num_threads,
+                      const F& fn) {
+  const std::size_t n = lcp.size();
+  work_pool pool(num_threads, std::max<std::size_t>(n / min_parallel_size, 1));
+  const std::size_t parts = pool.get() != nullptr ? 4 * pool.num_threads() : 1;
+  std::vector<std::size_t> bounds{ 0 };
+
+  for (std::size_t p = 1; p < parts; ++p) {
+    std::size_t row = std::max(n * p / parts, bounds.back() + 1);
+
+    for (; row < n && lcp[row] >= min_lcp; ++row) { }
+    if (row < n) {
+      bounds.push_back(row);
+    }
+  }
+  bounds.push_back(n);
+
+  if (pool.get() == nullptr || bounds.size() <= 2) {
+    fn(bounds.front(), bounds.back());
+  } else {
+    parallel_run(pool.get(), bounds.size() - 1, [&](std::size_t i) {
+      fn(bounds[i], bounds[i + 1]);
+    });
+  }
+}
+
+// The symbols preceding the suffixes of an lcp-interval, tracked only as far as
+// telling whether more than one of them is there.
+template <typename V>
+struct left_set {
+  void merge(const left_set& other) {
+    if (other.diverse || (has_value && other.has_value && value != other.value)) {
+      diverse = true;
+    } else if (!has_value) {
+      has_value = other.has_value;
+      value = other.value;
+    }
+  }
+
+  bool has_value = false;
+  bool diverse = false;
+  V value{};
+};
+
+// Visits bottom-up the lcp-intervals of the [begin, end) segment having at least
+// min_lcp LCP, calling fn(begin, end, lcp, parent_lcp, left) for each one, with
+// parent_lcp clamped to min_lcp - 1.
+template <typename T, typename S, typename L, typename F>
+void visit_intervals(const T& data, const S& sa, const L& lcp, std::size_t begin,
+                     std::size_t end, std::size_t min_lcp, const F& fn) {
+  using left_type = left_set<typename T::value_type>;
+
+  struct open_interval {
+    std::size_t lcp = 0;
+    std::size_t begin = 0;
+    left_type left;
+  };
+
+  auto left_symbol = [&](std::size_t row) {
+    std::size_t pos = sa[row];
+    left_type left;
+
+    // The suffix starting the data has no preceding symbol, which differs from
+    // all the others.
+    if (pos == 0) {
+      left.diverse = true;
+    } else {
+      left.has_value = true;
+      left.value = data[pos - 1];
+    }
+
+    return left;
+  };
+
+  std::vector<open_interval> stack;
+
+  stack.push_back({ min_lcp - 1, begin, {} });
+  for (std::size_t i = begin + 1; i <= end; ++i) {
+    std::size_t cur_lcp =
+        i < end ? std::max<std::size_t>(lcp[i], min_lcp - 1) : min_lcp - 1;
+    std::size_t ibegin = i - 1;
+    left_type pending = left_symbol(i - 1);
+
+    while (cur_lcp < stack.back().lcp) {
+      open_interval node = std::move(stack.back());
+
+      stack.pop_back();
+      node.left.merge(pending);
+      fn(node.begin, i, node.lcp, std::max(cur_lcp, stack.back().lcp), node.left);
+      pending = node.left;
+      ibegin = node.begin;
+    }
+    if (cur_lcp > stack.back().lcp) {
+      stack.push_back({ cur_lcp, ibegin, pending });
+    } else {
+      stack.back().left.merge(pending);
+    }
+  }
+}
+
+}
+
+// Calls fn(stat) for all the substrings occurring at least min_count times, with
+// length within [min_length, max_length]. Each call covers the substrings sharing
+// the same occurrences (an lcp-interval, or a single suffix when min_count is one),
+// whose lengths lie between the LCP of the parent interval (excluded) and the
+// interval one. The LCP array is the one of compute_lcp().
+// The suffix array is split among num_threads threads (the shared
+// dcpl::threadpool::get() pool for consts::all, or a new pool of the default number
+// of threads of dcpl::threadpool, if zero), and fn is called concurrently by them, as
+// the results are found.
+template <typename T, typename S, typename L, typename F>
+void frequent_substrings(const T& data, const S& sa, const L& lcp, std::size_t min_count,
+                         std::size_t min_length, std::size_t max_length, const F& fn,
+                         std::size_t num_threads = consts::all) {
+  const std::size_t n = sa.size();
+  const std::size_t min_lcp = std::max<std::size_t>(min_length, 1);
+
+  auto emit = [&](std::size_t begin, std::size_t end, std::size_t parent_lcp,
+                  std::size_t ilcp) {
+    std::size_t lo = std::max(parent_lcp + 1, min_lcp);
+    std::size_t hi = std::min(ilcp, max_length);
+
+    if (lo <= hi && end - begin >= min_count) {
+      fn(substring_stat{ begin, end, static_cast<std::size_t>(sa[begin]), lo, hi });
+    }
+  };
+
+  detail::for_each_segment(lcp, min_lcp, num_threads, [&](std::size_t begin,
+                                                          std::size_t end) {
+    if (min_count <= 1) {
+      for (std::size_t i = begin; i < end; ++i) {
+        std::size_t next_lcp = i + 1 < n ? lcp[i + 1] : 0;
+        std::size_t parent_lcp = std::max<std::size_t>(lcp[i], next_lcp);
+
+        emit(i, i + 1, parent_lcp, n - sa[i]);
+      }
+    }
+    detail::visit_intervals(data, sa, lcp, begin, end, min_lcp,
+                            [&](std::size_t ibegin, std::size_t iend, std::size_t ilcp,
+                                std::size_t parent_lcp, const auto&) {
+                              emit(ibegin, iend, parent_lcp, ilcp);
+                            });
+  });
+}
+
+// Returns the (up to) k most frequent n-grams, by decreasing count (and increasing
+// suffix array row, for equal counts), as substring_stat with n as both lengths.
+template <typename S, typename L>
+std::vector<substring_stat> top_ngrams(const S& sa, const L& lcp,
+                                       std::size_t ngram_size, std::size_t k,
+                                       std::size_t num_threads = consts::all) {
+  const std::size_t n = sa.size();
+  auto stat_less = [](const substring_stat& lhs, const substring_stat& rhs) {
+    return lhs.count() != rhs.count() ? lhs.count() > rhs.count() : lhs.begin < rhs.begin;
+  };
+  std::mutex mtx;
+  std::vector<substring_stat> top;
+
+  if (ngram_size == 0 || k == 0) {
+    return top;
+  }
+
+  detail::for_each_segment(lcp, ngram_size, num_threads, [&](std::size_t begin,
+                                                             std::size_t end) {
+    std::vector<substring_stat> local;
+
+    for (std::size_t i = begin; i < end;) {
+      std::size_t group_end = i + 1;
+
+      for (; group_end < end && lcp[group_end] >= ngram_size; ++group_end) { }
+      if (n - sa[i] >= ngram_size) {
+        local.push_back({ i, group_end, static_cast<std::size_t>(sa[i]), ngram_size,
+                          ngram_size });
+        std::push_heap(local.begin(), local.end(), stat_less);
+        if (local.size() > k) {
+          std::pop_heap(local.begin(), local.end(), stat_less);
+          local.pop_back();
+        }
+      }
+      i = group_end;
+    }
+
+    std::lock_guard guard(mtx);
+
+    top.insert(top.end(), local.begin(), local.end());
+  });
+
+  std::sort(top.begin(), top.end(), stat_less);
+  if (top.size() > k) {
+    top.resize(k);
+  }
+
+  return top;
+}
+
+// Calls fn(stat) for all the maximal repeats at least min_length long, that is the
+// substrings occurring more than once which cannot be extended either to the left or
+// to the right while keeping all their occurrences (with the repeat length as both
+// lengths of stat). Threads and calls to fn work like with frequent_substrings().
+template <typename T, typename S, typename L, typename F>
+void maximal_repeats(const T& data, const S& sa, const L& lcp, std::size_t min_length,
+                     const F& fn, std::size_t num_threads = consts::all) {
+  const std::size_t min_lcp = std::max<std::size_t>(min_length, 1);
+
+  detail::for_each_segment(lcp, min_lcp, num_threads, [&](std::size_t begin,
+                                                          std::size_t end) {
+    detail::visit_intervals(data, sa, lcp, begin, end, min_lcp,
+                            [&](std::size_t ibegin, std::size_t iend, std::size_t ilcp,
+                                std::size_t, const auto& left) {
+                              if (left.diverse) {
+                                fn(substring_stat{ ibegin, iend,
+                                                   static_cast<std::size_t>(sa[ibegin]),
+                                                   ilcp, ilcp });
+                              }
+                            });
+  });
+}
+
+}
@@ -1,69 +1,58 @@
 #include "dcpl/coro/condition_variable.h"
 
-#include <algorithm>
-
-#include "dcpl/coro/utils.h"
+#include <mutex>
 
 namespace dcpl::coro {
 
 void condition_variable::notify_one() {
-  std::unique_lock<std::mutex> lock(lock_);
-
-  if (!coros_.empty()) {
-    auto coro = coros_.front();
-
-    coros_.pop();
-    lock.unlock();
+  detail::wait_node* node;
+  {
+    std::lock_guard guard(lock_);
 
-    spawn(coro);
+    node = waiters_.pop_front();
+  }
+  if (node != nullptr) {
+    wake(static_cast<waiter*>(node));
   }
 }
 
 void condition_variable::notify_all() {
-  std::queue<std::coroutine_handle<>> coros;
+  detail::wait_node* node;
   {
-    std::unique_lock<std::mutex> lock(lock_);
+    std::lock_guard guard(lock_);
 
-    std::swap(coros_, coros);
+    node = waiters_.take();
   }
+  while (node != nullptr) {
+    // Waking the node links it into the mutex list, so fetch the next one first.
+    detail::wait_node* next = node->next;
 
-  while (!coros.empty()) {
-    auto coro = coros.front();
-
-    coros.pop();
-
-    spawn(coro);
+    wake(static_cast<waiter*>(node));
+    node = next;
   }
 }
 
-coro<> condition_variable::waiter(std::coroutine_handle<> coro, mutex* mtx,
-                                  std::function<bool()> wait_fn) {
-  for (;;) {
-    co_await mtx->lock();
+void condition_variable::suspend(waiter* node) {
+  // The node can be notified and resumed as soon as it is in the list, or the
+  // mutex is unlocked, so it must not be touched after that.
+  mutex* mtx = node->mtx;
 
-    if (wait_fn()) {
-      break;
-    }
-    mtx->unlock();
-
-    co_await suspend();
-  }
-
-  spawn(coro);
+  requeue(node);
+  mtx->unlock();
 }
 
-void condition_variable::do_wait(std::coroutine_handle<> coro, mutex* mtx,
-                                 std::function<bool()> wait_fn) {
-  auto wcoro = waiter(coro, mtx, wait_fn);
+void condition_variable::requeue(waiter* node) {
+  std::lock_guard guard(lock_);
 
-  do_suspend(wcoro.release());
-  mtx->unlock();
+  waiters_.push_back(node);
 }
 
-void condition_variable::do_suspend(std::coroutine_handle<> coro) {
-  std::unique_lock<std::mutex> lock(lock_);
+void condition_variable::wake(waiter* node) {
+  mutex* mtx = node->mtx;
 
-  coros_.emplace(coro);
+  if (!mtx->lock_or_enqueue(node) && !mutex::grant(node)) {
+    mtx->unlock();
+  }
 }
 
 }
@@ -1,45 +1,52 @@
 #include "dcpl/coro/event.h"
 
-#include <algorithm>
-
 #include "dcpl/coro/utils.h"
 
 namespace dcpl::coro {
 
 void event::set(std::size_t count) {
-  std::queue<std::coroutine_handle<>> coros;
-  {
-    std::unique_lock<std::mutex> lock(lock_);
+  std::size_t new_count = count_.fetch_add(count, std::memory_order_acq_rel) + count;
 
-    count_ += count;
-    if (count_ >= trigger_) {
-      std::swap(coros_, coros);
-    }
-  }
+  if (new_count >= trigger_) {
+    std::uintptr_t state = state_.exchange(set_state, std::memory_order_acq_rel);
 
-  while (!coros.empty()) {
-    auto coro = coros.front();
+    if (state != set_state) {
+      detail::wait_node* node =
+          detail::reverse_nodes(reinterpret_cast<detail::wait_node*>(state));
 
-    coros.pop();
+      while (node != nullptr) {
+        // Fetch the next pointer before resuming, as the node lives in the frame of
+        // the coroutine we are resuming.
+        detail::wait_node* next = node->next;
 
-    spawn(coro);
+        spawn(node->coro);
+        node = next;
+      }
+    }
   }
 }
 
 void event::clear() {
-  std::unique_lock<std::mutex> lock(lock_);
+  std::uintptr_t state = set_state;
 
-  count_ = 0;
+  count_.store(0, std::memory_order_relaxed);
+  state_.compare_exchange_strong(state, 0, std::memory_order_acq_rel);
 }
 
-bool event::do_wait(std::coroutine_handle<> coro) {
-  std::unique_lock<std::mutex> lock(lock_);
+bool event::enqueue(detail::wait_node* node) {
+  std::uintptr_t state = state_.load(std::memory_order_acquire);
 
-  if (count_ < trigger_) {
-    coros_.emplace(coro);
+  for (;;) {
+    if (state == set_state) {
+      return false;
+    }
+    node->next = reinterpret_cast<detail::wait_node*>(state);
+    if (state_.compare_exchange_weak(state, reinterpret_cast<std::uintptr_t>(node),
+                                     std::memory_order_release,
+                                     std::memory_order_acquire)) {
+      return true;
+    }
   }
-
-  return count_ < trigger_;
 }
 
 }
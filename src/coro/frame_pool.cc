@@ -0,0 +1,174 @@
+#include "dcpl/coro/frame_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <unordered_set>
+
+namespace dcpl::coro::frame_pool {
+namespace {
+
+// Each thread caches at most this many bytes worth of frames per size class.
+constexpr std::size_t class_cache_bytes = 64 * 1024;
+
+struct free_frame {
+  free_frame* next = nullptr;
+};
+
+constexpr std::size_t class_index(std::size_t size) {
+  return size > 0 ? (size + granularity - 1) / granularity - 1 : 0;
+}
+
+constexpr std::size_t class_size(std::size_t cls) {
+  return (cls + 1) * granularity;
+}
+
+constexpr std::size_t class_limit(std::size_t cls) {
+  return std::max<std::size_t>(class_cache_bytes / class_size(cls), 4);
+}
+
+struct class_cache {
+  free_frame* head = nullptr;
+  std::atomic<std::size_t> count = 0;
+};
+
+struct thread_cache;
+
+struct pool_context {
+  std::mutex mtx;
+  std::unordered_set<thread_cache*> caches;
+  // Counters of the exited threads.
+  std::size_t allocs = 0;
+  std::size_t hits = 0;
+  std::atomic<std::size_t> large_allocs = 0;
+};
+
+pool_context* get_context() {
+  static pool_context* ctx = new pool_context();
+
+  return ctx;
+}
+
+// Counters are atomics only to allow get_stats() to read them from other threads,
+// as they are only ever written by the owner thread.
+void increment(std::atomic<std::size_t>* counter, std::size_t value = 1) {
+  counter->store(counter->load(std::memory_order_relaxed) + value,
+                 std::memory_order_relaxed);
+}
+
+struct thread_cache {
+  thread_cache() {
+    pool_context* ctx = get_context();
+    std::lock_guard guard(ctx->mtx);
+
+    ctx->caches.insert(this);
+  }
+
+  ~thread_cache() {
+    for (auto& ccache : classes) {
+      while (ccache.head != nullptr) {
+        free_frame* frame = ccache.head;
+
+        ccache.head = frame->next;
+        operator delete(frame);
+      }
+    }
+
+    pool_context* ctx = get_context();
+    std::lock_guard guard(ctx->mtx);
+
+    ctx->allocs += allocs.load(std::memory_order_relaxed);
+    ctx->hits += hits.load(std::memory_order_relaxed);
+    ctx->caches.erase(this);
+  }
+
+  void* allocate(std::size_t cls) {
+    class_cache& ccache = classes[cls];
+    free_frame* frame = ccache.head;
+
+    increment(&allocs);
+    if (frame != nullptr) [[likely]] {
+      ccache.head = frame->next;
+      ccache.count.store(ccache.count.load(std::memory_order_relaxed) - 1,
+                         std::memory_order_relaxed);
+      increment(&hits);
+
+      return frame;
+    }
+
+    return operator new(class_size(cls));
+  }
+
+  void deallocate(void* ptr, std::size_t cls) {
+    class_cache& ccache = classes[cls];
+    std::size_t count = ccache.count.load(std::memory_order_relaxed);
+
+    if (count >= class_limit(cls)) [[unlikely]] {
+      operator delete(ptr);
+    } else {
+      free_frame* frame = new (ptr) free_frame{ ccache.head };
+
+      ccache.head = frame;
+      ccache.count.store(count + 1, std::memory_order_relaxed);
+    }
+  }
+
+  std::array<class_cache, num_classes> classes;
+  std::atomic<std::size_t> allocs = 0;
+  std::atomic<std::size_t> hits = 0;
+};
+
+thread_cache& get_cache() {
+  static thread_local thread_cache cache;
+
+  return cache;
+}
+
+}
+
+void* allocate(std::size_t size) {
+  if (size > max_size) [[unlikely]] {
+    get_context()->large_allocs.fetch_add(1, std::memory_order_relaxed);
+
+    return operator new(size);
+  }
+
+  return get_cache().allocate(class_index(size));
+}
+
+void deallocate(void* ptr, std::size_t size) {
+  if (size > max_size) [[unlikely]] {
+    operator delete(ptr);
+  } else {
+    get_cache().deallocate(ptr, class_index(size));
+  }
+}
+
+stats get_stats() {
+  pool_context* ctx = get_context();
+  stats pstats;
+
+  pstats.large_allocs = ctx->large_allocs.load(std::memory_order_relaxed);
+
+  std::lock_guard guard(ctx->mtx);
+
+  pstats.allocs = ctx->allocs;
+  pstats.hits = ctx->hits;
+  for (auto cache : ctx->caches) {
+    pstats.allocs += cache->allocs.load(std::memory_order_relaxed);
+    pstats.hits += cache->hits.load(std::memory_order_relaxed);
+    for (std::size_t cls = 0; cls < num_classes; ++cls) {
+      std::size_t count = cache->classes[cls].count.load(std::memory_order_relaxed);
+
+      pstats.cached_frames += count;
+      pstats.cached_bytes += count * class_size(cls);
+    }
+  }
+  pstats.allocs += pstats.large_allocs;
+
+  return pstats;
+}
+
+}
@@ -5,31 +5,57 @@
 namespace dcpl::coro {
 
 void mutex::unlock() {
-  std::unique_lock<std::mutex> lock(lock_);
-
-  if (coros_.empty()) {
-    locked_ = false;
-  } else {
-    auto coro = coros_.front();
-
-    coros_.pop();
-    lock.unlock();
-
-    spawn(coro);
+  for (;;) {
+    detail::wait_node* node = waiters_;
+
+    if (node == nullptr) {
+      std::uintptr_t state = locked_no_waiters;
+
+      if (state_.compare_exchange_strong(state, unlocked, std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+        break;
+      }
+
+      // New waiters pushed themselves onto the stack, grab them all.
+      state = state_.exchange(locked_no_waiters, std::memory_order_acquire);
+      node = detail::reverse_nodes(reinterpret_cast<detail::wait_node*>(state));
+    }
+    waiters_ = node->next;
+
+    if (grant(node)) {
+      break;
+    }
   }
 }
 
-bool mutex::do_lock(std::coroutine_handle<> coro) {
-  std::unique_lock<std::mutex> lock(lock_);
-  bool lock_result = locked_;
+bool mutex::lock_or_enqueue(detail::wait_node* node) {
+  std::uintptr_t state = state_.load(std::memory_order_relaxed);
+
+  for (;;) {
+    if (state == unlocked) {
+      if (state_.compare_exchange_weak(state, locked_no_waiters,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+        return false;
+      }
+    } else {
+      node->next = reinterpret_cast<detail::wait_node*>(state);
+      if (state_.compare_exchange_weak(state, reinterpret_cast<std::uintptr_t>(node),
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+}
 
-  if (locked_) {
-    coros_.emplace(coro);
-  } else {
-    locked_ = true;
+bool mutex::grant(detail::wait_node* node) {
+  if (node->on_acquire != nullptr) {
+    return node->on_acquire(node);
   }
+  spawn(node->coro);
 
-  return lock_result;
+  return true;
 }
 
 }
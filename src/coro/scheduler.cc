@@ -0,0 +1,343 @@
+#include "dcpl/coro/scheduler.h"
+
+#include <algorithm>
+#include <array>
+#include <thread>
+
+#include "dcpl/env.h"
+#include "dcpl/thread.h"
+
+namespace dcpl::coro {
+namespace {
+
+constexpr std::uint32_t queue_size = 256;
+// Every inject_interval resumptions a worker looks at the injection queue before
+// its local one, so that a worker busy with its own coroutines does not starve
+// the ones spawned from outside.
+constexpr std::uint32_t inject_interval = 61;
+
+}
+
+// The local queue is a bounded ring where only the owner pushes (at the tail), while
+// both the owner and the thieves pop (from the head) using a CAS, which makes the
+// queue FIFO for the owner as well.
+struct scheduler::worker {
+  worker(scheduler* sched, std::size_t index) :
+      sched(sched),
+      index(index) {
+  }
+
+  scheduler* sched = nullptr;
+  std::size_t index = 0;
+  std::uint32_t ticks = 0;
+  std::unique_ptr<std::thread> thread;
+  std::atomic<std::size_t> local_pushes = 0;
+  alignas(64) std::atomic<std::uint32_t> head = 0;
+  alignas(64) std::atomic<std::uint32_t> tail = 0;
+  std::array<std::atomic<void*>, queue_size> ring{};
+};
+
+thread_local scheduler::worker* scheduler::current_ = nullptr;
+
+scheduler::scheduler(std::size_t num_threads) {
+  std::size_t thread_count = num_threads != 0 ? num_threads :
+      std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+  workers_.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; ++i) {
+    workers_.push_back(std::make_unique<worker>(this, i));
+  }
+  // Threads are started only after all the workers have been created, as they
+  // might start stealing from each other right away.
+  for (auto& wrk : workers_) {
+    wrk->thread = thread::create([this, wrk = wrk.get()]() { run(wrk); });
+  }
+}
+
+scheduler::~scheduler() {
+  {
+    std::lock_guard guard(park_mtx_);
+
+    stopped_ = true;
+  }
+  park_cv_.notify_all();
+  for (auto& wrk : workers_) {
+    wrk->thread->join();
+  }
+}
+
+void scheduler::spawn(std::coroutine_handle<> coro) {
+  worker* wrk = current_;
+
+  if (wrk != nullptr && wrk->sched == this) [[likely]] {
+    push_local(wrk, coro.address());
+  } else {
+    {
+      std::lock_guard guard(inject_mtx_);
+
+      injected_.push_back(coro.address());
+      inject_count_.store(injected_.size(), std::memory_order_relaxed);
+    }
+    num_injected_.fetch_add(1, std::memory_order_relaxed);
+  }
+  wake();
+}
+
+scheduler::stats scheduler::get_stats() const {
+  stats sstats;
+
+  sstats.num_threads = workers_.size();
+  for (const auto& wrk : workers_) {
+    sstats.local_pushes += wrk->local_pushes.load(std::memory_order_relaxed);
+  }
+  sstats.injected = num_injected_.load(std::memory_order_relaxed);
+  sstats.steals = num_steals_.load(std::memory_order_relaxed);
+  sstats.parks = num_parks_.load(std::memory_order_relaxed);
+
+  return sstats;
+}
+
+scheduler* scheduler::current() {
+  worker* wrk = current_;
+
+  return wrk != nullptr ? wrk->sched : nullptr;
+}
+
+scheduler* scheduler::get() {
+  static scheduler* sched = create_system_scheduler();
+
+  return sched;
+}
+
+scheduler* scheduler::create_system_scheduler() {
+  return new scheduler(getenv<std::size_t>("DCPL_CORO_THREADS", 0));
+}
+
+void scheduler::run(worker* wrk) {
+  current_ = wrk;
+  for (;;) {
+    void* addr = find_work(wrk);
+
+    if (addr != nullptr) {
+      std::coroutine_handle<>::from_address(addr).resume();
+    } else if (!park()) {
+      break;
+    }
+  }
+  current_ = nullptr;
+}
+
+void scheduler::push_local(worker* wrk, void* addr) {
+  for (;;) {
+    std::uint32_t head = wrk->head.load(std::memory_order_acquire);
+    std::uint32_t tail = wrk->tail.load(std::memory_order_relaxed);
+
+    if (tail - head < queue_size) [[likely]] {
+      wrk->ring[tail % queue_size].store(addr, std::memory_order_relaxed);
+      wrk->tail.store(tail + 1, std::memory_order_release);
+      wrk->local_pushes.store(wrk->local_pushes.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+      break;
+    }
+    if (push_overflow(wrk, head, tail, addr)) {
+      break;
+    }
+  }
+}
+
+bool scheduler::push_overflow(worker* wrk, std::uint32_t head, std::uint32_t tail,
+                              void* addr) {
+  // Moves half of the full local queue, plus the new handle, to the injection queue.
+  std::uint32_t count = (tail - head) / 2;
+  std::array<void*, queue_size / 2 + 1> batch;
+
+  for (std::uint32_t i = 0; i < count; ++i) {
+    batch[i] = wrk->ring[(head + i) % queue_size].load(std::memory_order_relaxed);
+  }
+  if (!wrk->head.compare_exchange_strong(head, head + count,
+                                         std::memory_order_acq_rel)) {
+    // Thieves made room in the meantime, so the caller can retry the fast path.
+    return false;
+  }
+  batch[count] = addr;
+
+  std::lock_guard guard(inject_mtx_);
+
+  injected_.insert(injected_.end(), batch.begin(), batch.begin() + count + 1);
+  inject_count_.store(injected_.size(), std::memory_order_relaxed);
+
+  return true;
+}
+
+void* scheduler::pop_local(worker* wrk) {
+  for (;;) {
+    std::uint32_t head = wrk->head.load(std::memory_order_acquire);
+    std::uint32_t tail = wrk->tail.load(std::memory_order_relaxed);
+
+    if (head == tail) {
+      return nullptr;
+    }
+
+    void* addr = wrk->ring[head % queue_size].load(std::memory_order_relaxed);
+
+    if (wrk->head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel)) {
+      return addr;
+    }
+  }
+}
+
+void* scheduler::steal(worker* thief, worker* victim) {
+  for (;;) {
+    std::uint32_t head = victim->head.load(std::memory_order_acquire);
+    std::uint32_t tail = victim->tail.load(std::memory_order_acquire);
+    std::uint32_t count = tail - head;
+
+    if (count == 0) {
+      return nullptr;
+    }
+    count -= count / 2;
+    if (count > queue_size / 2) {
+      // Inconsistent head/tail snapshot, retry.
+      continue;
+    }
+
+    // The thief queue is empty (only its owner pushes, and it is stealing), so the
+    // stolen handles can be copied starting at its tail, and published only once
+    // the CAS on the victim head succeeds.
+    std::uint32_t ttail = thief->tail.load(std::memory_order_relaxed);
+
+    for (std::uint32_t i = 0; i < count; ++i) {
+      thief->ring[(ttail + i) % queue_size].store(
+          victim->ring[(head + i) % queue_size].load(std::memory_order_relaxed),
+          std::memory_order_relaxed);
+    }
+    if (victim->head.compare_exchange_weak(head, head + count,
+                                           std::memory_order_acq_rel)) {
+      count -= 1;
+
+      void* addr = thief->ring[(ttail + count) % queue_size].load(std::memory_order_relaxed);
+
+      if (count > 0) {
+        thief->tail.store(ttail + count, std::memory_order_release);
+      }
+      num_steals_.fetch_add(1, std::memory_order_relaxed);
+
+      return addr;
+    }
+  }
+}
+
+void* scheduler::pop_injected(worker* wrk) {
+  if (inject_count_.load(std::memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+
+  std::lock_guard guard(inject_mtx_);
+
+  if (injected_.empty()) {
+    return nullptr;
+  }
+
+  void* addr = injected_.front();
+
+  injected_.pop_front();
+
+  // Grab a fair share of the remaining ones into the local queue, without filling
+  // more than half of it.
+  std::uint32_t tail = wrk->tail.load(std::memory_order_relaxed);
+  std::uint32_t local_count = tail - wrk->head.load(std::memory_order_acquire);
+  std::size_t count = local_count < queue_size / 2 ?
+      std::min<std::size_t>(injected_.size() / workers_.size(),
+                            queue_size / 2 - local_count) : 0;
+
+  for (std::size_t i = 0; i < count; ++i, ++tail) {
+    wrk->ring[tail % queue_size].store(injected_.front(), std::memory_order_relaxed);
+    injected_.pop_front();
+  }
+  wrk->tail.store(tail, std::memory_order_release);
+  inject_count_.store(injected_.size(), std::memory_order_relaxed);
+
+  return addr;
+}
+
+void* scheduler::find_work(worker* wrk) {
+  void* addr = nullptr;
+
+  wrk->ticks += 1;
+  if (wrk->ticks % inject_interval == 0) [[unlikely]] {
+    addr = pop_injected(wrk);
+  }
+  if (addr == nullptr) {
+    addr = pop_local(wrk);
+  }
+  if (addr == nullptr) {
+    addr = pop_injected(wrk);
+  }
+  for (std::size_t i = 1; addr == nullptr && i < workers_.size(); ++i) {
+    addr = steal(wrk, workers_[(wrk->index + i) % workers_.size()].get());
+  }
+
+  return addr;
+}
+
+bool scheduler::has_work() const {
+  if (inject_count_.load(std::memory_order_relaxed) != 0) {
+    return true;
+  }
+  for (const auto& wrk : workers_) {
+    if (wrk->head.load(std::memory_order_acquire) !=
+        wrk->tail.load(std::memory_order_acquire)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool scheduler::park() {
+  std::unique_lock lock(park_mtx_);
+
+  // Announce the intention of sleeping before re-checking the queues, pairing with
+  // the fence in wake(), so that either the waker sees the idle count, or we see
+  // the newly queued coroutine.
+  idle_.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (!stopped_ && !has_work()) {
+    num_parks_.fetch_add(1, std::memory_order_relaxed);
+    park_cv_.wait(lock);
+  }
+  idle_.fetch_sub(1, std::memory_order_relaxed);
+
+  return !stopped_;
+}
+
+void scheduler::wake() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (idle_.load(std::memory_order_relaxed) != 0) {
+    std::lock_guard guard(park_mtx_);
+
+    park_cv_.notify_one();
+  }
+}
+
+std::coroutine_handle<> scheduler::yield_to_next(std::coroutine_handle<> coro) {
+  worker* wrk = current_;
+
+  if (wrk == nullptr || wrk->sched != this) [[unlikely]] {
+    spawn(coro);
+
+    return std::noop_coroutine();
+  }
+
+  void* addr = pop_local(wrk);
+
+  if (addr == nullptr) {
+    return coro;
+  }
+  push_local(wrk, coro.address());
+
+  return std::coroutine_handle<>::from_address(addr);
+}
+
+}
@@ -0,0 +1,60 @@
+#include "dcpl/coro/semaphore.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "dcpl/coro/utils.h"
+
+namespace dcpl::coro {
+
+bool semaphore::try_acquire() {
+  std::ptrdiff_t count = count_.load(std::memory_order_relaxed);
+
+  while (count > 0) {
+    if (count_.compare_exchange_weak(count, count - 1, std::memory_order_acquire,
+                                     std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void semaphore::release(std::ptrdiff_t count) {
+  std::ptrdiff_t old_count = count_.fetch_add(count, std::memory_order_acq_rel);
+  std::ptrdiff_t wakeups = std::min(count, std::max<std::ptrdiff_t>(-old_count, 0));
+
+  for (; wakeups > 0; --wakeups) {
+    detail::wait_node* node;
+    {
+      std::lock_guard guard(lock_);
+
+      node = waiters_.pop_front();
+      if (node == nullptr) {
+        pending_ += 1;
+      }
+    }
+    if (node != nullptr) {
+      spawn(node->coro);
+    }
+  }
+}
+
+bool semaphore::acquire_or_enqueue(detail::wait_node* node) {
+  if (count_.fetch_sub(1, std::memory_order_acq_rel) > 0) {
+    return false;
+  }
+
+  std::lock_guard guard(lock_);
+
+  if (pending_ > 0) {
+    pending_ -= 1;
+
+    return false;
+  }
+  waiters_.push_back(node);
+
+  return true;
+}
+
+}
@@ -0,0 +1,108 @@
+#include "dcpl/coro/shared_mutex.h"
+
+#include <mutex>
+
+#include "dcpl/coro/utils.h"
+
+namespace dcpl::coro {
+
+bool shared_mutex::try_lock() {
+  std::uint64_t state = 0;
+
+  return state_.compare_exchange_strong(state, writer_bit, std::memory_order_acquire,
+                                        std::memory_order_relaxed);
+}
+
+bool shared_mutex::try_lock_shared() {
+  std::uint64_t state = state_.load(std::memory_order_relaxed);
+
+  while ((state & (writer_bit | waiters_bit)) == 0) {
+    if (state_.compare_exchange_weak(state, state + reader_one,
+                                     std::memory_order_acquire,
+                                     std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void shared_mutex::unlock() {
+  std::uint64_t state = state_.fetch_sub(writer_bit, std::memory_order_release) -
+      writer_bit;
+
+  if (state == waiters_bit) {
+    dispatch();
+  }
+}
+
+void shared_mutex::unlock_shared() {
+  std::uint64_t state = state_.fetch_sub(reader_one, std::memory_order_release) -
+      reader_one;
+
+  if (state == waiters_bit) {
+    dispatch();
+  }
+}
+
+bool shared_mutex::lock_or_enqueue(waiter* node) {
+  std::lock_guard guard(lock_);
+  std::uint64_t state = state_.load(std::memory_order_relaxed);
+
+  for (;;) {
+    if (node->shared ? (state & (writer_bit | waiters_bit)) == 0 : state == 0) {
+      if (state_.compare_exchange_weak(state,
+                                       node->shared ? state + reader_one : writer_bit,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+        return false;
+      }
+    } else if (state_.compare_exchange_weak(state, state | waiters_bit,
+                                            std::memory_order_relaxed,
+                                            std::memory_order_relaxed)) {
+      waiters_.push_back(node);
+
+      return true;
+    }
+  }
+}
+
+void shared_mutex::dispatch() {
+  detail::wait_node* granted = nullptr;
+  {
+    std::lock_guard guard(lock_);
+
+    // With the waiters bit set, the lock can only be acquired here, so if holders
+    // are found, another dispatch() already granted it, and their release will
+    // dispatch again.
+    if (state_.load(std::memory_order_acquire) != waiters_bit) {
+      return;
+    }
+
+    std::uint64_t state = 0;
+    detail::wait_list grants;
+
+    if (!static_cast<waiter*>(waiters_.front())->shared) {
+      grants.push_back(waiters_.pop_front());
+      state = writer_bit;
+    } else {
+      while (!waiters_.empty() && static_cast<waiter*>(waiters_.front())->shared) {
+        grants.push_back(waiters_.pop_front());
+        state += reader_one;
+      }
+    }
+    if (!waiters_.empty()) {
+      state |= waiters_bit;
+    }
+    state_.store(state, std::memory_order_release);
+    granted = grants.take();
+  }
+  while (granted != nullptr) {
+    detail::wait_node* next = granted->next;
+
+    spawn(granted->coro);
+    granted = next;
+  }
+}
+
+}
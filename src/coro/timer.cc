@@ -0,0 +1,147 @@
+#include "dcpl/coro/timer.h"
+
+#include "dcpl/thread.h"
+
+namespace dcpl::coro {
+
+timer_queue::timer_queue() :
+    thread_(thread::create([this]() { run(); })) {
+}
+
+timer_queue::~timer_queue() {
+  {
+    std::lock_guard guard(mtx_);
+
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  thread_->join();
+}
+
+void timer_queue::add(detail::timer_node* node) {
+  bool notify;
+  {
+    std::lock_guard guard(mtx_);
+
+    heap_.push_back(node);
+    node->heap_index = heap_.size() - 1;
+    sift_up(node->heap_index);
+    // The timer thread needs to be woken up only if it has a new earliest deadline.
+    notify = heap_.front() == node;
+  }
+  if (notify) {
+    cv_.notify_one();
+  }
+}
+
+bool timer_queue::cancel(detail::timer_node* node) {
+  std::lock_guard guard(mtx_);
+
+  if (node->heap_index == detail::timer_node::no_index) {
+    return false;
+  }
+  heap_remove(node->heap_index);
+
+  return true;
+}
+
+std::size_t timer_queue::size() {
+  std::lock_guard guard(mtx_);
+
+  return heap_.size();
+}
+
+timer_queue* timer_queue::get() {
+  static timer_queue* tqueue = new timer_queue();
+
+  return tqueue;
+}
+
+void timer_queue::run() {
+  std::unique_lock lock(mtx_);
+
+  while (!stopped_) {
+    if (heap_.empty()) {
+      cv_.wait(lock);
+      continue;
+    }
+
+    detail::timer_node* node = heap_.front();
+    ns_time now = nstime();
+
+    if (node->deadline <= now) {
+      heap_remove(0);
+      fire(node);
+    } else {
+      cv_.wait_for(lock, node->deadline - now);
+    }
+  }
+}
+
+void timer_queue::fire(detail::timer_node* node) {
+  // Resuming the coroutine might destroy the node, so it must not be touched
+  // after that.
+  if (node->on_expire != nullptr) {
+    node->on_expire(node);
+  } else if (node->sched != nullptr) {
+    node->sched->spawn(node->coro);
+  } else {
+    spawn(node->coro);
+  }
+}
+
+void timer_queue::heap_remove(std::size_t pos) {
+  detail::timer_node* node = heap_[pos];
+  detail::timer_node* last = heap_.back();
+
+  heap_.pop_back();
+  node->heap_index = detail::timer_node::no_index;
+  if (last != node) {
+    heap_set(pos, last);
+    sift_up(pos);
+    sift_down(last->heap_index);
+  }
+}
+
+void timer_queue::sift_up(std::size_t pos) {
+  detail::timer_node* node = heap_[pos];
+
+  while (pos > 0) {
+    std::size_t parent = (pos - 1) / 2;
+
+    if (heap_[parent]->deadline <= node->deadline) {
+      break;
+    }
+    heap_set(pos, heap_[parent]);
+    pos = parent;
+  }
+  heap_set(pos, node);
+}
+
+void timer_queue::sift_down(std::size_t pos) {
+  detail::timer_node* node = heap_[pos];
+
+  for (;;) {
+    std::size_t child = 2 * pos + 1;
+
+    if (child >= heap_.size()) {
+      break;
+    }
+    if (child + 1 < heap_.size() && heap_[child + 1]->deadline < heap_[child]->deadline) {
+      child += 1;
+    }
+    if (node->deadline <= heap_[child]->deadline) {
+      break;
+    }
+    heap_set(pos, heap_[child]);
+    pos = child;
+  }
+  heap_set(pos, node);
+}
+
+void timer_queue::heap_set(std::size_t pos, detail::timer_node* node) {
+  heap_[pos] = node;
+  node->heap_index = pos;
+}
+
+}
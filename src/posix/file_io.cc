@@ -0,0 +1,34 @@
+#include "dcpl/coro/file_io.h"
+
+#include <cstring>
+
+#include "dcpl/assert.h"
+
+namespace dcpl::coro {
+
+file_io_awaiter::file_io_awaiter(const file& afile, int opcode, const void* data,
+                                 std::size_t size, fileoff_t off) :
+    io_ring::awaiter(io_ring::get(), opcode, afile.fileno(), data, size, off),
+    path_(&afile.path()) {
+}
+
+void file_io_awaiter::await_resume() const {
+  const char* opname = opcode == op_read ? "read" : "write";
+
+  DCPL_ASSERT(error == 0)
+      << "Failed to " << opname << " file (" << std::strerror(error) << "): " << *path_;
+  DCPL_CHECK_EQ(done, size)
+      << "Failed to " << opname << " file (short transfer): " << *path_;
+}
+
+file_io_awaiter async_pread(const file& afile, void* data, std::size_t size,
+                            fileoff_t off) {
+  return file_io_awaiter(afile, file_io_awaiter::op_read, data, size, off);
+}
+
+file_io_awaiter async_pwrite(const file& afile, const void* data, std::size_t size,
+                             fileoff_t off) {
+  return file_io_awaiter(afile, file_io_awaiter::op_write, data, size, off);
+}
+
+}
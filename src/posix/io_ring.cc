@@ -0,0 +1,410 @@
+#include "dcpl/coro/io_ring.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include "dcpl/assert.h"
+#include "dcpl/coro/utils.h"
+#include "dcpl/env.h"
+#include "dcpl/thread.h"
+
+namespace dcpl::coro {
+namespace {
+
+// Linux still has the limit of 2GB for read/write operations, even on 64bit builds.
+constexpr std::size_t max_rw_chunk = 1ULL << 30;
+
+}
+
+#if defined(__linux__)
+
+struct io_ring::kernel_ring {
+  ~kernel_ring() {
+    if (sqes != nullptr) {
+      ::munmap(sqes, sqes_size);
+    }
+    if (cq_ptr != nullptr && cq_ptr != sq_ptr) {
+      ::munmap(cq_ptr, cq_size);
+    }
+    if (sq_ptr != nullptr) {
+      ::munmap(sq_ptr, sq_size);
+    }
+    if (wake_fd != -1) {
+      ::close(wake_fd);
+    }
+    if (fd != -1) {
+      ::close(fd);
+    }
+  }
+
+  static std::unique_ptr<kernel_ring> create(std::size_t entries);
+
+  std::size_t sq_space() const {
+    std::uint32_t head = std::atomic_ref<std::uint32_t>(*sq_head).load(std::memory_order_acquire);
+
+    return sq_entries - (sq_tail_local - head);
+  }
+
+  void queue(int opcode, int sfd, void* addr, std::size_t len, fileoff_t offset,
+             std::uint64_t user_data) {
+    std::uint32_t index = sq_tail_local & *sq_mask;
+    io_uring_sqe* sqe = sqes + index;
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = static_cast<std::uint8_t>(opcode);
+    sqe->fd = sfd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(addr);
+    sqe->len = static_cast<std::uint32_t>(len);
+    sqe->off = static_cast<std::uint64_t>(offset);
+    sqe->user_data = user_data;
+    sq_array[index] = index;
+    ++sq_tail_local;
+    std::atomic_ref<std::uint32_t>(*sq_tail).store(sq_tail_local, std::memory_order_release);
+  }
+
+  void queue_io(detail::io_node* node) {
+    int opcode = node->opcode == detail::io_node::op_read ? IORING_OP_READ : IORING_OP_WRITE;
+
+    queue(opcode, node->fd, node->data + node->done,
+          std::min(node->size - node->done, max_rw_chunk),
+          node->offset + static_cast<fileoff_t>(node->done),
+          reinterpret_cast<std::uint64_t>(node));
+  }
+
+  // The wakeup entry is a read of the eventfd which submitters write to, and is
+  // told apart from the I/O operations by its zero user data.
+  void queue_wakeup() {
+    queue(IORING_OP_READ, wake_fd, &wake_value, sizeof(wake_value), 0, 0);
+  }
+
+  // Submits the queued entries and waits for at least one completion. Returns the
+  // number of submitted entries.
+  std::uint32_t enter(std::uint32_t to_submit) {
+    long count = ::syscall(__NR_io_uring_enter, fd, to_submit, 1, IORING_ENTER_GETEVENTS,
+                           nullptr, 0);
+
+    if (count < 0) {
+      DCPL_ASSERT(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+          << "Failed to enter io_uring: " << std::strerror(errno);
+
+      return 0;
+    }
+
+    return static_cast<std::uint32_t>(count);
+  }
+
+  bool pop_completion(std::uint64_t* user_data, std::int32_t* res) {
+    std::uint32_t head = *cq_head;
+    std::uint32_t tail = std::atomic_ref<std::uint32_t>(*cq_tail).load(std::memory_order_acquire);
+
+    if (head == tail) {
+      return false;
+    }
+
+    const io_uring_cqe* cqe = cqes + (head & *cq_mask);
+
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    std::atomic_ref<std::uint32_t>(*cq_head).store(head + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  int fd = -1;
+  int wake_fd = -1;
+  std::uint64_t wake_value = 0;
+  void* sq_ptr = nullptr;
+  std::size_t sq_size = 0;
+  void* cq_ptr = nullptr;
+  std::size_t cq_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  std::size_t sqes_size = 0;
+  std::uint32_t sq_entries = 0;
+  std::uint32_t* sq_head = nullptr;
+  std::uint32_t* sq_tail = nullptr;
+  std::uint32_t* sq_mask = nullptr;
+  std::uint32_t* sq_array = nullptr;
+  std::uint32_t sq_tail_local = 0;
+  std::uint32_t cq_entries = 0;
+  std::uint32_t* cq_head = nullptr;
+  std::uint32_t* cq_tail = nullptr;
+  std::uint32_t* cq_mask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+};
+
+std::unique_ptr<io_ring::kernel_ring> io_ring::kernel_ring::create(std::size_t entries) {
+  io_uring_params params;
+
+  std::memset(&params, 0, sizeof(params));
+
+  auto ur = std::make_unique<kernel_ring>();
+
+  ur->fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+  // The IORING_OP_READ and IORING_OP_WRITE operations came together with the
+  // IORING_FEAT_RW_CUR_POS feature.
+  if (ur->fd == -1 || (params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+    return nullptr;
+  }
+
+  ur->sq_size = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+  ur->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+    ur->sq_size = ur->cq_size = std::max(ur->sq_size, ur->cq_size);
+  }
+
+  void* ptr = ::mmap(nullptr, ur->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+
+  if (ptr == MAP_FAILED) {
+    return nullptr;
+  }
+  ur->sq_ptr = ptr;
+
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+    ur->cq_ptr = ur->sq_ptr;
+  } else {
+    ptr = ::mmap(nullptr, ur->cq_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING);
+    if (ptr == MAP_FAILED) {
+      return nullptr;
+    }
+    ur->cq_ptr = ptr;
+  }
+
+  ur->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  ptr = ::mmap(nullptr, ur->sqes_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+  if (ptr == MAP_FAILED) {
+    return nullptr;
+  }
+  ur->sqes = static_cast<io_uring_sqe*>(ptr);
+
+  char* sq_base = static_cast<char*>(ur->sq_ptr);
+  char* cq_base = static_cast<char*>(ur->cq_ptr);
+
+  ur->sq_entries = params.sq_entries;
+  ur->sq_head = reinterpret_cast<std::uint32_t*>(sq_base + params.sq_off.head);
+  ur->sq_tail = reinterpret_cast<std::uint32_t*>(sq_base + params.sq_off.tail);
+  ur->sq_mask = reinterpret_cast<std::uint32_t*>(sq_base + params.sq_off.ring_mask);
+  ur->sq_array = reinterpret_cast<std::uint32_t*>(sq_base + params.sq_off.array);
+  ur->sq_tail_local = *ur->sq_tail;
+  ur->cq_entries = params.cq_entries;
+  ur->cq_head = reinterpret_cast<std::uint32_t*>(cq_base + params.cq_off.head);
+  ur->cq_tail = reinterpret_cast<std::uint32_t*>(cq_base + params.cq_off.tail);
+  ur->cq_mask = reinterpret_cast<std::uint32_t*>(cq_base + params.cq_off.ring_mask);
+  ur->cqes = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+
+  ur->wake_fd = ::eventfd(0, EFD_CLOEXEC);
+  if (ur->wake_fd == -1) {
+    return nullptr;
+  }
+
+  return ur;
+}
+
+#else
+
+struct io_ring::kernel_ring {
+  static std::unique_ptr<kernel_ring> create(std::size_t entries) {
+    return nullptr;
+  }
+};
+
+#endif
+
+std::size_t io_ring::awaiter::await_resume() const {
+  DCPL_ASSERT(error == 0)
+      << "Failed to " << (opcode == op_read ? "read" : "write")
+      << " file descriptor " << fd << ": " << std::strerror(error);
+
+  return done;
+}
+
+io_ring::io_ring(std::size_t entries, bool use_uring) {
+  if (use_uring) {
+    kring_ = kernel_ring::create(entries);
+  }
+  if (kring_ != nullptr) {
+    thread_ = thread::create([this]() { run(); });
+  } else {
+    pool_ = std::make_unique<threadpool>(getenv<std::size_t>("DCPL_IO_THREADS", 4));
+  }
+}
+
+io_ring::~io_ring() {
+  if (thread_ != nullptr) {
+    stopped_.store(true, std::memory_order_release);
+    wakeup();
+    thread_->join();
+  }
+}
+
+void io_ring::submit(detail::io_node* node) {
+  num_submitted_.fetch_add(1, std::memory_order_relaxed);
+  if (kring_ == nullptr) {
+    pool_->push_work([this, node]() {
+      run_blocking(node);
+      complete(node);
+    });
+
+    return;
+  }
+
+  detail::wait_node* head = pending_.load(std::memory_order_relaxed);
+
+  do {
+    node->next = head;
+  } while (!pending_.compare_exchange_weak(head, node, std::memory_order_release,
+                                           std::memory_order_relaxed));
+
+  // Only the push onto an empty stack needs to wake the ring thread up, as it takes
+  // the whole stack at once.
+  if (head == nullptr) {
+    wakeup();
+  }
+}
+
+io_ring::stats io_ring::get_stats() const {
+  stats st;
+
+  st.uring = uring();
+  st.submitted = num_submitted_.load(std::memory_order_relaxed);
+  st.completed = num_completed_.load(std::memory_order_relaxed);
+  st.enters = num_enters_.load(std::memory_order_relaxed);
+
+  return st;
+}
+
+io_ring* io_ring::get() {
+  static io_ring* ring = create_system_ring();
+
+  return ring;
+}
+
+io_ring* io_ring::create_system_ring() {
+  return new io_ring(getenv<std::size_t>("DCPL_IO_ENTRIES", 256),
+                     getenv<int>("DCPL_IO_URING", 1) != 0);
+}
+
+void io_ring::run() {
+#if defined(__linux__)
+  kernel_ring& ur = *kring_;
+  detail::wait_list backlog;
+  std::size_t in_flight = 0;
+  std::uint32_t to_submit = 0;
+  bool wakeup_queued = false;
+
+  for (;;) {
+    detail::wait_node* node = detail::reverse_nodes(
+        pending_.exchange(nullptr, std::memory_order_acquire));
+
+    while (node != nullptr) {
+      detail::wait_node* next = node->next;
+
+      backlog.push_back(node);
+      node = next;
+    }
+
+    if (!wakeup_queued && ur.sq_space() > 0) {
+      ur.queue_wakeup();
+      wakeup_queued = true;
+      ++to_submit;
+    }
+    // One completion queue slot is always left to the wakeup entry, so that the
+    // completion queue never overflows.
+    while (!backlog.empty() && in_flight + 1 < ur.cq_entries && ur.sq_space() > 0) {
+      ur.queue_io(static_cast<detail::io_node*>(backlog.pop_front()));
+      ++in_flight;
+      ++to_submit;
+    }
+
+    if (stopped_.load(std::memory_order_acquire) && in_flight == 0 && backlog.empty()) {
+      break;
+    }
+
+    to_submit -= ur.enter(to_submit);
+    num_enters_.fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t user_data;
+    std::int32_t res;
+
+    while (ur.pop_completion(&user_data, &res)) {
+      if (user_data == 0) {
+        wakeup_queued = false;
+        continue;
+      }
+
+      detail::io_node* ionode = reinterpret_cast<detail::io_node*>(user_data);
+
+      --in_flight;
+      if (res < 0) {
+        if (res == -EINTR || res == -EAGAIN) {
+          backlog.push_front(ionode);
+          continue;
+        }
+        ionode->error = -res;
+      } else {
+        ionode->done += static_cast<std::size_t>(res);
+        if (res > 0 && ionode->done < ionode->size) {
+          backlog.push_front(ionode);
+          continue;
+        }
+      }
+      complete(ionode);
+    }
+  }
+#endif
+}
+
+void io_ring::run_blocking(detail::io_node* node) {
+  while (node->done < node->size) {
+    std::size_t csize = std::min(node->size - node->done, max_rw_chunk);
+    fileoff_t offset = node->offset + static_cast<fileoff_t>(node->done);
+    dcpl::ssize_t count = node->opcode == detail::io_node::op_read ?
+        ::pread(node->fd, node->data + node->done, csize, offset) :
+        ::pwrite(node->fd, node->data + node->done, csize, offset);
+
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      node->error = errno;
+      break;
+    }
+    if (count == 0) {
+      break;
+    }
+    node->done += static_cast<std::size_t>(count);
+  }
+}
+
+void io_ring::complete(detail::io_node* node) {
+  num_completed_.fetch_add(1, std::memory_order_relaxed);
+  // Resuming the coroutine might destroy the node, so it must not be touched
+  // after that.
+  if (node->sched != nullptr) {
+    node->sched->spawn(node->coro);
+  } else {
+    spawn(node->coro);
+  }
+}
+
+void io_ring::wakeup() {
+#if defined(__linux__)
+  std::uint64_t value = 1;
+
+  while (::write(kring_->wake_fd, &value, sizeof(value)) < 0 && errno == EINTR) { }
+#endif
+}
+
+}
@@ -1,8 +1,14 @@
 #include "dcpl/os.h"
 
+#include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <cerrno>
+#include <cstring>
+
+#include "dcpl/assert.h"
+
 namespace dcpl {
 namespace os {
 
@@ -22,6 +28,20 @@ std::size_t page_size() {
   return static_cast<std::size_t>(::getpagesize());
 }
 
+std::array<int, 2> socketpair() {
+  std::array<int, 2> fds;
+
+  DCPL_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data()) == 0)
+      << "Unable to create socket pair: " << std::strerror(errno);
+
+  return fds;
+}
+
+void close(int fd) {
+  DCPL_ASSERT(::close(fd) == 0 || errno == EINTR)
+      << "Unable to close file descriptor " << fd << ": " << std::strerror(errno);
+}
+
 }
 
 }
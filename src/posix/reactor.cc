@@ -0,0 +1,249 @@
+#include "dcpl/coro/reactor.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include "dcpl/assert.h"
+#include "dcpl/coro/utils.h"
+#include "dcpl/thread.h"
+#include "dcpl/types.h"
+
+namespace dcpl::coro {
+namespace {
+
+constexpr int max_events = 128;
+
+void resume(detail::wait_node* node) {
+  while (node != nullptr) {
+    detail::ready_node* rnode = static_cast<detail::ready_node*>(node);
+
+    node = node->next;
+    if (rnode->sched != nullptr) {
+      rnode->sched->spawn(rnode->coro);
+    } else {
+      spawn(rnode->coro);
+    }
+  }
+}
+
+}
+
+struct reactor::fd_state {
+  int fd = -1;
+  detail::spin_lock lock;
+  detail::wait_list waiters[2];
+  // Whether a readiness edge arrived while nobody was waiting for it.
+  bool ready[2] = { false, false };
+};
+
+reactor::reactor() {
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  DCPL_ASSERT(epoll_fd_ != -1) << "Unable to create epoll: " << std::strerror(errno);
+
+  wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  DCPL_ASSERT(wake_fd_ != -1) << "Unable to create eventfd: " << std::strerror(errno);
+
+  struct epoll_event event;
+
+  std::memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  DCPL_ASSERT(::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) == 0)
+      << "Unable to register eventfd: " << std::strerror(errno);
+
+  thread_ = thread::create([this]() { run(); });
+}
+
+reactor::~reactor() {
+  std::uint64_t value = 1;
+
+  stopped_.store(true, std::memory_order_release);
+  while (::write(wake_fd_, &value, sizeof(value)) < 0 && errno == EINTR) { }
+  thread_->join();
+  ::close(wake_fd_);
+  ::close(epoll_fd_);
+}
+
+void reactor::remove(int fd) {
+  std::unique_ptr<fd_state> state;
+  {
+    std::lock_guard guard(mtx_);
+
+    auto it = fds_.find(fd);
+
+    if (it == fds_.end()) {
+      return;
+    }
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    state = std::move(it->second);
+    fds_.erase(it);
+  }
+  notify(state.get(), true, true);
+
+  std::lock_guard guard(mtx_);
+
+  retired_.push_back(std::move(state));
+}
+
+reactor* reactor::get() {
+  static reactor* rct = new reactor();
+
+  return rct;
+}
+
+void reactor::add(int fd) {
+  std::lock_guard guard(mtx_);
+  std::unique_ptr<fd_state>& state = fds_[fd];
+
+  if (state != nullptr) {
+    return;
+  }
+
+  int flags = ::fcntl(fd, F_GETFL);
+
+  DCPL_ASSERT(flags != -1 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0)
+      << "Unable to set non-blocking mode on file descriptor " << fd
+      << ": " << std::strerror(errno);
+
+  auto new_state = std::make_unique<fd_state>();
+  struct epoll_event event;
+
+  new_state->fd = fd;
+  std::memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.ptr = new_state.get();
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    int error = errno;
+
+    fds_.erase(fd);
+    DCPL_THROW() << "Unable to register file descriptor " << fd << " with epoll: "
+                 << std::strerror(error);
+  }
+  state = std::move(new_state);
+}
+
+reactor::fd_state* reactor::get_state(int fd) {
+  std::lock_guard guard(mtx_);
+  auto it = fds_.find(fd);
+
+  DCPL_ASSERT(it != fds_.end()) << "File descriptor " << fd
+                                << " not registered with the reactor";
+
+  return it->second.get();
+}
+
+bool reactor::consume_ready(fd_state* state, int dir) {
+  std::lock_guard guard(state->lock);
+
+  return std::exchange(state->ready[dir], false);
+}
+
+bool reactor::ready_or_enqueue(fd_state* state, int dir, detail::ready_node* node) {
+  std::lock_guard guard(state->lock);
+
+  if (std::exchange(state->ready[dir], false)) {
+    return false;
+  }
+  state->waiters[dir].push_back(node);
+
+  return true;
+}
+
+void reactor::notify(fd_state* state, bool readable, bool writable) {
+  detail::wait_node* readers = nullptr;
+  detail::wait_node* writers = nullptr;
+  {
+    std::lock_guard guard(state->lock);
+
+    // An edge with waiters is handed over to them, otherwise it is remembered for
+    // the next one.
+    if (readable) {
+      readers = state->waiters[dir_read].take();
+      state->ready[dir_read] = readers == nullptr;
+    }
+    if (writable) {
+      writers = state->waiters[dir_write].take();
+      state->ready[dir_write] = writers == nullptr;
+    }
+  }
+  resume(readers);
+  resume(writers);
+}
+
+void reactor::run() {
+  struct epoll_event events[max_events];
+
+  while (!stopped_.load(std::memory_order_acquire)) {
+    int count = ::epoll_wait(epoll_fd_, events, max_events, -1);
+
+    if (count < 0) {
+      DCPL_ASSERT(errno == EINTR) << "Failed to wait for epoll events: "
+                                  << std::strerror(errno);
+      continue;
+    }
+    for (int i = 0; i < count; ++i) {
+      fd_state* state = static_cast<fd_state*>(events[i].data.ptr);
+
+      if (state == nullptr) {
+        std::uint64_t value;
+
+        while (::read(wake_fd_, &value, sizeof(value)) < 0 && errno == EINTR) { }
+        continue;
+      }
+
+      std::uint32_t flags = events[i].events;
+      bool failed = (flags & (EPOLLERR | EPOLLHUP)) != 0;
+
+      notify(state, failed || (flags & (EPOLLIN | EPOLLRDHUP)) != 0,
+             failed || (flags & EPOLLOUT) != 0);
+    }
+
+    // The states removed before this point can no longer show up in the events
+    // fetched by the next epoll_wait() calls.
+    std::lock_guard guard(mtx_);
+
+    retired_.clear();
+  }
+}
+
+task<std::size_t> async_read_some(int fd, void* data, std::size_t size) {
+  for (;;) {
+    dcpl::ssize_t count = ::read(fd, data, size);
+
+    if (count >= 0) {
+      co_return static_cast<std::size_t>(count);
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      co_await readable(fd);
+    } else {
+      DCPL_ASSERT(errno == EINTR)
+          << "Failed to read file descriptor " << fd << ": " << std::strerror(errno);
+    }
+  }
+}
+
+task<> async_write(int fd, const void* data, std::size_t size) {
+  const char* ptr = static_cast<const char*>(data);
+
+  while (size > 0) {
+    dcpl::ssize_t count = ::write(fd, ptr, size);
+
+    if (count >= 0) {
+      ptr += count;
+      size -= static_cast<std::size_t>(count);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      co_await writable(fd);
+    } else {
+      DCPL_ASSERT(errno == EINTR)
+          << "Failed to write file descriptor " << fd << ": " << std::strerror(errno);
+    }
+  }
+}
+
+}
@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <atomic>
+#include <bit>
+#include <cmath>
 #include <cstdint>
 #include <exception>
 #include <functional>
@@ -23,7 +25,7 @@
 namespace dcpl::rcu {
 namespace {
 
-using gen_t = std::uintmax_t;
+constexpr gen_t no_generation = std::numeric_limits<gen_t>::max();
 
 struct callback {
   void* data = nullptr;
@@ -37,12 +39,25 @@ struct callback {
 struct gen_callbacks {
   gen_t gen = 0;
   std::vector<callback> callbacks;
+  std::size_t bytes = 0;
+  ns_time time{ 0 };
 };
 
 struct rcu_tls {
   std::vector<callback> callbacks;
-  gen_t generation = std::numeric_limits<gen_t>::max();
+  std::size_t callbacks_bytes = 0;
+  // The generation and enter_time fields are read by other threads (purger and
+  // stats), while holding the rcu_context lock. The enter_time is zero unless
+  // reader timing was enabled when the section was entered.
+  std::atomic<gen_t> generation = no_generation;
+  std::atomic<ns_time::rep> enter_time = 0;
   int scope_count = 0;
+  std::thread::id thread_id;
+  gen_t stall_reported = no_generation;
+};
+
+struct pin_state {
+  gen_t generation = no_generation;
 };
 
 struct rcu_context {
@@ -50,10 +65,36 @@ struct rcu_context {
   std::list<gen_callbacks> callbacks;
   std::atomic<gen_t> generation = 1;
   std::unordered_set<rcu_tls*> threads_tls;
+  std::unordered_set<pin_state*> pins;
   std::unique_ptr<periodic_task> purger;
+  std::atomic<ns_time::rep> stall_threshold = 0;
+  std::atomic<bool> reader_stats = false;
+  // Whether readers record their enter time, which is only needed by the stall
+  // detection and the reader stats (set when any of them is enabled).
+  std::atomic<bool> time_readers = false;
+  std::size_t reader_stalls = 0;
+  std::size_t purge_runs = 0;
+  std::size_t executed_callbacks = 0;
+  time_histogram grace_period;
+  time_histogram purge_time;
 };
 
-thread_local std::unique_ptr<rcu_tls> tls;
+void thread_exit();
+
+void flush_callbacks(rcu_tls* ctls);
+
+// Threads not created with thread::create() do not run the registered thread_exit()
+// and lazily create their TLS, which then unregisters itself once destroyed, so
+// that the context is never left with dangling thread entries.
+struct tls_holder {
+  ~tls_holder() {
+    thread_exit();
+  }
+
+  std::unique_ptr<rcu_tls> ptr;
+};
+
+thread_local tls_holder tls;
 
 rcu_context* initialize() {
   void thread_enter();
@@ -65,7 +106,11 @@ rcu_context* initialize() {
   rcu_context* ctx = new rcu_context();
 
   ns_time purge_period = msecs(getenv<std::int64_t>("RCU_PURGE_PERIOD", 1000));
+  ns_time stall_threshold = msecs(getenv<std::int64_t>("RCU_STALL_THRESHOLD", 0));
 
+  ctx->stall_threshold = stall_threshold.count();
+  ctx->reader_stats = getenv<int>("RCU_READER_STATS", 0) != 0;
+  ctx->time_readers = ctx->reader_stats || ctx->stall_threshold != 0;
   ctx->purger = std::make_unique<periodic_task>(purge, purge_period);
 
   return ctx;
@@ -78,40 +123,49 @@ rcu_context* get_context() {
 }
 
 void thread_enter() {
-  tls = std::make_unique<rcu_tls>();
+  tls.ptr = std::make_unique<rcu_tls>();
+  tls.ptr->thread_id = std::this_thread::get_id();
 
   rcu_context* ctx = get_context();
   std::lock_guard guard(ctx->mtx);
 
-  ctx->threads_tls.insert(tls.get());
+  ctx->threads_tls.insert(tls.ptr.get());
 }
 
 void thread_exit() {
-  flush_callbacks();
-
-  rcu_context* ctx = get_context();
-  std::lock_guard guard(ctx->mtx);
+  if (tls.ptr == nullptr) {
+    return;
+  }
+  flush_callbacks(tls.ptr.get());
+  {
+    rcu_context* ctx = get_context();
+    std::lock_guard guard(ctx->mtx);
 
-  ctx->threads_tls.erase(tls.get());
+    ctx->threads_tls.erase(tls.ptr.get());
+  }
+  tls.ptr.reset();
 }
 
 rcu_tls* get_tls() {
-  if (tls == nullptr) [[unlikely]] {
+  if (tls.ptr == nullptr) [[unlikely]] {
     thread_enter();
   }
 
-  return tls.get();
+  return tls.ptr.get();
 }
 
 gen_t get_oldest_generation(rcu_context* ctx, rcu_tls* ctls) {
   // Must be called with ctx->mtx locked.
-  gen_t mingen = std::numeric_limits<gen_t>::max();
+  gen_t mingen = no_generation;
 
   for (auto rtls : ctx->threads_tls) {
     if (ctls != rtls) {
-      mingen = std::min(mingen, rtls->generation);
+      mingen = std::min(mingen, rtls->generation.load());
     }
   }
+  for (auto cpin : ctx->pins) {
+    mingen = std::min(mingen, cpin->generation);
+  }
 
   return mingen;
 }
@@ -121,8 +175,10 @@ void flush_callbacks(rcu_tls* ctls) {
     rcu_context* ctx = get_context();
     std::lock_guard guard(ctx->mtx);
 
-    ctx->callbacks.emplace_back(ctx->generation.load() , std::move(ctls->callbacks));
+    ctx->callbacks.emplace_back(ctx->generation.load(), std::move(ctls->callbacks),
+                                ctls->callbacks_bytes, nstime());
     ctls->callbacks.clear();
+    ctls->callbacks_bytes = 0;
   }
 }
 
@@ -134,6 +190,7 @@ void purge_callbacks() {
   DCPL_SLOG() << "Running RCU purge at " << curgen;
 
   std::lock_guard guard(ctx->mtx);
+  ns_time start = nstime();
   gen_t mingen = get_oldest_generation(ctx, ctls);
 
   DCPL_SLOG() << "Oldest thread RCU generation is " << mingen;
@@ -144,6 +201,9 @@ void purge_callbacks() {
     if (mingen > callbacks.gen) {
       DCPL_SLOG() << "Running RCU callbacks for generation " << callbacks.gen;
 
+      ctx->grace_period.add(start - callbacks.time);
+      ctx->executed_callbacks += callbacks.callbacks.size();
+
       for (const auto& cb : callbacks.callbacks) {
         try {
           DCPL_SLOG() << "RCU callback for " << cb.data;
@@ -163,10 +223,14 @@ void purge_callbacks() {
       ++it;
     }
   }
+
+  ctx->purge_runs += 1;
+  ctx->purge_time.add(nstime() - start);
 }
 
 void purge() {
   purge_callbacks();
+  check_stalls();
 
   // When the RCU callbacks are called from within the purge_callbacks() API, they
   // might issue more callbacks, which will be queued in the purger thread. So here
@@ -180,11 +244,52 @@ void flush_callbacks() {
   flush_callbacks(get_tls());
 }
 
+void check_stalls() {
+  rcu_context* ctx = get_context();
+  ns_time threshold{ ctx->stall_threshold.load() };
+
+  if (threshold.count() == 0) {
+    return;
+  }
+
+  std::lock_guard guard(ctx->mtx);
+  ns_time now = nstime();
+
+  for (auto rtls : ctx->threads_tls) {
+    gen_t gen = rtls->generation.load();
+
+    if (gen == no_generation || gen == rtls->stall_reported) {
+      continue;
+    }
+
+    ns_time enter_time{ rtls->enter_time.load(std::memory_order_relaxed) };
+
+    if (enter_time.count() == 0) {
+      continue;
+    }
+
+    ns_time held_time = now - enter_time;
+
+    if (held_time > threshold) {
+      DCPL_WLOG() << "RCU reader stall: thread " << rtls->thread_id
+                  << " has been holding generation " << gen << " for "
+                  << from_nsecs(held_time) << " seconds";
+
+      rtls->stall_reported = gen;
+      ctx->reader_stalls += 1;
+    }
+  }
+}
+
 void enter() {
   rcu_context* ctx = get_context();
   rcu_tls* ctls = get_tls();
 
   if (ctls->scope_count == 0) [[likely]] {
+    ns_time::rep enter_time =
+        ctx->time_readers.load(std::memory_order_relaxed) ? nstime().count() : 0;
+
+    ctls->enter_time.store(enter_time, std::memory_order_relaxed);
     ctls->generation = ctx->generation.load();
   }
   ctls->scope_count += 1;
@@ -196,14 +301,15 @@ void exit() {
   ctls->scope_count -= 1;
   if (ctls->scope_count == 0) [[likely]] {
     flush_callbacks(ctls);
-    ctls->generation = std::numeric_limits<gen_t>::max();
+    ctls->generation = no_generation;
   }
 }
 
-void enqueue_callback(void* data, void (*fn)(void*)) {
+void enqueue_callback(void* data, void (*fn)(void*), std::size_t size) {
   rcu_tls* ctls = get_tls();
 
   ctls->callbacks.emplace_back(data, fn);
+  ctls->callbacks_bytes += size;
 
   DCPL_SLOG() << "Pointer added to the RCU queue: " << data;
 }
@@ -234,5 +340,108 @@ void synchronize() {
   DCPL_VLOG() << "Exiting RCU synchronize for thread " << this_id;
 }
 
+void time_histogram::add(ns_time value) {
+  std::int64_t usecs = value.count() / 1000;
+  std::size_t bucket = usecs > 0 ?
+      static_cast<std::size_t>(std::bit_width(static_cast<std::uint64_t>(usecs))) - 1 : 0;
+
+  buckets[std::min(bucket, num_buckets - 1)] += 1;
+  count += 1;
+  total += value;
+  max = std::max(max, value);
 }
 
+ns_time time_histogram::percentile(double pct) const {
+  std::size_t target = std::max<std::size_t>(
+      static_cast<std::size_t>(std::ceil(pct * static_cast<double>(count))), 1);
+  std::size_t current = 0;
+
+  for (std::size_t i = 0; i < num_buckets; ++i) {
+    current += buckets[i];
+    if (current >= target) {
+      // Report the upper bound of the bucket, capped by the observed maximum.
+      return std::min(max, usecs(static_cast<ns_time::rep>(1) << (i + 1)));
+    }
+  }
+
+  return max;
+}
+
+stats get_stats() {
+  rcu_context* ctx = get_context();
+  stats rstats;
+
+  rstats.generation = ctx->generation.load();
+
+  std::lock_guard guard(ctx->mtx);
+  ns_time now = nstime();
+
+  rstats.pending.reserve(ctx->callbacks.size());
+  for (const auto& callbacks : ctx->callbacks) {
+    rstats.pending.push_back({ callbacks.gen, callbacks.callbacks.size(),
+                               callbacks.bytes, now - callbacks.time });
+    rstats.pending_callbacks += callbacks.callbacks.size();
+    rstats.pending_bytes += callbacks.bytes;
+  }
+  rstats.active_pins = ctx->pins.size();
+  rstats.reader_stalls = ctx->reader_stalls;
+  rstats.purge_runs = ctx->purge_runs;
+  rstats.executed_callbacks = ctx->executed_callbacks;
+  rstats.grace_period = ctx->grace_period;
+  rstats.purge_time = ctx->purge_time;
+
+  for (auto rtls : ctx->threads_tls) {
+    gen_t gen = rtls->generation.load();
+
+    if (gen != no_generation &&
+        (!rstats.oldest_reader || gen < rstats.oldest_reader->generation)) {
+      ns_time enter_time{ rtls->enter_time.load(std::memory_order_relaxed) };
+      ns_time held_time = enter_time.count() != 0 ? now - enter_time : ns_time{ 0 };
+
+      rstats.oldest_reader = reader_stats{ rtls->thread_id, gen, held_time };
+    }
+  }
+
+  return rstats;
+}
+
+pin::pin() {
+  rcu_context* ctx = get_context();
+  pin_state* state = new pin_state();
+  std::lock_guard guard(ctx->mtx);
+
+  state->generation = ctx->generation.load();
+  ctx->pins.insert(state);
+  handle_ = state;
+}
+
+pin::~pin() {
+  if (handle_ != nullptr) {
+    rcu_context* ctx = get_context();
+    pin_state* state = static_cast<pin_state*>(handle_);
+    {
+      std::lock_guard guard(ctx->mtx);
+
+      ctx->pins.erase(state);
+    }
+    delete state;
+  }
+}
+
+void set_stall_threshold(ns_time threshold) {
+  rcu_context* ctx = get_context();
+  std::lock_guard guard(ctx->mtx);
+
+  ctx->stall_threshold = threshold.count();
+  ctx->time_readers = ctx->reader_stats || threshold.count() != 0;
+}
+
+void set_reader_stats(bool enabled) {
+  rcu_context* ctx = get_context();
+  std::lock_guard guard(ctx->mtx);
+
+  ctx->reader_stats = enabled;
+  ctx->time_readers = enabled || ctx->stall_threshold != 0;
+}
+
+}
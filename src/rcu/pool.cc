@@ -0,0 +1,313 @@
+#include "dcpl/rcu/pool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "dcpl/rcu/rcu.h"
+
+namespace dcpl::rcu::pool {
+namespace {
+
+constexpr std::size_t slab_size = 64 * 1024;
+constexpr std::size_t slab_header_size = 64;
+constexpr std::size_t batch_size = 64;
+
+struct free_node {
+  free_node* next = nullptr;
+};
+
+struct slab_header {
+  std::size_t cls = 0;
+};
+
+struct node_list {
+  void push(free_node* node) {
+    node->next = head;
+    head = node;
+    count += 1;
+  }
+
+  free_node* pop() {
+    free_node* node = head;
+
+    if (node != nullptr) {
+      head = node->next;
+      count -= 1;
+    }
+
+    return node;
+  }
+
+  // Detaches the first `size` nodes of the list, returning them as a new list.
+  node_list split(std::size_t size) {
+    node_list chain;
+    free_node* tail = head;
+
+    for (std::size_t i = 1; i < size; ++i) {
+      tail = tail->next;
+    }
+    chain.head = head;
+    chain.count = size;
+    head = tail->next;
+    count -= size;
+    tail->next = nullptr;
+
+    return chain;
+  }
+
+  free_node* head = nullptr;
+  std::size_t count = 0;
+};
+
+struct depot_class {
+  std::mutex mtx;
+  std::vector<node_list> chains;
+  std::size_t free_nodes = 0;
+  std::size_t total_nodes = 0;
+};
+
+struct class_cache {
+  node_list nodes;
+  char* bump = nullptr;
+  char* bump_end = nullptr;
+  std::atomic<std::size_t> free_nodes = 0;
+};
+
+struct thread_cache;
+
+struct pool_context {
+  std::array<depot_class, num_classes> depot;
+  std::mutex mtx;
+  std::unordered_set<thread_cache*> caches;
+  std::atomic<std::size_t> slab_count = 0;
+  std::atomic<std::size_t> large_allocs = 0;
+};
+
+pool_context* get_context() {
+  static pool_context* ctx = new pool_context();
+
+  return ctx;
+}
+
+constexpr std::size_t class_index(std::size_t size) {
+  return size > 0 ? (size + alignment - 1) / alignment - 1 : 0;
+}
+
+constexpr std::size_t class_size(std::size_t cls) {
+  return (cls + 1) * alignment;
+}
+
+slab_header* get_slab(void* ptr) {
+  std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(ptr);
+
+  return reinterpret_cast<slab_header*>(addr & ~static_cast<std::uintptr_t>(slab_size - 1));
+}
+
+char* alloc_slab(std::size_t cls) {
+  pool_context* ctx = get_context();
+  char* slab = static_cast<char*>(operator new(slab_size, std::align_val_t(slab_size)));
+
+  new (slab) slab_header{ cls };
+  ctx->slab_count += 1;
+
+  depot_class& dclass = ctx->depot[cls];
+  std::lock_guard guard(dclass.mtx);
+
+  dclass.total_nodes += (slab_size - slab_header_size) / class_size(cls);
+
+  return slab;
+}
+
+struct thread_cache {
+  thread_cache() {
+    pool_context* ctx = get_context();
+    std::lock_guard guard(ctx->mtx);
+
+    ctx->caches.insert(this);
+  }
+
+  ~thread_cache() {
+    pool_context* ctx = get_context();
+
+    for (std::size_t cls = 0; cls < num_classes; ++cls) {
+      class_cache& ccache = classes[cls];
+      std::size_t node_size = class_size(cls);
+
+      for (; ccache.bump + node_size <= ccache.bump_end; ccache.bump += node_size) {
+        ccache.nodes.push(reinterpret_cast<free_node*>(ccache.bump));
+      }
+      if (ccache.nodes.count > 0) {
+        depot_class& dclass = ctx->depot[cls];
+        std::lock_guard guard(dclass.mtx);
+
+        dclass.free_nodes += ccache.nodes.count;
+        dclass.chains.push_back(std::exchange(ccache.nodes, node_list()));
+      }
+    }
+
+    std::lock_guard guard(ctx->mtx);
+
+    ctx->caches.erase(this);
+  }
+
+  void* allocate(std::size_t cls) {
+    class_cache& ccache = classes[cls];
+    free_node* node = ccache.nodes.pop();
+
+    if (node == nullptr) [[unlikely]] {
+      std::size_t node_size = class_size(cls);
+
+      if (ccache.bump + node_size > ccache.bump_end && !refill(cls)) {
+        char* slab = alloc_slab(cls);
+
+        ccache.bump = slab + slab_header_size;
+        ccache.bump_end = slab + slab_size;
+        ccache.free_nodes.store((slab_size - slab_header_size) / node_size,
+                                std::memory_order_relaxed);
+      }
+
+      node = ccache.nodes.pop();
+      if (node == nullptr) {
+        node = reinterpret_cast<free_node*>(ccache.bump);
+        ccache.bump += node_size;
+      }
+    }
+    ccache.free_nodes.store(ccache.free_nodes.load(std::memory_order_relaxed) - 1,
+                            std::memory_order_relaxed);
+
+    return node;
+  }
+
+  void deallocate(void* ptr, std::size_t cls) {
+    class_cache& ccache = classes[cls];
+
+    ccache.nodes.push(reinterpret_cast<free_node*>(ptr));
+    if (ccache.nodes.count >= 2 * batch_size) [[unlikely]] {
+      depot_class& dclass = get_context()->depot[cls];
+      node_list chain = ccache.nodes.split(batch_size);
+      std::lock_guard guard(dclass.mtx);
+
+      dclass.free_nodes += chain.count;
+      dclass.chains.push_back(chain);
+    }
+    ccache.free_nodes.store(ccache.nodes.count + bump_count(cls),
+                            std::memory_order_relaxed);
+  }
+
+  bool refill(std::size_t cls) {
+    class_cache& ccache = classes[cls];
+    depot_class& dclass = get_context()->depot[cls];
+    std::lock_guard guard(dclass.mtx);
+
+    if (dclass.chains.empty()) {
+      return false;
+    }
+
+    ccache.nodes = dclass.chains.back();
+    dclass.chains.pop_back();
+    dclass.free_nodes -= ccache.nodes.count;
+    ccache.free_nodes.store(ccache.nodes.count + bump_count(cls),
+                            std::memory_order_relaxed);
+
+    return true;
+  }
+
+  std::size_t bump_count(std::size_t cls) const {
+    const class_cache& ccache = classes[cls];
+
+    return static_cast<std::size_t>(ccache.bump_end - ccache.bump) / class_size(cls);
+  }
+
+  std::array<class_cache, num_classes> classes;
+};
+
+thread_cache& get_cache() {
+  static thread_local thread_cache cache;
+
+  return cache;
+}
+
+void release_node(void* ptr) {
+  get_cache().deallocate(ptr, get_slab(ptr)->cls);
+}
+
+void release_large(void* ptr) {
+  operator delete(ptr);
+  get_context()->large_allocs -= 1;
+}
+
+}
+
+void* allocate(std::size_t size) {
+  if (size > max_size) [[unlikely]] {
+    void* ptr = operator new(size);
+
+    get_context()->large_allocs += 1;
+
+    return ptr;
+  }
+
+  return get_cache().allocate(class_index(size));
+}
+
+void deallocate(void* ptr, std::size_t size) {
+  if (size > max_size) [[unlikely]] {
+    release_large(ptr);
+  } else {
+    release_node(ptr);
+  }
+}
+
+void retire(void* ptr, std::size_t size) {
+  if (size > max_size) [[unlikely]] {
+    enqueue_callback(ptr, release_large, size);
+  } else {
+    enqueue_callback(ptr, release_node, size);
+  }
+}
+
+stats get_stats() {
+  pool_context* ctx = get_context();
+  stats pstats;
+
+  pstats.slab_count = ctx->slab_count.load();
+  pstats.slab_bytes = pstats.slab_count * slab_size;
+  pstats.large_allocs = ctx->large_allocs.load();
+  pstats.classes.resize(num_classes);
+
+  std::lock_guard guard(ctx->mtx);
+
+  for (std::size_t cls = 0; cls < num_classes; ++cls) {
+    class_stats& cstats = pstats.classes[cls];
+    depot_class& dclass = ctx->depot[cls];
+
+    cstats.node_size = class_size(cls);
+    {
+      std::lock_guard dguard(dclass.mtx);
+
+      cstats.total_nodes = dclass.total_nodes;
+      cstats.free_nodes = dclass.free_nodes;
+    }
+    for (auto cache : ctx->caches) {
+      cstats.free_nodes += cache->classes[cls].free_nodes.load(std::memory_order_relaxed);
+    }
+    // Thread caches counters are read without stopping their owners, so make sure
+    // a racy read does not lead to nonsensical results.
+    cstats.free_nodes = std::min(cstats.free_nodes, cstats.total_nodes);
+
+    pstats.total_nodes += cstats.total_nodes;
+    pstats.free_nodes += cstats.free_nodes;
+  }
+  pstats.used_nodes = pstats.total_nodes - pstats.free_nodes;
+
+  return pstats;
+}
+
+}
@@ -1,13 +1,19 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <iterator>
 #include <list>
+#include <map>
+#include <mutex>
 #include <numbers>
+#include <numeric>
 #include <random>
+#include <set>
 #include <sstream>
 #include <string>
 #include <tuple>
@@ -16,29 +22,56 @@
 #include "gtest/gtest.h"
 
 #include "dcpl/any.h"
+#include "dcpl/archive.h"
 #include "dcpl/bfloat16.h"
 #include "dcpl/cleanup.h"
+#include "dcpl/coro/channel.h"
+#include "dcpl/coro/condition_variable.h"
 #include "dcpl/coro/coro.h"
+#include "dcpl/coro/event.h"
+#include "dcpl/coro/file_io.h"
+#include "dcpl/coro/frame_pool.h"
+#include "dcpl/coro/io_ring.h"
+#include "dcpl/coro/mutex.h"
+#include "dcpl/coro/reactor.h"
+#include "dcpl/coro/scheduler.h"
+#include "dcpl/coro/semaphore.h"
+#include "dcpl/coro/shared_mutex.h"
+#include "dcpl/coro/task.h"
+#include "dcpl/coro/timer.h"
 #include "dcpl/coro/utils.h"
 #include "dcpl/dyn_tensor.h"
+#include "dcpl/enhanced_suffix_array.h"
 #include "dcpl/env.h"
 #include "dcpl/file.h"
+#include "dcpl/fm_index.h"
 #include "dcpl/fs.h"
+#include "dcpl/generalized_suffix_array.h"
 #include "dcpl/hash.h"
 #include "dcpl/ivector.h"
 #include "dcpl/json/json.h"
 #include "dcpl/logging.h"
 #include "dcpl/memory.h"
 #include "dcpl/multi_merge_sort.h"
+#include "dcpl/os.h"
 #include "dcpl/periodic_task.h"
+#include "dcpl/rcu/map.h"
+#include "dcpl/rcu/pointers.h"
+#include "dcpl/rcu/pool.h"
 #include "dcpl/rcu/rcu.h"
+#include "dcpl/rcu/segmented_vector.h"
+#include "dcpl/rcu/sharded_unordered_map.h"
 #include "dcpl/rcu/unordered_map.h"
 #include "dcpl/rcu/vector.h"
+#include "dcpl/seqlock_map.h"
 #include "dcpl/sequence.h"
+#include "dcpl/sequence_index.h"
 #include "dcpl/stdns_override.h"
 #include "dcpl/storage_span.h"
 #include "dcpl/string_formatter.h"
 #include "dcpl/suffix_array.h"
+#include "dcpl/suffix_array_sample.h"
+#include "dcpl/suffix_array_stats.h"
 #include "dcpl/temp_file.h"
 #include "dcpl/temp_path.h"
 #include "dcpl/thread.h"
@@ -545,6 +578,544 @@ TEST(Coro, SelfPromise) {
   EXPECT_EQ(cfn.value(), static_cast<void*>(&cfn.promise()));
 }
 
+dcpl::coro::pooled_coro<int> CoroPooledCounter(int count) {
+  for (int i = 0; i < count; ++i) {
+    co_yield i;
+  }
+}
+
+TEST(CoroFramePool, Stats) {
+  const int num_calls = 100;
+  dcpl::coro::frame_pool::stats bstats = dcpl::coro::frame_pool::get_stats();
+  int sum = 0;
+
+  for (int n = 0; n < num_calls; ++n) {
+    auto counter = CoroPooledCounter(10);
+
+    while (std::optional<int> value = counter.next_value()) {
+      sum += *value;
+    }
+  }
+  EXPECT_EQ(sum, num_calls * 45);
+
+  dcpl::coro::frame_pool::stats astats = dcpl::coro::frame_pool::get_stats();
+
+  EXPECT_EQ(astats.allocs - bstats.allocs, num_calls);
+  EXPECT_GE(astats.hits - bstats.hits, num_calls - 1);
+  EXPECT_GT(astats.hit_rate(), 0.0);
+  EXPECT_GE(astats.cached_frames, 1);
+}
+
+dcpl::coro::coro<dcpl::coro::no_value, std::suspend_always, std::suspend_never>
+CoroYielder(dcpl::coro::scheduler* sched, int count, std::atomic<int>* counter,
+            std::atomic<int>* done) {
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(dcpl::coro::scheduler::current(), sched);
+    counter->fetch_add(1);
+    co_await sched->yield();
+  }
+  done->fetch_add(1);
+  done->notify_one();
+}
+
+TEST(CoroScheduler, Yield) {
+  const int num_coros = 1000;
+  const int num_yields = 100;
+  std::atomic<int> counter = 0;
+  std::atomic<int> done = 0;
+  dcpl::coro::scheduler sched(4);
+
+  EXPECT_EQ(sched.num_threads(), 4);
+  EXPECT_EQ(dcpl::coro::scheduler::current(), nullptr);
+
+  for (int i = 0; i < num_coros; ++i) {
+    auto coro = CoroYielder(&sched, num_yields, &counter, &done);
+
+    sched.spawn(coro.release());
+  }
+  for (int count = done.load(); count < num_coros; count = done.load()) {
+    done.wait(count);
+  }
+
+  EXPECT_EQ(counter.load(), num_coros * num_yields);
+
+  dcpl::coro::scheduler::stats sstats = sched.get_stats();
+
+  EXPECT_EQ(sstats.num_threads, 4);
+  EXPECT_EQ(sstats.injected, num_coros);
+}
+
+dcpl::coro::task<int> CoroAdd(dcpl::coro::scheduler* sched, int a, int b) {
+  co_await sched->schedule();
+
+  co_return a + b;
+}
+
+dcpl::coro::task<> CoroThrow(dcpl::coro::scheduler* sched) {
+  co_await sched->schedule();
+
+  throw std::runtime_error("Task error");
+}
+
+dcpl::coro::task<int> CoroSum(dcpl::coro::scheduler* sched, int count) {
+  std::vector<dcpl::coro::task<int>> tasks;
+
+  for (int i = 0; i < count; ++i) {
+    tasks.push_back(CoroAdd(sched, i, 1));
+  }
+
+  std::vector<int> results = co_await dcpl::coro::when_all(std::move(tasks));
+  int sum = 0;
+
+  for (int value : results) {
+    sum += value;
+  }
+
+  co_return sum + co_await CoroAdd(sched, 0, 0);
+}
+
+dcpl::coro::task<int> CoroValue(int value) {
+  co_return value;
+}
+
+TEST(CoroTask, WhenAll) {
+  dcpl::coro::scheduler sched(4);
+
+  EXPECT_EQ(dcpl::coro::sync_wait(CoroSum(&sched, 100)), 5050);
+
+  auto [a, b, c] = dcpl::coro::sync_wait(
+      dcpl::coro::when_all(CoroAdd(&sched, 1, 2), CoroValue(7), CoroAdd(&sched, 3, 4)));
+
+  EXPECT_EQ(a, 3);
+  EXPECT_EQ(b, 7);
+  EXPECT_EQ(c, 7);
+
+  EXPECT_THROW(dcpl::coro::sync_wait(CoroThrow(&sched)), std::runtime_error);
+  EXPECT_THROW(dcpl::coro::sync_wait(
+      dcpl::coro::when_all(CoroAdd(&sched, 1, 2), CoroThrow(&sched))),
+               std::runtime_error);
+}
+
+TEST(CoroTask, WhenAny) {
+  std::vector<dcpl::coro::task<int>> tasks;
+
+  for (int i = 0; i < 4; ++i) {
+    tasks.push_back(CoroValue(10 * i));
+  }
+
+  dcpl::coro::when_any_result<int> result =
+      dcpl::coro::sync_wait(dcpl::coro::when_any(std::move(tasks)));
+
+  EXPECT_EQ(result.index, 0);
+  EXPECT_EQ(result.value, 0);
+}
+
+dcpl::coro::task<> CoroLockedAdd(dcpl::coro::scheduler* sched, dcpl::coro::mutex* mtx,
+                                 int count, int* counter) {
+  co_await sched->schedule();
+
+  for (int i = 0; i < count; ++i) {
+    auto guard = co_await mtx->lock_guard();
+
+    *counter += 1;
+    if (i % 8 == 0) {
+      co_await sched->yield();
+    }
+  }
+}
+
+TEST(CoroSync, Mutex) {
+  const int num_coros = 16;
+  const int num_adds = 1000;
+  dcpl::coro::scheduler sched(4);
+  dcpl::coro::mutex mtx;
+  int counter = 0;
+  std::vector<dcpl::coro::task<>> tasks;
+
+  for (int i = 0; i < num_coros; ++i) {
+    tasks.push_back(CoroLockedAdd(&sched, &mtx, num_adds, &counter));
+  }
+  dcpl::coro::sync_wait(dcpl::coro::when_all(std::move(tasks)));
+
+  EXPECT_EQ(counter, num_coros * num_adds);
+  EXPECT_TRUE(mtx.try_lock());
+  EXPECT_FALSE(mtx.try_lock());
+  mtx.unlock();
+}
+
+dcpl::coro::task<> CoroConsumer(dcpl::coro::scheduler* sched, dcpl::coro::mutex* mtx,
+                                dcpl::coro::condition_variable* cv,
+                                std::deque<int>* queue, int count, int* sum) {
+  co_await sched->schedule();
+
+  for (int i = 0; i < count; ++i) {
+    co_await mtx->lock();
+    co_await cv->wait(mtx, [queue]() { return !queue->empty(); });
+
+    *sum += queue->front();
+    queue->pop_front();
+    mtx->unlock();
+  }
+}
+
+dcpl::coro::task<> CoroProducer(dcpl::coro::scheduler* sched, dcpl::coro::mutex* mtx,
+                                dcpl::coro::condition_variable* cv,
+                                std::deque<int>* queue, int count) {
+  co_await sched->schedule();
+
+  for (int i = 0; i < count; ++i) {
+    co_await mtx->lock();
+    queue->push_back(i);
+    mtx->unlock();
+    cv->notify_one();
+  }
+}
+
+TEST(CoroSync, ConditionVariable) {
+  dcpl::coro::scheduler sched(4);
+  dcpl::coro::mutex mtx;
+  dcpl::coro::condition_variable cv;
+  std::deque<int> queue;
+  int sum = 0;
+  std::vector<dcpl::coro::task<>> tasks;
+
+  for (int i = 0; i < 4; ++i) {
+    tasks.push_back(CoroConsumer(&sched, &mtx, &cv, &queue, 250, &sum));
+  }
+  for (int i = 0; i < 2; ++i) {
+    tasks.push_back(CoroProducer(&sched, &mtx, &cv, &queue, 500));
+  }
+  dcpl::coro::sync_wait(dcpl::coro::when_all(std::move(tasks)));
+
+  EXPECT_EQ(sum, 2 * (499 * 500) / 2);
+  EXPECT_TRUE(queue.empty());
+}
+
+dcpl::coro::task<> CoroLimited(dcpl::coro::scheduler* sched, dcpl::coro::semaphore* sem,
+                               std::atomic<int>* active, int limit) {
+  co_await sched->schedule();
+
+  for (int i = 0; i < 100; ++i) {
+    co_await sem->acquire();
+    EXPECT_LE(active->fetch_add(1) + 1, limit);
+    co_await sched->yield();
+    active->fetch_sub(1);
+    sem->release();
+  }
+}
+
+TEST(CoroSync, Semaphore) {
+  const int limit = 3;
+  dcpl::coro::scheduler sched(4);
+  dcpl::coro::semaphore sem(limit);
+  std::atomic<int> active = 0;
+  std::vector<dcpl::coro::task<>> tasks;
+
+  for (int i = 0; i < 16; ++i) {
+    tasks.push_back(CoroLimited(&sched, &sem, &active, limit));
+  }
+  dcpl::coro::sync_wait(dcpl::coro::when_all(std::move(tasks)));
+
+  EXPECT_EQ(sem.count(), limit);
+  EXPECT_TRUE(sem.try_acquire());
+  sem.release();
+}
+
+dcpl::coro::task<> CoroReadWrite(dcpl::coro::scheduler* sched,
+                                 dcpl::coro::shared_mutex* mtx, bool writer,
+                                 std::array<int, 2>* values) {
+  co_await sched->schedule();
+
+  for (int i = 0; i < 200; ++i) {
+    if (writer) {
+      co_await mtx->lock();
+      (*values)[0] += 1;
+      co_await sched->yield();
+      (*values)[1] += 1;
+      mtx->unlock();
+    } else {
+      co_await mtx->lock_shared();
+      EXPECT_EQ((*values)[0], (*values)[1]);
+      co_await sched->yield();
+      mtx->unlock_shared();
+    }
+  }
+}
+
+TEST(CoroSync, SharedMutex) {
+  dcpl::coro::scheduler sched(4);
+  dcpl::coro::shared_mutex mtx;
+  std::array<int, 2> values{0, 0};
+  std::vector<dcpl::coro::task<>> tasks;
+
+  for (int i = 0; i < 12; ++i) {
+    tasks.push_back(CoroReadWrite(&sched, &mtx, i % 3 == 0, &values));
+  }
+  dcpl::coro::sync_wait(dcpl::coro::when_all(std::move(tasks)));
+
+  EXPECT_EQ(values[0], 4 * 200);
+  EXPECT_EQ(values[1], 4 * 200);
+  EXPECT_TRUE(mtx.try_lock_shared());
+  EXPECT_FALSE(mtx.try_lock());
+  mtx.unlock_shared();
+  EXPECT_TRUE(mtx.try_lock());
+  mtx.unlock();
+}
+
+dcpl::coro::task<> CoroEventWaiter(dcpl::coro::scheduler* sched, dcpl::coro::event* ev,
+                                   std::atomic<int>* woken) {
+  co_await sched->schedule();
+  co_await ev->wait();
+  woken->fetch_add(1);
+}
+
+TEST(CoroSync, Event) {
+  dcpl::coro::scheduler sched(2);
+  dcpl::coro::event ev(3);
+  std::atomic<int> woken = 0;
+  std::vector<dcpl::coro::task<>> tasks;
+
+  for (int i = 0; i < 8; ++i) {
+    tasks.push_back(CoroEventWaiter(&sched, &ev, &woken));
+  }
+
+  auto waiter = [&]() -> dcpl::coro::task<> {
+    co_await dcpl::coro::when_all(std::move(tasks));
+  };
+  auto setter = [&]() -> dcpl::coro::task<> {
+    co_await sched.schedule();
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_FALSE(ev.is_set());
+      ev.set();
+    }
+  };
+
+  dcpl::coro::sync_wait(dcpl::coro::when_all(waiter(), setter()));
+
+  EXPECT_EQ(woken.load(), 8);
+  EXPECT_TRUE(ev.is_set());
+  ev.clear();
+  EXPECT_FALSE(ev.is_set());
+}
+
+dcpl::coro::task<> CoroChannelSender(dcpl::coro::scheduler* sched,
+                                     dcpl::coro::channel<int>* chan, int count) {
+  co_await sched->schedule();
+
+  for (int i = 0; i < count; ++i) {
+    EXPECT_TRUE(co_await chan->send(i));
+  }
+}
+
+dcpl::coro::task<long> CoroChannelReceiver(dcpl::coro::scheduler* sched,
+                                           dcpl::coro::channel<int>* chan, bool batched) {
+  co_await sched->schedule();
+
+  long sum = 0;
+
+  if (batched) {
+    std::vector<int> values;
+
+    while (co_await chan->recv_many(&values, 16) > 0) {
+      for (int value : values) {
+        sum += value;
+      }
+      values.clear();
+    }
+  } else {
+    while (std::optional<int> value = co_await chan->recv()) {
+      sum += *value;
+    }
+  }
+
+  co_return sum;
+}
+
+TEST(CoroChannel, SendRecv) {
+  const int num_senders = 4;
+  const int num_values = 1000;
+  dcpl::coro::scheduler sched(4);
+  dcpl::coro::channel<int> chan(8);
+
+  EXPECT_EQ(chan.capacity(), 8);
+
+  auto sender = [&]() -> dcpl::coro::task<> {
+    std::vector<dcpl::coro::task<>> tasks;
+
+    for (int i = 0; i < num_senders; ++i) {
+      tasks.push_back(CoroChannelSender(&sched, &chan, num_values));
+    }
+    co_await dcpl::coro::when_all(std::move(tasks));
+    chan.close();
+  };
+
+  auto [sent, sum1, sum2, sum3] = dcpl::coro::sync_wait(
+      dcpl::coro::when_all(sender(),
+                           CoroChannelReceiver(&sched, &chan, false),
+                           CoroChannelReceiver(&sched, &chan, false),
+                           CoroChannelReceiver(&sched, &chan, true)));
+
+  EXPECT_EQ(sum1 + sum2 + sum3, num_senders * (num_values * (num_values - 1L) / 2));
+
+  int value = 1;
+
+  EXPECT_TRUE(chan.closed());
+  EXPECT_FALSE(chan.try_send(&value));
+  EXPECT_FALSE(chan.try_recv());
+
+  // Values need not be default constructible.
+  struct no_default {
+    explicit no_default(int value) :
+        value(value) {
+    }
+
+    int value;
+  };
+
+  dcpl::coro::channel<no_default> nd_chan(4);
+  no_default nd_value(3);
+
+  EXPECT_TRUE(nd_chan.try_send(&nd_value));
+  EXPECT_TRUE(nd_chan.try_send(&nd_value));
+  EXPECT_EQ(nd_chan.try_recv()->value, 3);
+  EXPECT_EQ(dcpl::coro::sync_wait([](dcpl::coro::channel<no_default>* ch)
+                                  -> dcpl::coro::task<int> {
+    co_return (co_await ch->recv())->value;
+  }(&nd_chan)), 3);
+  EXPECT_TRUE(nd_chan.try_send(&nd_value));
+  nd_chan.close();
+}
+
+dcpl::coro::task<dcpl::ns_time> CoroSleeper(dcpl::ns_time duration) {
+  co_await dcpl::coro::schedule();
+
+  dcpl::ns_time start = dcpl::nstime();
+
+  co_await dcpl::coro::sleep_for(duration);
+
+  co_return dcpl::nstime() - start;
+}
+
+TEST(CoroTimer, Sleep) {
+  const int num_sleepers = 200;
+  std::vector<dcpl::coro::task<dcpl::ns_time>> tasks;
+
+  for (int i = 0; i < num_sleepers; ++i) {
+    tasks.push_back(CoroSleeper(dcpl::msecs(1 + i % 10)));
+  }
+
+  std::vector<dcpl::ns_time> elapsed =
+      dcpl::coro::sync_wait(dcpl::coro::when_all(std::move(tasks)));
+
+  ASSERT_EQ(elapsed.size(), num_sleepers);
+  for (int i = 0; i < num_sleepers; ++i) {
+    EXPECT_GE(elapsed[i], dcpl::msecs(1 + i % 10));
+  }
+  EXPECT_EQ(dcpl::coro::timer_queue::get()->size(), 0);
+}
+
+TEST(CoroTimer, WithTimeout) {
+  dcpl::coro::event ev;
+
+  EXPECT_FALSE(dcpl::coro::sync_wait(
+      dcpl::coro::with_timeout(ev.wait(), dcpl::msecs(5))));
+  ev.set();
+  EXPECT_TRUE(dcpl::coro::sync_wait(
+      dcpl::coro::with_timeout(ev.wait(), dcpl::secs(10))));
+
+  std::optional<int> value = dcpl::coro::sync_wait(
+      dcpl::coro::with_timeout(CoroValue(17), dcpl::secs(10)));
+
+  ASSERT_TRUE(value);
+  EXPECT_EQ(*value, 17);
+  EXPECT_EQ(dcpl::coro::timer_queue::get()->size(), 0);
+}
+
+dcpl::coro::task<std::size_t> CoroSocketWriter(int fd, std::size_t size) {
+  co_await dcpl::coro::schedule();
+
+  std::vector<char> data(size);
+
+  for (std::size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<char>(i % 251);
+  }
+  co_await dcpl::coro::async_write(fd, data.data(), data.size());
+
+  co_return size;
+}
+
+dcpl::coro::task<std::size_t> CoroSocketReader(int fd, std::size_t size) {
+  co_await dcpl::coro::schedule();
+
+  std::vector<char> buffer(4096);
+  std::size_t count = 0;
+  std::size_t errors = 0;
+
+  for (;;) {
+    std::size_t rsize = co_await dcpl::coro::async_read_some(fd, buffer.data(),
+                                                             buffer.size());
+
+    if (rsize == 0) {
+      break;
+    }
+    for (std::size_t i = 0; i < rsize; ++i) {
+      errors += buffer[i] != static_cast<char>((count + i) % 251) ? 1 : 0;
+    }
+    count += rsize;
+    if (count == size) {
+      break;
+    }
+  }
+
+  co_return errors == 0 ? count : 0;
+}
+
+TEST(CoroReactor, SocketPair) {
+  // Large enough to fill the socket buffers, so that the writer has to wait for
+  // the descriptor to become writable again.
+  const std::size_t size = 8 * 1024 * 1024;
+  std::array<int, 2> fds = dcpl::os::socketpair();
+
+  dcpl::coro::reactor::get()->add(fds[0]);
+  dcpl::coro::reactor::get()->add(fds[1]);
+
+  auto [read_size, write_size] = dcpl::coro::sync_wait(
+      dcpl::coro::when_all(CoroSocketReader(fds[0], size),
+                           CoroSocketWriter(fds[1], size)));
+
+  EXPECT_EQ(read_size, size);
+  EXPECT_EQ(write_size, size);
+
+  dcpl::coro::reactor::get()->remove(fds[1]);
+  dcpl::os::close(fds[1]);
+
+  // The peer is gone, so the reader sees the end of file.
+  char byte;
+
+  EXPECT_EQ(dcpl::coro::sync_wait(dcpl::coro::async_read_some(fds[0], &byte, 1)), 0);
+
+  dcpl::coro::reactor::get()->remove(fds[0]);
+  dcpl::os::close(fds[0]);
+
+  // The new descriptors likely reuse the numbers of the closed ones, which must not
+  // find their stale states.
+  fds = dcpl::os::socketpair();
+  dcpl::coro::reactor::get()->add(fds[0]);
+  dcpl::coro::reactor::get()->add(fds[1]);
+
+  auto [reused_read_size, reused_write_size] = dcpl::coro::sync_wait(
+      dcpl::coro::when_all(CoroSocketReader(fds[0], size),
+                           CoroSocketWriter(fds[1], size)));
+
+  EXPECT_EQ(reused_read_size, size);
+  EXPECT_EQ(reused_write_size, size);
+
+  for (int fd : fds) {
+    dcpl::coro::reactor::get()->remove(fd);
+    dcpl::os::close(fd);
+  }
+}
+
 TEST(Memory, API) {
   static constexpr std::size_t buffer_size = 4096;
   std::unique_ptr<std::uint8_t[]> buffer =
@@ -717,6 +1288,66 @@ TEST(FileFile, Private) {
   }
 }
 
+dcpl::coro::task<int> CoroFileBlock(dcpl::file* file, std::size_t block_size,
+                                    std::size_t index) {
+  std::vector<char> wrdata(block_size, static_cast<char>('a' + index % 26));
+  std::vector<char> rddata(block_size);
+  dcpl::fileoff_t off = static_cast<dcpl::fileoff_t>(index * block_size);
+
+  co_await dcpl::coro::async_pwrite(*file, wrdata.data(), wrdata.size(), off);
+  co_await dcpl::coro::async_pread(*file, rddata.data(), rddata.size(), off);
+
+  co_return rddata == wrdata ? 1 : 0;
+}
+
+dcpl::coro::task<std::size_t> CoroRingRead(dcpl::coro::io_ring* ring, int fd,
+                                           std::vector<char>* data) {
+  co_return co_await ring->read(fd, data->data(), data->size(), 0);
+}
+
+TEST(FileFile, AsyncIO) {
+  static const std::size_t block_size = 4096;
+  static const std::size_t num_blocks = 64;
+  dcpl::temp_path tmp;
+  dcpl::file file(tmp, dcpl::file::open_read | dcpl::file::open_write |
+                  dcpl::file::open_create);
+  std::vector<dcpl::coro::task<int>> tasks;
+
+  for (std::size_t i = 0; i < num_blocks; ++i) {
+    tasks.push_back(CoroFileBlock(&file, block_size, i));
+  }
+
+  std::vector<int> results =
+      dcpl::coro::sync_wait(dcpl::coro::when_all(std::move(tasks)));
+
+  EXPECT_EQ(std::count(results.begin(), results.end(), 1), num_blocks);
+  EXPECT_EQ(file.size(), block_size * num_blocks);
+
+  dcpl::coro::io_ring::stats stats = dcpl::coro::io_ring::get()->get_stats();
+
+  EXPECT_GE(stats.submitted, 2 * num_blocks);
+  EXPECT_EQ(stats.completed, stats.submitted);
+
+  // Reads past the end of file are short, both with io_uring and with the
+  // threadpool fallback.
+  for (bool use_uring : { true, false }) {
+    dcpl::coro::io_ring ring(16, use_uring);
+    std::vector<char> data(block_size * num_blocks + 100);
+
+    EXPECT_EQ(dcpl::coro::sync_wait(CoroRingRead(&ring, file.fileno(), &data)),
+              block_size * num_blocks);
+    EXPECT_EQ(data[block_size * 3], 'd');
+  }
+
+  std::vector<char> data(block_size * num_blocks + 100);
+
+  EXPECT_THROW(dcpl::coro::sync_wait(
+      [](dcpl::file* file, std::vector<char>* data) -> dcpl::coro::task<int> {
+        co_await dcpl::coro::async_pread(*file, data->data(), data->size(), 0);
+        co_return 0;
+      }(&file, &data)), std::exception);
+}
+
 TEST(BFloat16, Precision) {
   dcpl::bfloat16 pi(std::numbers::pi);
   double err = std::fabs(std::numbers::pi - static_cast<double>(pi)) / std::numbers::pi;
@@ -831,6 +1462,101 @@ TEST(PeriodicTask, API) {
   EXPECT_GT(counter, 3);
 }
 
+TEST(Rcu, Stats) {
+  std::atomic<bool> entered = false;
+  std::atomic<bool> release = false;
+
+  auto thread_fn = [&]() {
+    dcpl::rcu::context ctx;
+
+    entered = true;
+    while (!release) {
+      dcpl::sleep_for(dcpl::msecs(1));
+    }
+  };
+
+  std::unique_ptr<std::thread> reader_thread = dcpl::thread::create(thread_fn);
+
+  while (!entered) {
+    dcpl::sleep_for(dcpl::msecs(1));
+  }
+  {
+    dcpl::rcu::context ctx;
+
+    dcpl::rcu::free_object(new std::array<char, 100>());
+  }
+
+  dcpl::rcu::stats rstats = dcpl::rcu::get_stats();
+
+  EXPECT_GE(rstats.pending_callbacks, 1);
+  EXPECT_GE(rstats.pending_bytes, 100);
+  ASSERT_TRUE(rstats.oldest_reader);
+  EXPECT_LE(rstats.oldest_reader->generation, rstats.generation);
+
+  release = true;
+  reader_thread->join();
+
+  dcpl::rcu::time_histogram hist;
+
+  hist.add(dcpl::usecs(3));
+  hist.add(dcpl::msecs(5));
+  EXPECT_EQ(hist.count, 2);
+  EXPECT_EQ(hist.buckets[1], 1);
+  EXPECT_EQ(hist.max, dcpl::msecs(5));
+  EXPECT_LE(hist.percentile(0.5), dcpl::usecs(4));
+}
+
+TEST(Rcu, StallDetection) {
+  std::atomic<bool> entered = false;
+  std::atomic<bool> release = false;
+
+  dcpl::rcu::set_stall_threshold(dcpl::msecs(5));
+
+  auto thread_fn = [&]() {
+    dcpl::rcu::context ctx;
+
+    entered = true;
+    while (!release) {
+      dcpl::sleep_for(dcpl::msecs(1));
+    }
+  };
+
+  std::size_t stalls = dcpl::rcu::get_stats().reader_stalls;
+  std::unique_ptr<std::thread> reader_thread = dcpl::thread::create(thread_fn);
+
+  while (!entered) {
+    dcpl::sleep_for(dcpl::msecs(1));
+  }
+  dcpl::sleep_for(dcpl::msecs(20));
+
+  // The stall is reported once per held generation.
+  dcpl::rcu::check_stalls();
+  dcpl::rcu::check_stalls();
+
+  dcpl::rcu::stats rstats = dcpl::rcu::get_stats();
+
+  EXPECT_EQ(rstats.reader_stalls, stalls + 1);
+  ASSERT_TRUE(rstats.oldest_reader);
+  EXPECT_GE(rstats.oldest_reader->held_time, dcpl::msecs(20));
+
+  release = true;
+  reader_thread->join();
+
+  dcpl::rcu::set_stall_threshold(dcpl::ns_time{ 0 });
+
+  // Without stall detection or reader stats, readers are not timed.
+  {
+    dcpl::rcu::context ctx;
+
+    dcpl::sleep_for(dcpl::msecs(10));
+    rstats = dcpl::rcu::get_stats();
+    ASSERT_TRUE(rstats.oldest_reader);
+    if (rstats.oldest_reader->thread_id == std::this_thread::get_id()) {
+      EXPECT_EQ(rstats.oldest_reader->held_time, dcpl::ns_time{ 0 });
+    }
+  }
+}
+
 TEST(RcuVector, Concurrency) {
   const dcpl::ns_time tick = dcpl::msecs(1);
   dcpl::rcu::vector<int> vect;
@@ -858,14 +1584,61 @@ TEST(RcuVector, Concurrency) {
   tick_thread->join();
 }
 
-TEST(RcuUnorderedMap, Concurrency) {
-  const dcpl::ns_time tick = dcpl::msecs(1);
-  const int num_inserts = 200;
-  dcpl::rcu::unordered_map<int, int> umap;
+TEST(RcuSegmentedVector, Concurrency) {
+  const dcpl::ns_time tick = dcpl::usecs(100);
+  const int num_values = 2000;
+  dcpl::rcu::segmented_vector<int> vect;
 
-  auto thread_fn = [&]() {
-    for (int i = 0; i < num_inserts; ++i) {
-      dcpl::rcu::context ctx;
+  vect.push_back(0);
+
+  const int* first = &vect[0];
+
+  auto thread_fn = [&]() {
+    for (int i = 1; i < num_values; ++i) {
+      vect.push_back(i);
+      if (i % 100 == 0) {
+        dcpl::sleep_for(tick);
+      }
+    }
+  };
+
+  std::unique_ptr<std::thread> tick_thread = dcpl::thread::create(thread_fn);
+
+  for (int i = 0; i < 200; ++i) {
+    dcpl::rcu::context ctx;
+    const auto& ivect = vect.get();
+    std::size_t size = ivect.size();
+
+    for (std::size_t n = 0; n < size; ++n) {
+      EXPECT_EQ(n, static_cast<std::size_t>(ivect[n]));
+    }
+  }
+  tick_thread->join();
+
+  EXPECT_EQ(vect.size(), num_values);
+  EXPECT_EQ(&vect[0], first);
+  EXPECT_EQ(vect.back(), num_values - 1);
+  EXPECT_TRUE(std::is_sorted(vect.begin(), vect.end()));
+
+  std::size_t count = 0;
+
+  vect.get().for_each_segment([&](std::span<const int> values) {
+    for (auto value : values) {
+      EXPECT_EQ(value, static_cast<int>(count));
+      ++count;
+    }
+  });
+  EXPECT_EQ(count, num_values);
+}
+
+TEST(RcuUnorderedMap, Concurrency) {
+  const dcpl::ns_time tick = dcpl::msecs(1);
+  const int num_inserts = 200;
+  dcpl::rcu::unordered_map<int, int> umap;
+
+  auto thread_fn = [&]() {
+    for (int i = 0; i < num_inserts; ++i) {
+      dcpl::rcu::context ctx;
 
       umap.emplace(i, i + 1);
       dcpl::sleep_for(tick + dcpl::usecs(10));
@@ -889,6 +1662,336 @@ TEST(RcuUnorderedMap, Concurrency) {
   }
 }
 
+TEST(RcuMap, API) {
+  const int num_ops = 20000;
+  dcpl::rnd_generator rgen(17);
+  std::uniform_int_distribution<int> keys(0, 2000);
+  std::map<int, int> ref_map;
+  dcpl::rcu::map<int, int> rmap;
+
+  for (int i = 0; i < num_ops; ++i) {
+    int key = keys(rgen);
+
+    if (i % 3 == 2) {
+      EXPECT_EQ(rmap.erase(key), ref_map.erase(key));
+    } else {
+      rmap.insert(std::pair<int, int>{ key, i });
+      ref_map[key] = i;
+    }
+  }
+
+  dcpl::rcu::context ctx;
+  const auto& imap = rmap.get();
+
+  EXPECT_EQ(imap.size(), ref_map.size());
+  EXPECT_TRUE(std::equal(imap.begin(), imap.end(), ref_map.begin(), ref_map.end(),
+                         [](const auto& kv, const auto& rkv) {
+                           return kv.first == rkv.first && kv.second == rkv.second;
+                         }));
+
+  for (int key = -1; key < 2002; key += 7) {
+    auto it = imap.lower_bound(key);
+    auto rit = ref_map.lower_bound(key);
+
+    EXPECT_EQ(it == imap.end(), rit == ref_map.end());
+    if (rit != ref_map.end()) {
+      EXPECT_EQ(it->first, rit->first);
+    }
+
+    auto uit = imap.upper_bound(key);
+    auto ruit = ref_map.upper_bound(key);
+
+    EXPECT_EQ(uit == imap.end(), ruit == ref_map.end());
+    if (ruit != ref_map.end()) {
+      EXPECT_EQ(uit->first, ruit->first);
+    }
+  }
+
+  std::size_t count = 0;
+
+  imap.for_each(100, 200, [&](const auto& kv) {
+    EXPECT_GE(kv.first, 100);
+    EXPECT_LT(kv.first, 200);
+    ++count;
+  });
+  EXPECT_EQ(count, std::distance(ref_map.lower_bound(100), ref_map.lower_bound(200)));
+}
+
+TEST(RcuMap, Concurrency) {
+  const int num_inserts = 2000;
+  dcpl::rcu::map<int, int> rmap;
+
+  auto thread_fn = [&]() {
+    for (int i = 0; i < num_inserts; ++i) {
+      dcpl::rcu::context ctx;
+
+      rmap.emplace(i, i + 1);
+      if (i % 4 == 0) {
+        rmap.erase(i / 2);
+      }
+    }
+  };
+
+  std::unique_ptr<std::thread> writer_thread = dcpl::thread::create(thread_fn);
+
+  for (int i = 0; i < 200; ++i) {
+    dcpl::rcu::context ctx;
+    const auto& imap = rmap.get();
+    std::size_t count = 0;
+    int prev_key = -1;
+
+    for (const auto& kv : imap) {
+      EXPECT_EQ(kv.first + 1, kv.second);
+      EXPECT_LT(prev_key, kv.first);
+      prev_key = kv.first;
+      ++count;
+    }
+    EXPECT_EQ(count, imap.size());
+  }
+  writer_thread->join();
+}
+
+TEST(RcuAtomicPtr, Update) {
+  const int num_writers = 4;
+  const int num_updates = 200;
+  dcpl::rcu::atomic_ptr<std::vector<int>> aptr(
+      dcpl::rcu::make_unique<std::vector<int>>());
+  std::vector<std::unique_ptr<std::thread>> writers;
+
+  for (int w = 0; w < num_writers; ++w) {
+    auto thread_fn = [&]() {
+      for (int i = 0; i < num_updates; ++i) {
+        aptr.update([](std::vector<int>* values) {
+          values->push_back(static_cast<int>(values->size()));
+        });
+      }
+    };
+
+    writers.push_back(dcpl::thread::create(thread_fn));
+  }
+
+  for (int i = 0; i < 200; ++i) {
+    dcpl::rcu::context ctx;
+    const std::vector<int>* values = aptr.load();
+
+    for (std::size_t n = 0; n < values->size(); ++n) {
+      EXPECT_EQ((*values)[n], static_cast<int>(n));
+    }
+  }
+  for (auto& writer : writers) {
+    writer->join();
+  }
+
+  dcpl::rcu::context ctx;
+
+  EXPECT_EQ(aptr->size(), num_writers * num_updates);
+
+  auto old = aptr.exchange(dcpl::rcu::make_unique<std::vector<int>>(3, 17));
+
+  EXPECT_EQ(old->size(), num_writers * num_updates);
+  EXPECT_EQ(aptr->size(), 3);
+}
+
+TEST(RcuPool, Stats) {
+  const std::size_t num_nodes = 1000;
+  std::vector<void*> nodes;
+
+  for (std::size_t i = 0; i < num_nodes; ++i) {
+    nodes.push_back(dcpl::rcu::pool::allocate(24));
+  }
+
+  dcpl::rcu::pool::stats astats = dcpl::rcu::pool::get_stats();
+
+  EXPECT_GE(astats.used_nodes, num_nodes);
+  EXPECT_GE(astats.classes[1].total_nodes - astats.classes[1].free_nodes, num_nodes);
+  EXPECT_EQ(astats.classes[1].node_size, 32);
+  EXPECT_GT(astats.slab_bytes, 0);
+
+  for (auto node : nodes) {
+    dcpl::rcu::pool::deallocate(node, 24);
+  }
+
+  dcpl::rcu::pool::stats fstats = dcpl::rcu::pool::get_stats();
+
+  EXPECT_LE(fstats.used_nodes + num_nodes, astats.used_nodes);
+
+  void* large = dcpl::rcu::pool::allocate(dcpl::rcu::pool::max_size + 1);
+
+  EXPECT_EQ(dcpl::rcu::pool::get_stats().large_allocs, fstats.large_allocs + 1);
+
+  dcpl::rcu::pool::deallocate(large, dcpl::rcu::pool::max_size + 1);
+}
+
+TEST(RcuUnorderedMap, ParallelScan) {
+  const int num_values = 100000;
+  dcpl::rcu::unordered_map<int, int> umap;
+
+  for (int i = 0; i < num_values; ++i) {
+    umap.emplace(i, 2 * i);
+  }
+
+  std::atomic<std::int64_t> sum = 0;
+
+  umap.parallel_for_each([&](const auto& kv) {
+    EXPECT_EQ(2 * kv.first, kv.second);
+    sum += kv.second;
+  });
+  EXPECT_EQ(sum, static_cast<std::int64_t>(num_values) * (num_values - 1));
+
+  for (std::size_t num_threads : { 1, 3 }) {
+    sum = 0;
+    umap.parallel_for_each([&](const auto& kv) { sum += kv.second; }, num_threads);
+    EXPECT_EQ(sum, static_cast<std::int64_t>(num_values) * (num_values - 1));
+  }
+
+  auto snapshot = umap.snapshot();
+  std::atomic<std::size_t> count = 0;
+  auto thread_fn = [&]() {
+    snapshot.parallel_for_each([&](const auto& kv) {
+      EXPECT_EQ(2 * kv.first, kv.second);
+      count += 1;
+    });
+  };
+
+  std::unique_ptr<std::thread> scan_thread = dcpl::thread::create(thread_fn);
+
+  for (int i = 0; i < num_values; i += 2) {
+    umap.erase(i);
+  }
+  scan_thread->join();
+
+  EXPECT_GE(count, num_values / 2);
+  EXPECT_LE(count, num_values);
+  EXPECT_EQ(umap.size(), num_values / 2);
+  EXPECT_EQ(dcpl::rcu::get_stats().active_pins, 1);
+}
+
+TEST(RcuShardedUnorderedMap, Concurrency) {
+  const int num_writers = 4;
+  const int num_inserts = 1000;
+  dcpl::rcu::sharded_unordered_map<int, int> umap(8);
+
+  EXPECT_EQ(umap.num_shards(), 8);
+
+  std::vector<std::unique_ptr<std::thread>> writers;
+
+  for (int w = 0; w < num_writers; ++w) {
+    auto thread_fn = [&, w]() {
+      for (int i = 0; i < num_inserts; ++i) {
+        dcpl::rcu::context ctx;
+
+        umap.emplace(w * num_inserts + i, w * num_inserts + i + 1);
+      }
+    };
+
+    writers.push_back(dcpl::thread::create(thread_fn));
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    dcpl::rcu::context ctx;
+
+    umap.for_each([](const auto& kv) {
+      EXPECT_EQ(kv.first + 1, kv.second);
+    });
+  }
+  for (auto& writer : writers) {
+    writer->join();
+  }
+
+  dcpl::rcu::context ctx;
+
+  EXPECT_EQ(umap.size(), num_writers * num_inserts);
+  for (int i = 0; i < num_writers * num_inserts; ++i) {
+    const int* value = umap.lookup(i);
+
+    ASSERT_NE(value, nullptr);
+    EXPECT_EQ(*value, i + 1);
+  }
+  EXPECT_EQ(umap.erase(0), 1);
+  EXPECT_EQ(umap.erase(0), 0);
+  EXPECT_FALSE(umap.contains(0));
+}
+
+TEST(SeqlockMap, Concurrency) {
+  struct record {
+    std::uint64_t count = 0;
+    std::uint64_t check = 0;
+  };
+
+  const int num_writers = 4;
+  const int num_keys = 100;
+  const int num_updates = 20000;
+  dcpl::seqlock_map<int, record> smap(num_keys);
+
+  EXPECT_GE(smap.capacity(), num_keys);
+
+  std::vector<std::unique_ptr<std::thread>> writers;
+
+  for (int w = 0; w < num_writers; ++w) {
+    auto thread_fn = [&, w]() {
+      for (int i = 0; i < num_updates; ++i) {
+        smap.update((w + i) % num_keys, [](record& rec) {
+          rec.count += 1;
+          rec.check = ~rec.count;
+        });
+      }
+    };
+
+    writers.push_back(dcpl::thread::create(thread_fn));
+  }
+
+  for (int i = 0; i < 10000; ++i) {
+    std::optional<record> rec = smap.find(i % num_keys);
+
+    if (rec) {
+      EXPECT_EQ(rec->check, ~rec->count);
+    }
+  }
+  for (auto& writer : writers) {
+    writer->join();
+  }
+
+  std::uint64_t total = 0;
+
+  EXPECT_EQ(smap.size(), num_keys);
+  smap.for_each([&](int, const record& rec) {
+    EXPECT_EQ(rec.check, ~rec.count);
+    total += rec.count;
+  });
+  EXPECT_EQ(total, num_writers * num_updates);
+
+  EXPECT_TRUE(smap.erase(7));
+  EXPECT_FALSE(smap.erase(7));
+  EXPECT_FALSE(smap.contains(7));
+  EXPECT_TRUE(smap.insert_or_assign(7, record{ 1, 2 }));
+  EXPECT_FALSE(smap.insert_or_assign(7, record{ 3, 4 }));
+  EXPECT_EQ(smap.find(7)->count, 3);
+  EXPECT_EQ(smap.size(), num_keys);
+
+  smap.clear();
+  EXPECT_TRUE(smap.empty());
+  EXPECT_FALSE(smap.find(7));
+
+  // Insert and erase churn, with the table kept close to full, so that entries
+  // overflow their groups.
+  std::mt19937 rng(43);
+  std::map<int, std::uint64_t> ref;
+
+  for (int i = 0; i < 50000; ++i) {
+    int key = static_cast<int>(rng() % 1000);
+
+    if (ref.size() < smap.capacity() - 4 && rng() % 2 == 0) {
+      EXPECT_EQ(smap.insert_or_assign(key, record{ 1, 0 }), ref.emplace(key, 1).second);
+    } else {
+      EXPECT_EQ(smap.erase(key), ref.erase(key) > 0);
+    }
+  }
+  EXPECT_EQ(smap.size(), ref.size());
+  for (int key = 0; key < 1000; ++key) {
+    EXPECT_EQ(smap.contains(key), ref.count(key) > 0) << key;
+  }
+}
+
 TEST(SuffixArray, Find) {
   std::vector<unsigned int> data{ 17, 21, 44, 97, 10, 11, 65, 3, 11, 19 };
   auto sa = dcpl::suffix_array::compute<std::uint32_t>(data);
@@ -900,6 +2003,634 @@ TEST(SuffixArray, Find) {
   EXPECT_NE(result.begin, result.end);
 }
 
+TEST(SuffixArray, SAIS) {
+  std::mt19937 rng(17);
+
+  for (std::size_t size : { 1, 2, 3, 10, 100, 1000, 10000 }) {
+    for (unsigned int vocab : { 1, 2, 4, 300 }) {
+      std::uniform_int_distribution<unsigned int> gen(1, vocab);
+      std::vector<unsigned int> data(size);
+
+      for (auto& value : data) {
+        value = gen(rng);
+      }
+
+      std::vector<std::uint32_t> sorted(size);
+
+      std::iota(sorted.begin(), sorted.end(), 0);
+      std::sort(sorted.begin(), sorted.end(), [&](std::uint32_t i1, std::uint32_t i2) {
+        return std::lexicographical_compare(data.begin() + i1, data.end(),
+                                            data.begin() + i2, data.end());
+      });
+
+      EXPECT_EQ(dcpl::suffix_array::compute_sais<std::uint32_t>(data), sorted);
+
+      // With a unique terminator cyclic shifts and suffixes sort the same.
+      data.push_back(0);
+      EXPECT_EQ(dcpl::suffix_array::compute_sais<std::uint32_t>(data),
+                dcpl::suffix_array::compute<std::uint32_t>(data));
+    }
+  }
+}
+
+TEST(SuffixArray, Parallel) {
+  std::mt19937 rng(21);
+  std::vector<std::vector<unsigned int>> inputs;
+
+  for (unsigned int vocab : { 1, 3, 1000 }) {
+    std::uniform_int_distribution<unsigned int> gen(0, vocab - 1);
+    std::vector<unsigned int> data(100000);
+
+    for (auto& value : data) {
+      value = gen(rng);
+    }
+    inputs.push_back(std::move(data));
+  }
+
+  // Long repeats make for many doubling rounds.
+  std::vector<unsigned int> repeats;
+
+  for (int i = 0; i < 50; ++i) {
+    repeats.insert(repeats.end(), inputs[1].begin(), inputs[1].begin() + 1000);
+  }
+  inputs.push_back(std::move(repeats));
+
+  for (const auto& data : inputs) {
+    EXPECT_EQ(dcpl::suffix_array::compute_parallel<std::uint32_t>(data, 4),
+              dcpl::suffix_array::compute_sais<std::uint32_t>(data));
+  }
+}
+
+TEST(SuffixArray, External) {
+  std::mt19937 rng(35);
+  std::uniform_int_distribution<unsigned int> gen(0, 3);
+  std::vector<unsigned int> data(20000);
+
+  for (auto& value : data) {
+    value = gen(rng);
+  }
+
+  // Long repeats (a run of the same symbol, and a periodic tail) take only a few
+  // more prefix doubling rounds.
+  data.insert(data.end(), 50000, 1);
+  for (std::size_t i = 0; i < 50000; ++i) {
+    data.push_back(static_cast<unsigned int>(i % 7));
+  }
+
+  auto sa = dcpl::suffix_array::compute_sais<std::uint32_t>(data);
+
+  for (std::size_t mem_budget : { 1 << 16, 1 << 22 }) {
+    dcpl::temp_path path;
+    dcpl::file::mmap sa_view =
+        dcpl::suffix_array::compute_external<std::uint32_t>(data, path, mem_budget, 2);
+    auto ext_sa = sa_view.data<std::uint32_t>();
+
+    EXPECT_TRUE(std::equal(sa.begin(), sa.end(), ext_sa.begin(), ext_sa.end()));
+  }
+}
+
+TEST(SuffixArray, LCP) {
+  std::mt19937 rng(33);
+
+  for (unsigned int vocab : { 1, 4, 1000 }) {
+    std::uniform_int_distribution<unsigned int> gen(0, vocab - 1);
+    std::vector<unsigned int> data(50000);
+
+    for (auto& value : data) {
+      value = gen(rng);
+    }
+
+    auto sa = dcpl::suffix_array::compute_sais<std::uint32_t>(data);
+    auto lcp = dcpl::suffix_array::compute_lcp<std::uint32_t>(data, sa);
+
+    ASSERT_EQ(lcp.size(), data.size());
+    EXPECT_EQ(lcp[0], 0);
+    for (std::size_t i = 1; i < sa.size(); i += 97) {
+      auto mit = std::mismatch(data.begin() + sa[i - 1], data.end(),
+                               data.begin() + sa[i], data.end());
+
+      EXPECT_EQ(lcp[i], mit.first - (data.begin() + sa[i - 1])) << i;
+    }
+    EXPECT_EQ(dcpl::suffix_array::compute_lcp_parallel<std::uint32_t>(data, sa, 4), lcp);
+  }
+}
+
+TEST(SuffixArray, Enhanced) {
+  using esa_type = dcpl::suffix_array::enhanced_suffix_array<std::vector<unsigned int>,
+                                                             std::vector<std::uint32_t>>;
+  std::mt19937 rng(34);
+  std::uniform_int_distribution<unsigned int> gen(0, 2);
+  std::vector<unsigned int> data(300);
+
+  for (auto& value : data) {
+    value = gen(rng);
+  }
+
+  auto sa = dcpl::suffix_array::compute_sais<std::uint32_t>(data);
+  esa_type esa(data, sa);
+
+  for (int i = 0; i < 200; ++i) {
+    std::size_t pos = rng() % data.size();
+    std::size_t size = 1 + rng() % 8;
+    std::vector<unsigned int> seq(data.begin() + pos,
+                         data.begin() + std::min(pos + size, data.size()));
+
+    if (i % 4 == 0) {
+      seq.back() = 3;
+    }
+
+    auto part = esa.find(seq);
+    std::size_t count = 0;
+
+    for (std::size_t j = 0; j + seq.size() <= data.size(); ++j) {
+      count += std::equal(seq.begin(), seq.end(), data.begin() + j);
+    }
+    EXPECT_EQ(part.end - part.begin, count);
+    for (std::size_t j = part.begin; j < part.end; ++j) {
+      ASSERT_LE(sa[j] + seq.size(), data.size());
+      EXPECT_TRUE(std::equal(seq.begin(), seq.end(), data.begin() + sa[j]));
+    }
+  }
+
+  // Long patterns over periodic data, where the lookups skip most of the symbols.
+  std::vector<unsigned int> periodic(500);
+
+  for (std::size_t i = 0; i < periodic.size(); ++i) {
+    periodic[i] = (i % 7) % 3;
+  }
+  periodic.back() = 3;
+
+  esa_type pesa(periodic, dcpl::suffix_array::compute_sais<std::uint32_t>(periodic));
+  auto count_matches = [&](const std::vector<unsigned int>& seq) {
+    std::size_t count = 0;
+
+    for (std::size_t j = 0; j + seq.size() <= periodic.size(); ++j) {
+      count += std::equal(seq.begin(), seq.end(), periodic.begin() + j);
+    }
+
+    return count;
+  };
+
+  for (std::size_t pos = 0; pos < periodic.size(); pos += 13) {
+    std::vector<unsigned int> seq(periodic.begin() + pos, periodic.end());
+
+    seq.resize(std::min<std::size_t>(seq.size(), 1 + pos % 97));
+
+    auto part = pesa.find(seq);
+
+    EXPECT_EQ(part.end - part.begin, count_matches(seq)) << pos;
+
+    seq.back() = (seq.back() + 1) % 3;
+    part = pesa.find(seq);
+    EXPECT_EQ(part.end - part.begin, count_matches(seq)) << pos;
+  }
+  EXPECT_EQ(pesa.find(std::vector<unsigned int>{}).end, periodic.size());
+
+  // The child intervals partition their parent, and share the parent prefix.
+  std::vector<esa_type::interval> intervals{ esa.root() };
+  std::size_t leaves = 0;
+
+  while (!intervals.empty()) {
+    auto parent = intervals.back();
+    auto children = esa.children(parent);
+
+    intervals.pop_back();
+    if (parent.end - parent.begin == 1) {
+      EXPECT_TRUE(children.empty());
+      EXPECT_EQ(parent.lcp, data.size() - sa[parent.begin]);
+      ++leaves;
+      continue;
+    }
+    ASSERT_GE(children.size(), 2);
+    EXPECT_EQ(children.front().begin, parent.begin);
+    EXPECT_EQ(children.back().end, parent.end);
+    for (std::size_t i = 0; i < children.size(); ++i) {
+      if (i > 0) {
+        EXPECT_EQ(children[i].begin, children[i - 1].end);
+        EXPECT_EQ(esa.lcp()[children[i].begin], parent.lcp);
+      }
+      // Only the suffix ending at the parent depth (always the first child) can
+      // be as long as the parent prefix.
+      EXPECT_GE(children[i].lcp, parent.lcp + (i > 0 ? 1 : 0));
+      intervals.push_back(children[i]);
+    }
+  }
+  EXPECT_EQ(leaves, data.size());
+
+  // Maximal repeats against a brute force enumeration of the repeated substrings.
+  std::set<std::pair<std::vector<unsigned int>, std::size_t>> repeats;
+  std::set<std::pair<std::vector<unsigned int>, std::size_t>> expected;
+
+  esa.maximal_repeats(2, [&](const esa_type::interval& rep) {
+    std::vector<unsigned int> seq(data.begin() + sa[rep.begin],
+                         data.begin() + sa[rep.begin] + rep.lcp);
+
+    repeats.emplace(std::move(seq), rep.end - rep.begin);
+  });
+  for (std::size_t size = 2; size < data.size(); ++size) {
+    std::map<std::vector<unsigned int>, std::vector<std::size_t>> occurrences;
+
+    for (std::size_t j = 0; j + size <= data.size(); ++j) {
+      occurrences[{ data.begin() + j, data.begin() + j + size }].push_back(j);
+    }
+    for (const auto& [seq, positions] : occurrences) {
+      std::set<long> lefts;
+      std::set<long> rights;
+
+      for (auto pos : positions) {
+        lefts.insert(pos > 0 ? static_cast<long>(data[pos - 1]) : -1 - static_cast<long>(pos));
+        rights.insert(pos + size < data.size() ? static_cast<long>(data[pos + size]) : -1);
+      }
+      if (positions.size() > 1 && lefts.size() > 1 && rights.size() > 1) {
+        expected.emplace(seq, positions.size());
+      }
+    }
+  }
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(repeats, expected);
+}
+
+TEST(SuffixArray, FindBatch) {
+  std::mt19937 rng(37);
+  std::uniform_int_distribution<unsigned int> gen(1, 3);
+  std::vector<std::uint8_t> data(20000);
+
+  for (auto& value : data) {
+    value = static_cast<std::uint8_t>(gen(rng));
+  }
+  // A unique terminator makes compute() and find() agree with compute_sais().
+  data.back() = 0;
+
+  auto sa = dcpl::suffix_array::compute_sais<std::uint32_t>(data);
+  std::vector<std::vector<std::uint8_t>> patterns;
+
+  for (int i = 0; i < 1000; ++i) {
+    std::size_t pos = rng() % data.size();
+    std::size_t size = 1 + rng() % 24;
+    std::vector<std::uint8_t> seq(data.begin() + pos,
+                                  data.begin() + std::min(pos + size, data.size()));
+
+    if (i % 5 == 0) {
+      seq.back() = 4;
+    }
+    patterns.push_back(seq);
+    if (i % 7 == 0) {
+      seq.resize(seq.size() / 2);
+      patterns.push_back(std::move(seq));
+    }
+  }
+
+  dcpl::suffix_array::partition whole{ 0, sa.size(), 0 };
+
+  EXPECT_EQ(dcpl::suffix_array::compute<std::uint32_t>(data), sa);
+  for (std::size_t num_threads : { std::size_t{ 1 }, std::size_t{ 4 }, dcpl::consts::all }) {
+    auto results = dcpl::suffix_array::find_batch(data, sa, patterns, whole, num_threads);
+
+    ASSERT_EQ(results.size(), patterns.size());
+    for (std::size_t i = 0; i < patterns.size(); ++i) {
+      EXPECT_EQ(results[i], dcpl::suffix_array::find(data, sa, patterns[i], whole)) << i;
+    }
+  }
+}
+
+TEST(SuffixArray, SampleIndex) {
+  std::mt19937 rng(38);
+  std::uniform_int_distribution<unsigned int> gen(0, 5);
+  std::vector<unsigned int> data(20000);
+
+  for (auto& value : data) {
+    value = gen(rng);
+  }
+
+  auto sa = dcpl::suffix_array::compute_sais<std::uint32_t>(data);
+  dcpl::suffix_array::sample_index<unsigned int> index(data, sa, 16, 4);
+  dcpl::suffix_array::sample_index<unsigned int> loaded;
+  std::stringstream stream;
+  {
+    dcpl::archive ar(&stream);
+
+    ar.store(index);
+  }
+  {
+    dcpl::archive ar(&stream);
+
+    ar.load(loaded);
+  }
+
+  dcpl::suffix_array::partition whole{ 0, sa.size(), 0 };
+  std::size_t narrowed = 0;
+
+  for (int i = 0; i < 500; ++i) {
+    std::size_t pos = rng() % data.size();
+    std::size_t size = 1 + rng() % 12;
+    std::vector<unsigned int> seq(data.begin() + pos,
+                                  data.begin() + std::min(pos + size, data.size()));
+
+    if (i % 5 == 0) {
+      seq.back() = 6;
+    }
+
+    std::vector<std::vector<unsigned int>> patterns{ seq };
+    auto expected = dcpl::suffix_array::find_batch(data, sa, patterns, whole, 1);
+    auto part = index.narrow(seq);
+
+    if (expected[0].begin != expected[0].end) {
+      EXPECT_LE(part.begin, expected[0].begin);
+      EXPECT_GE(part.end, expected[0].end);
+      narrowed += (part.end - part.begin) - (expected[0].end - expected[0].begin);
+    }
+    EXPECT_EQ(index.find(data, sa, seq), expected[0]);
+    EXPECT_EQ(loaded.find(data, sa, seq), expected[0]);
+  }
+  // Past the matches, the fine search is left with few rows on average.
+  EXPECT_LT(narrowed, 500 * 64);
+}
+
+TEST(SuffixArray, Generalized) {
+  using gsa_type =
+      dcpl::suffix_array::generalized_suffix_array<std::vector<unsigned int>,
+                                                   std::vector<std::uint32_t>>;
+  static const unsigned int separator = 100;
+  std::mt19937 rng(39);
+  std::uniform_int_distribution<unsigned int> gen(0, 7);
+  std::vector<std::vector<unsigned int>> documents(50);
+
+  for (auto& doc : documents) {
+    doc.resize(rng() % 400);
+    for (auto& value : doc) {
+      value = gen(rng);
+    }
+  }
+
+  gsa_type gsa = gsa_type::create(documents, separator, 2);
+
+  ASSERT_EQ(gsa.num_documents(), documents.size());
+
+  // Document starts must begin with zero and be strictly increasing.
+  for (std::vector<std::size_t> doc_starts :
+           { std::vector<std::size_t>{}, std::vector<std::size_t>{ 1 },
+             std::vector<std::size_t>{ 0, 5, 5 } }) {
+    EXPECT_THROW({
+        gsa_type(gsa.data(), gsa.suffix_array(), separator, doc_starts);
+      }, std::runtime_error);
+  }
+  for (std::size_t i = 0; i < documents.size(); ++i) {
+    auto [begin, end] = gsa.document_range(i);
+
+    ASSERT_EQ(end - begin, documents[i].size());
+    EXPECT_TRUE(std::equal(documents[i].begin(), documents[i].end(),
+                           gsa.data().begin() + begin));
+    EXPECT_EQ(gsa.document(begin), i);
+    EXPECT_EQ(gsa.document(end), i);
+  }
+
+  for (int i = 0; i < 200; ++i) {
+    std::vector<unsigned int> seq(1 + rng() % 6);
+
+    for (auto& value : seq) {
+      value = gen(rng);
+    }
+
+    std::vector<gsa_type::document_count> expected;
+
+    for (std::size_t j = 0; j < documents.size(); ++j) {
+      const auto& doc = documents[j];
+      std::size_t count = 0;
+
+      for (std::size_t k = 0; k + seq.size() <= doc.size(); ++k) {
+        count += std::equal(seq.begin(), seq.end(), doc.begin() + k);
+      }
+      if (count > 0) {
+        expected.push_back({ j, count });
+      }
+    }
+
+    auto part = gsa.find(seq);
+    std::vector<std::size_t> expected_docs;
+
+    for (const auto& dcount : expected) {
+      expected_docs.push_back(dcount.doc);
+    }
+
+    EXPECT_EQ(gsa.document_frequencies(part), expected);
+    EXPECT_EQ(gsa.list_documents(part), expected_docs);
+    EXPECT_EQ(gsa.count_documents(part), expected.size());
+  }
+
+  // Fuzzy matches of a query made of the end of a document and the start of the
+  // next one stay within a single document.
+  std::uniform_int_distribution<unsigned int> wide_gen(0, 4999);
+  std::vector<std::vector<unsigned int>> wide_documents(20);
+
+  for (auto& doc : wide_documents) {
+    doc.resize(100 + rng() % 100);
+    for (auto& value : doc) {
+      value = wide_gen(rng);
+    }
+  }
+
+  gsa_type wide_gsa = gsa_type::create(wide_documents, 5000);
+  dcpl::sequence::sequence_index<std::vector<unsigned int>, std::vector<std::uint32_t>>
+      index(wide_gsa.data(), wide_gsa.suffix_array(), wide_gsa.doc_starts());
+  decltype(index)::fuzzy_params params;
+
+  EXPECT_THROW({
+      decltype(index)(wide_gsa.data(), wide_gsa.suffix_array(), { 0, 5, 5 });
+    }, std::runtime_error);
+  std::vector<unsigned int> query;
+
+  query.insert(query.end(), wide_documents[3].end() - 30, wide_documents[3].end());
+  query.insert(query.end(), wide_documents[4].begin(), wide_documents[4].begin() + 20);
+  // Anchors past the ones of the documents above, for their group to be evaluated.
+  query.insert(query.end(), wide_documents[10].begin(), wide_documents[10].begin() + 5);
+  params.max_edit = 0.3;
+
+  auto matches = index.fuzzy_search(query, params);
+
+  EXPECT_FALSE(matches.empty());
+  for (const auto& match : matches) {
+    EXPECT_EQ(wide_gsa.document(match.data_begin), wide_gsa.document(match.data_end - 1));
+  }
+}
+
+TEST(SuffixArray, FMIndex) {
+  std::mt19937 rng(36);
+  std::uniform_int_distribution<unsigned int> gen(0, 49);
+  std::vector<unsigned int> data(20000);
+
+  for (auto& value : data) {
+    value = gen(rng);
+  }
+
+  auto sa = dcpl::suffix_array::compute_sais<std::uint32_t>(data);
+  dcpl::suffix_array::fm_index<std::uint32_t> index(data, sa, 16);
+
+  ASSERT_EQ(index.size(), sa.size());
+  for (std::size_t i = 0; i < sa.size(); ++i) {
+    ASSERT_EQ(index[i], sa[i]) << i;
+  }
+  EXPECT_LT(index.memory_size(), data.size() * sizeof(std::uint32_t));
+
+  for (int i = 0; i < 200; ++i) {
+    std::size_t pos = rng() % data.size();
+    std::size_t size = 1 + rng() % 4;
+    std::vector<unsigned int> seq(data.begin() + pos,
+                                  data.begin() + std::min(pos + size, data.size()));
+
+    if (i % 4 == 0) {
+      seq.front() = 50 + i % 2;
+    }
+
+    auto part = index.find(seq);
+    std::size_t count = 0;
+
+    for (std::size_t j = 0; j + seq.size() <= data.size(); ++j) {
+      count += std::equal(seq.begin(), seq.end(), data.begin() + j);
+    }
+    EXPECT_EQ(index.count(seq), count);
+    for (std::size_t j = part.begin; j < part.end; ++j) {
+      EXPECT_TRUE(std::equal(seq.begin(), seq.end(), data.begin() + sa[j]));
+    }
+  }
+
+  // The index works as the suffix array of a sequence_index.
+  std::vector<unsigned int> query(data.begin() + 1000, data.begin() + 1040);
+  dcpl::sequence::sequence_index<std::vector<unsigned int>, std::vector<std::uint32_t>>
+      sa_index(data, sa);
+  dcpl::sequence::sequence_index<std::vector<unsigned int>,
+                                 dcpl::suffix_array::fm_index<std::uint32_t>>
+      fm_seq_index(data, index);
+  decltype(sa_index)::fuzzy_params params;
+  decltype(fm_seq_index)::fuzzy_params fm_params;
+
+  // Symbols are too frequent in such a small vocabulary for the default limit.
+  params.prob_max = fm_params.prob_max = 0.05;
+  query[10] = 7;
+  query[20] = 9;
+
+  auto matches = sa_index.fuzzy_search(query, params);
+
+  EXPECT_FALSE(matches.empty());
+  auto fm_matches = fm_seq_index.fuzzy_search(query, fm_params);
+
+  ASSERT_EQ(fm_matches.size(), matches.size());
+  for (std::size_t i = 0; i < matches.size(); ++i) {
+    EXPECT_EQ(fm_matches[i].data_begin, matches[i].data_begin);
+    EXPECT_EQ(fm_matches[i].data_end, matches[i].data_end);
+  }
+}
+
+TEST(SuffixArray, Stats) {
+  using substring_map = std::map<std::vector<unsigned int>, std::size_t>;
+  std::mt19937 rng(41);
+  std::uniform_int_distribution<unsigned int> gen(0, 3);
+  std::vector<unsigned int> data(9000);
+
+  for (auto& value : data) {
+    value = gen(rng);
+  }
+
+  auto sa = dcpl::suffix_array::compute_sais<std::uint32_t>(data);
+  auto lcp = dcpl::suffix_array::compute_lcp<std::uint32_t>(data, sa);
+
+  auto brute_substrings = [&](std::size_t size, std::size_t min_count,
+                              std::size_t min_length, std::size_t max_length) {
+    substring_map counts;
+
+    for (std::size_t length = min_length; length <= max_length; ++length) {
+      for (std::size_t j = 0; j + length <= size; ++j) {
+        ++counts[{ data.begin() + j, data.begin() + j + length }];
+      }
+    }
+    std::erase_if(counts, [&](const auto& entry) { return entry.second < min_count; });
+
+    return counts;
+  };
+
+  // Every substring covered by a result is reported once, with its count.
+  auto substrings = [&](const auto& cdata, const auto& csa, const auto& clcp,
+                        std::size_t min_count, std::size_t min_length,
+                        std::size_t max_length, std::size_t num_threads) {
+    std::mutex mtx;
+    substring_map counts;
+
+    dcpl::suffix_array::frequent_substrings(
+        cdata, csa, clcp, min_count, min_length, max_length,
+        [&](const dcpl::suffix_array::substring_stat& stat) {
+          std::lock_guard guard(mtx);
+
+          EXPECT_EQ(stat.pos, csa[stat.begin]);
+          for (std::size_t length = stat.min_length; length <= stat.max_length; ++length) {
+            std::vector<unsigned int> seq(cdata.begin() + stat.pos,
+                                          cdata.begin() + stat.pos + length);
+
+            EXPECT_TRUE(counts.emplace(std::move(seq), stat.count()).second);
+          }
+        }, num_threads);
+
+    return counts;
+  };
+
+  auto expected = brute_substrings(data.size(), 3, 4, 12);
+
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(substrings(data, sa, lcp, 3, 4, 12, 1), expected);
+  EXPECT_EQ(substrings(data, sa, lcp, 3, 4, 12, 4), expected);
+
+  // With min_count one, the substrings occurring once are reported too.
+  std::vector<unsigned int> small_data(data.begin(), data.begin() + 200);
+  auto small_sa = dcpl::suffix_array::compute_sais<std::uint32_t>(small_data);
+  auto small_lcp = dcpl::suffix_array::compute_lcp<std::uint32_t>(small_data, small_sa);
+
+  EXPECT_EQ(substrings(small_data, small_sa, small_lcp, 1, 1, 20, 1),
+            brute_substrings(small_data.size(), 1, 1, 20));
+
+  // Top n-grams against brute force counts.
+  for (std::size_t num_threads : { 1, 4 }) {
+    auto top = dcpl::suffix_array::top_ngrams(sa, lcp, 5, 20, num_threads);
+    auto ngrams = brute_substrings(data.size(), 1, 5, 5);
+    std::vector<std::size_t> counts;
+
+    for (const auto& [seq, count] : ngrams) {
+      counts.push_back(count);
+    }
+    std::sort(counts.begin(), counts.end(), std::greater<std::size_t>());
+
+    ASSERT_EQ(top.size(), 20);
+    for (std::size_t i = 0; i < top.size(); ++i) {
+      std::vector<unsigned int> seq(data.begin() + top[i].pos, data.begin() + top[i].pos + 5);
+
+      EXPECT_EQ(top[i].count(), counts[i]);
+      EXPECT_EQ(ngrams[seq], top[i].count());
+    }
+  }
+
+  // Maximal repeats, split among threads, match the sequential ones.
+  auto repeats = [&](std::size_t num_threads) {
+    std::mutex mtx;
+    std::vector<dcpl::suffix_array::substring_stat> stats;
+
+    dcpl::suffix_array::maximal_repeats(data, sa, lcp, 6,
+                                        [&](const dcpl::suffix_array::substring_stat& stat) {
+                                          std::lock_guard guard(mtx);
+
+                                          stats.push_back(stat);
+                                        }, num_threads);
+    std::sort(stats.begin(), stats.end());
+
+    return stats;
+  };
+  auto seq_repeats = repeats(1);
+
+  EXPECT_FALSE(seq_repeats.empty());
+  EXPECT_EQ(repeats(4), seq_repeats);
+  for (const auto& stat : seq_repeats) {
+    EXPECT_GE(stat.min_length, 6);
+    EXPECT_EQ(stat.min_length, stat.max_length);
+    EXPECT_GE(stat.count(), 2);
+  }
+}
+
 TEST(MultiMergeSort, Basic) {
   std::vector<int> v1{ 1, 4, 7, 10 };
   std::vector<int> v2{ 2, 5, 8, 11 };